@@ -4,8 +4,13 @@ in	vec2 TexCoord;
 out vec4 color;
 
 uniform sampler2D ourTexture;
+uniform bool SwapRB;			// Raw ZED frames are BGRA, swizzle here instead of cv::cvtColor
 
 void main()
 {
 	color = texture(ourTexture, TexCoord);
+	if (SwapRB)
+	{
+		color = color.bgra;
+	}
 }
\ No newline at end of file
@@ -3,9 +3,15 @@ layout (location = 0) in vec2 position;
 layout (location = 1) in vec2 texCoord;
 
 out vec2 TexCoord;
+
+uniform bool FlipY;				// Raw camera rows are top-down, flip here instead of cv::flip
+uniform vec4 TexRect;			// Sub-rectangle of the texture to sample (offset.xy, size.zw), (0, 0, 1, 1) for all of it
+uniform mat3 ReprojMat;			// NDC homography for camera timewarp, identity otherwise
 									   
 void main()
 {
-	gl_Position = vec4(position, 0, 1.0);
-	TexCoord = texCoord;
+	vec3 warpedPos = ReprojMat * vec3(position, 1.0);
+	gl_Position = vec4(warpedPos.xy, 0, warpedPos.z);
+	vec2 quadCoord = FlipY ? vec2(texCoord.x, 1.0 - texCoord.y) : texCoord;
+	TexCoord = TexRect.xy + quadCoord * TexRect.zw;
 }
\ No newline at end of file
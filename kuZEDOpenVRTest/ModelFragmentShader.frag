@@ -13,17 +13,26 @@ in vec2 TexCoord;
 
 out vec4 color;
 
-uniform vec3 CamPos;
+layout (std140) uniform FrameData {
+	vec4 CamPos;			// xyz used
+};
+
+// Must match the declaration in ModelVertexShader.vert
+layout (std140) uniform ObjectData {
+	mat4 ModelMat;
+	mat3 NormalMat;
+	vec4 ObjColor;
+};
+
 uniform Material material;
 uniform sampler2D ourTexture;
-uniform vec4 ObjColor;
 
 
 void main()
 {    
 	vec3 LightColor = vec3(1.0, 1.0, 1.0);
-	vec3 LightPos   = CamPos;
-	vec3 viewPos    = CamPos;
+	vec3 LightPos   = CamPos.xyz;
+	vec3 viewPos    = CamPos.xyz;
 
 	// Ambient
 	vec3 ambient = LightColor * material.ambient;
@@ -1,28 +1,78 @@
-#version 410 core
+#version 430 core
 
-uniform mat4 matrix;
-uniform mat4 ModelMat;
-uniform mat4 ViewMat;
-uniform mat4 ProjMat;
+// std140 blocks filled by kuUniformRing, see kuUniformRing.h for the C++ side
+layout (std140) uniform EyeData {
+	mat4 ViewProjMat[2];	// Per view, view = gl_InstanceID
+	int  NumViews;			// 2: single-pass stereo, each view drawn into its half of a double-wide target
+};
+
+layout (std140) uniform ObjectData {
+	mat4 ModelMat;
+	mat3 NormalMat;			// transpose(inverse(mat3(ModelMat))), computed on the CPU
+	vec4 ObjColor;
+};
+
+uniform vec3 PositionOffset;		// Packed vertices: position = offset + scale * unorm16, (0, 0, 0) and (1, 1, 1) for float vertices
+uniform vec3 PositionScale;
+uniform bool OctahedralNormals;		// Packed vertices: normal.xy is an octahedral encoding
+uniform bool ArenaDraw;				// kuGeometryArena draw: position decode comes from Draws[DrawID] instead
+
+struct DrawData {
+	vec4 PositionOffset;
+	vec4 PositionScale;
+};
+
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+	DrawData Draws[];
+};
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 texCoord;
+layout (location = 3) in uint DrawID;	// Per instance, starts at the indirect command's baseInstance
 
 //out vec3 ourColor;
 out vec3 Normal;
 out vec3 FragPos;
+out float gl_ClipDistance[1];
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3  n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
 
 void main()
 {
-	gl_Position = ProjMat *  matrix /** ViewMat*/ * ModelMat * vec4(position, 1.0);
+	vec3 offset		 = ArenaDraw ? Draws[DrawID].PositionOffset.xyz : PositionOffset;
+	vec3 scale		 = ArenaDraw ? Draws[DrawID].PositionScale.xyz : PositionScale;
+	vec3 modelPos	 = offset + scale * position;
+	vec3 modelNormal = OctahedralNormals ? DecodeOctahedral(normal.xy) : normal;
+
+	vec4 worldPos = ModelMat * vec4(modelPos, 1.0);
+	int  view	  = min(gl_InstanceID, 1);
+	vec4 clipPos  = ViewProjMat[view] * worldPos;
+
+	// Squeeze the view into its half of the target, the clip plane keeps it from spilling into the other half
+	if (NumViews > 1)
+	{
+		gl_ClipDistance[0] = view == 0 ? clipPos.w - clipPos.x : clipPos.w + clipPos.x;
+		clipPos.x		   = 0.5 * clipPos.x + (view == 0 ? -0.5 : 0.5) * clipPos.w;
+	}
+	else
+	{
+		gl_ClipDistance[0] = 1.0;
+	}
+	gl_Position = clipPos;
 	//ourColor = vec3(1.0, 1.0, 1.0);
 
 	//FragPos = position;
 	//Normal  = normal;
 
-	FragPos = vec3(ModelMat * vec4(position, 1.0f));
-	Normal = mat3(transpose(inverse(ModelMat))) * normal;
+	FragPos = worldPos.xyz;
+	Normal = NormalMat * modelNormal;
 
 	//Normal = vec3(-Normal.x, -Normal.y, -Normal.z);
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "kuCameraTimewarp.h"
+
+// OpenVR head space is x right, y up, -z forward; the camera model is x right, y down, z forward
+static const glm::mat3 VRToCV(glm::vec3(1.0f, 0.0f, 0.0f),
+							  glm::vec3(0.0f, -1.0f, 0.0f),
+							  glm::vec3(0.0f, 0.0f, -1.0f));
+
+static glm::mat3 GetRotation(const vr::HmdMatrix34_t & pose)
+{
+	glm::mat3 rot;
+	for (int row = 0; row < 3; row++)
+	{
+		for (int col = 0; col < 3; col++)
+		{
+			rot[col][row] = pose.m[row][col];
+		}
+	}
+	return rot;
+}
+
+kuCameraTimewarp::kuCameraTimewarp()
+	: m_HistoryCount(0), m_HistoryHead(0), m_fCapturePoseValid(false)
+{
+	m_fIntrinsicValid[0] = false;
+	m_fIntrinsicValid[1] = false;
+}
+
+kuCameraTimewarp::~kuCameraTimewarp()
+{
+}
+
+void kuCameraTimewarp::SetIntrinsics(int eye, float fx, float fy, float cx, float cy, int width, int height)
+{
+	m_fIntrinsicValid[eye] = fx > 0.0f && fy > 0.0f;
+	if (!m_fIntrinsicValid[eye])
+	{
+		return;
+	}
+
+	glm::mat3 K(1.0f);
+	K[0][0] = fx;
+	K[1][1] = fy;
+	K[2][0] = cx;
+	K[2][1] = cy;
+	m_Intrinsic[eye] = K;
+
+	// The background pass draws image row 0 at NDC y = -1 (see BGImgVertexShader FlipY)
+	glm::mat3 N(1.0f);
+	N[0][0] = 0.5f * width;
+	N[2][0] = 0.5f * width;
+	N[1][1] = 0.5f * height;
+	N[2][1] = 0.5f * height;
+	m_NDCToPixel[eye] = N;
+}
+
+bool kuCameraTimewarp::HasIntrinsics(int eye)
+{
+	return m_fIntrinsicValid[eye];
+}
+
+void kuCameraTimewarp::AddHMDPose(uint64_t timeNs, const vr::HmdMatrix34_t & pose)
+{
+	m_History[m_HistoryHead].Time = timeNs;
+	m_History[m_HistoryHead].Pose = pose;
+
+	m_HistoryHead = (m_HistoryHead + 1) % kuPoseHistorySize;
+	if (m_HistoryCount < kuPoseHistorySize)
+	{
+		m_HistoryCount++;
+	}
+}
+
+bool kuCameraTimewarp::GetHMDPoseAt(uint64_t timeNs, vr::HmdMatrix34_t & pose)
+{
+	if (m_HistoryCount == 0)
+	{
+		return false;
+	}
+
+	// Walk back from the newest sample, the history is ordered in time
+	int		 best	  = (m_HistoryHead + kuPoseHistorySize - 1) % kuPoseHistorySize;
+	uint64_t bestDiff = UINT64_MAX;
+	for (int i = 0; i < m_HistoryCount; i++)
+	{
+		int		 index = (m_HistoryHead + kuPoseHistorySize - 1 - i) % kuPoseHistorySize;
+		uint64_t t	   = m_History[index].Time;
+		uint64_t diff  = t > timeNs ? t - timeNs : timeNs - t;
+
+		if (diff > bestDiff)
+		{
+			break;
+		}
+		bestDiff = diff;
+		best	 = index;
+	}
+
+	pose = m_History[best].Pose;
+	return true;
+}
+
+void kuCameraTimewarp::SetCaptureTime(uint64_t timeNs)
+{
+	m_fCapturePoseValid = this->GetHMDPoseAt(timeNs, m_CapturePose);
+}
+
+glm::mat3 kuCameraTimewarp::GetReprojection(int eye, const vr::HmdMatrix34_t & currentPose)
+{
+	if (!m_fCapturePoseValid || !m_fIntrinsicValid[eye])
+	{
+		return glm::mat3(1.0f);
+	}
+
+	// Rotation taking capture-time head coordinates to current head coordinates
+	glm::mat3 deltaRot = glm::transpose(GetRotation(currentPose)) * GetRotation(m_CapturePose);
+	glm::mat3 deltaCV  = VRToCV * deltaRot * VRToCV;
+
+	const glm::mat3 & K = m_Intrinsic[eye];
+	const glm::mat3 & N = m_NDCToPixel[eye];
+
+	return glm::inverse(N) * K * deltaCV * glm::inverse(K) * N;
+}
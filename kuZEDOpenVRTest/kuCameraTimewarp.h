@@ -0,0 +1,55 @@
+#ifndef KU_CAMERATIMEWARP_H
+#define KU_CAMERATIMEWARP_H
+
+#pragma once
+
+#include <stdint.h>
+#include <OpenVR.h>
+#include <GLM/glm.hpp>
+
+#define kuPoseHistorySize	256
+
+// Rotational reprojection of the camera image. The camera runs slower than the HMD,
+// so the last camera frame is reused and warped by the head rotation between the
+// moment it was captured and the pose the current HMD frame is rendered with.
+// The result is a homography in NDC of the background pass.
+class kuCameraTimewarp
+{
+public:
+	kuCameraTimewarp();
+	~kuCameraTimewarp();
+
+	// Pinhole intrinsics (pixels) of the image drawn for this eye
+	void		SetIntrinsics(int eye, float fx, float fy, float cx, float cy, int width, int height);
+	bool		HasIntrinsics(int eye);
+
+	// Called once per HMD frame with the pose the frame is rendered with
+	void		AddHMDPose(uint64_t timeNs, const vr::HmdMatrix34_t & pose);
+	// Nearest recorded pose, false if the history is empty
+	bool		GetHMDPoseAt(uint64_t timeNs, vr::HmdMatrix34_t & pose);
+
+	// Latches the HMD pose at the capture time of a newly arrived camera frame
+	void		SetCaptureTime(uint64_t timeNs);
+
+	// NDC homography mapping the captured image to where it appears from currentPose
+	glm::mat3	GetReprojection(int eye, const vr::HmdMatrix34_t & currentPose);
+
+private:
+	struct PoseSample {
+		uint64_t			Time;
+		vr::HmdMatrix34_t	Pose;
+	};
+
+	PoseSample			m_History[kuPoseHistorySize];
+	int					m_HistoryCount;
+	int					m_HistoryHead;
+
+	vr::HmdMatrix34_t	m_CapturePose;
+	bool				m_fCapturePoseValid;
+
+	glm::mat3			m_Intrinsic[2];
+	glm::mat3			m_NDCToPixel[2];
+	bool				m_fIntrinsicValid[2];
+};
+
+#endif // !KU_CAMERATIMEWARP_H
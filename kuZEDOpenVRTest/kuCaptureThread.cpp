@@ -0,0 +1,121 @@
+#include "kuCaptureThread.h"
+#include "kuTrace.h"
+
+kuCaptureThread::kuCaptureThread()
+	: m_Source(nullptr), m_fRunning(false), m_NumCapturedFrames(0), m_NumGrabFailures(0)
+{
+}
+
+kuCaptureThread::~kuCaptureThread()
+{
+	this->Stop();
+}
+
+bool kuCaptureThread::Start(kuStereoSource * source)
+{
+	if (m_fRunning || !source)
+	{
+		return false;
+	}
+
+	m_Source = source;
+
+	// Allocate all slots up front, the capture loop never allocates.
+	// Sources handing out their own images only need the layout set.
+	for (int i = 0; i < m_Frames.GetNumSlots(); i++)
+	{
+		kuStereoFrame & frame = m_Frames.GetSlot(i);
+		frame.SideBySide	 = m_Source->IsSideBySide();
+		frame.SequenceNumber = 0;
+		if (m_Source->ProvidesImages())
+		{
+			continue;
+		}
+
+		if (frame.SideBySide)
+		{
+			frame.Image[0].create(m_Source->GetHeight(), 2 * m_Source->GetWidth(), CV_8UC4);
+		}
+		else
+		{
+			for (int eye = 0; eye < 2; eye++)
+			{
+				frame.Image[eye].create(m_Source->GetHeight(), m_Source->GetWidth(), CV_8UC4);
+			}
+		}
+	}
+
+	m_fRunning = true;
+	m_Thread   = std::thread(&kuCaptureThread::CaptureLoop, this);
+
+	return true;
+}
+
+void kuCaptureThread::Stop()
+{
+	m_fRunning = false;
+
+	if (m_Thread.joinable())
+	{
+		m_Thread.join();
+	}
+}
+
+const kuStereoFrame * kuCaptureThread::AcquireLatestFrame(bool * isNewFrame)
+{
+	bool updated = m_Frames.Update();
+
+	if (isNewFrame)
+	{
+		*isNewFrame = updated;
+	}
+
+	const kuStereoFrame & frame = m_Frames.GetReadBuffer();
+	return frame.SequenceNumber ? &frame : nullptr;
+}
+
+uint64_t kuCaptureThread::GetNumCapturedFrames()
+{
+	return m_NumCapturedFrames;
+}
+
+uint64_t kuCaptureThread::GetNumGrabFailures()
+{
+	return m_NumGrabFailures;
+}
+
+void kuCaptureThread::CaptureLoop()
+{
+	uint64_t sequenceNumber = 0;
+
+	KU_PROFILE_THREAD_NAME("capture");
+
+	while (m_fRunning)
+	{
+		KU_PROFILE_ZONE("capture frame");
+
+		kuStereoFrame & frame = m_Frames.GetWriteBuffer();
+
+		KU_TIMELINE_CAM_BEGIN(sequenceNumber + 1);
+		KU_TIMELINE_CAM_STAMP(kuCamStamp_GrabBegin);
+
+		if (!m_Source->Grab(frame))
+		{
+			m_NumGrabFailures++;
+			std::this_thread::yield();
+			continue;
+		}
+
+		frame.SequenceNumber = ++sequenceNumber;
+		frame.HostTimestamp	 = kuGetTimeNs();
+
+		KU_TIMELINE_CAM_STAMP_AT(kuCamStamp_Exposure, frame.ExposureTimestamp);
+		KU_TIMELINE_CAM_STAMP_AT(kuCamStamp_RetrieveEnd, frame.HostTimestamp);
+
+		m_Frames.Publish();
+		m_NumCapturedFrames++;
+
+		KU_TIMELINE_CAM_STAMP(kuCamStamp_Published);
+		KU_TIMELINE_CAM_END();
+	}
+}
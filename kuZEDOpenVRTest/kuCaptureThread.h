@@ -0,0 +1,43 @@
+#ifndef KU_CAPTURETHREAD_H
+#define KU_CAPTURETHREAD_H
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "kuStereoSource.h"
+#include "kuTripleBuffer.h"
+
+// Runs grab/retrieve of a kuStereoSource on its own thread and publishes every
+// completed stereo pair through a triple buffer. The render loop picks up the
+// newest frame with AcquireLatestFrame() and never blocks on the camera.
+class kuCaptureThread
+{
+public:
+	kuCaptureThread();
+	~kuCaptureThread();
+
+	bool	Start(kuStereoSource * source);
+	void	Stop();
+
+	// Render thread only. Returns the newest completed frame (nullptr before the first one).
+	// The frame stays valid until the next call. isNewFrame tells whether it changed since the last call.
+	const kuStereoFrame *	AcquireLatestFrame(bool * isNewFrame = nullptr);
+
+	uint64_t	GetNumCapturedFrames();
+	uint64_t	GetNumGrabFailures();
+
+private:
+	kuStereoSource				*	m_Source;
+	kuTripleBuffer<kuStereoFrame>	m_Frames;
+
+	std::thread						m_Thread;
+	std::atomic<bool>				m_fRunning;
+	std::atomic<uint64_t>			m_NumCapturedFrames;
+	std::atomic<uint64_t>			m_NumGrabFailures;
+
+	void	CaptureLoop();
+};
+
+#endif // !KU_CAPTURETHREAD_H
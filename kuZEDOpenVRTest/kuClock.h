@@ -0,0 +1,25 @@
+#ifndef KU_CLOCK_H
+#define KU_CLOCK_H
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+// Monotonic host time in nanoseconds. Every subsystem stamps with this clock so
+// timestamps taken on different threads can be compared directly.
+inline uint64_t kuGetTimeNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Wall-clock (Unix epoch) nanoseconds, e.g. a ZED image timestamp, moved to the kuGetTimeNs() clock
+inline uint64_t kuSystemTimeToHostNs(uint64_t systemNs)
+{
+	int64_t systemNow = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	return (uint64_t)((int64_t)kuGetTimeNs() - (systemNow - (int64_t)systemNs));
+}
+
+#endif // !KU_CLOCK_H
@@ -0,0 +1,203 @@
+#include "kuColorConvert.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KU_X86_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define KU_X86_SIMD 0
+#endif
+
+// MSVC compiles intrinsics of any level without /arch, GCC and Clang need them enabled per function
+#if KU_X86_SIMD && !defined(_MSC_VER)
+#define KU_TARGET_SSE4	__attribute__((target("sse4.1")))
+#define KU_TARGET_AVX2	__attribute__((target("avx2")))
+#else
+#define KU_TARGET_SSE4
+#define KU_TARGET_AVX2
+#endif
+
+typedef void (*kuConvertRowFunc)(const uint8_t * src, uint8_t * dst, int width);
+
+static void ConvertRowScalar(const uint8_t * src, uint8_t * dst, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+
+		src += 4;
+		dst += 3;
+	}
+}
+
+#if KU_X86_SIMD
+KU_TARGET_SSE4 static void ConvertRowSSE4(const uint8_t * src, uint8_t * dst, int width)
+{
+	// 4 pixels -> 12 bytes packed in the low part of the register, top 4 bytes zeroed
+	const __m128i shuffleMask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src)), shuffleMask);
+		__m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 16)), shuffleMask);
+		__m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 32)), shuffleMask);
+		__m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 48)), shuffleMask);
+
+		// Stitch 4 x 12 bytes into 3 x 16 bytes
+		_mm_storeu_si128((__m128i *)(dst),		_mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+		_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+		_mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+
+		src += 64;
+		dst += 48;
+	}
+
+	ConvertRowScalar(src, dst, width - x);
+}
+
+KU_TARGET_AVX2 static void ConvertRowAVX2(const uint8_t * src, uint8_t * dst, int width)
+{
+	// pshufb works per 128 bit lane, so each lane packs its 4 pixels into dwords 0-2
+	// and the cross-lane permute joins them into 24 contiguous bytes
+	const __m256i shuffleMask = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+												 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i packMask	  = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+	int x = 0;
+	for (; x + 16 <= width; x += 16)
+	{
+		__m256i p0 = _mm256_loadu_si256((const __m256i *)(src));
+		__m256i p1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+		p0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p0, shuffleMask), packMask);
+		p1 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p1, shuffleMask), packMask);
+
+		// 2 x 24 bytes -> 48 bytes
+		__m128i p0Lo = _mm256_castsi256_si128(p0);
+		__m128i p0Hi = _mm256_extracti128_si256(p0, 1);
+		__m128i p1Lo = _mm256_castsi256_si128(p1);
+		__m128i p1Hi = _mm256_extracti128_si256(p1, 1);
+
+		_mm_storeu_si128((__m128i *)(dst),		p0Lo);
+		_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpacklo_epi64(p0Hi, p1Lo));
+		_mm_storeu_si128((__m128i *)(dst + 32), _mm_alignr_epi8(p1Hi, p1Lo, 8));
+
+		src += 64;
+		dst += 48;
+	}
+
+	ConvertRowScalar(src, dst, width - x);
+}
+
+static bool CPUSupportsAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx	 = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)			// OS must save YMM state
+	{
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+static bool CPUSupportsSSE4()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 19)) != 0 && (info[2] & (1 << 9)) != 0;		// SSE4.1 + SSSE3
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+#endif
+}
+#endif
+
+static kuSIMDLevel DetectSIMDLevel()
+{
+#if KU_X86_SIMD
+	if (CPUSupportsAVX2())
+	{
+		return kuSIMD_AVX2;
+	}
+	if (CPUSupportsSSE4())
+	{
+		return kuSIMD_SSE4;
+	}
+#endif
+	return kuSIMD_Scalar;
+}
+
+static kuConvertRowFunc GetRowFunc(kuSIMDLevel level)
+{
+#if KU_X86_SIMD
+	switch (level)
+	{
+	case kuSIMD_AVX2: return ConvertRowAVX2;
+	case kuSIMD_SSE4: return ConvertRowSSE4;
+	default:		  break;
+	}
+#endif
+	return ConvertRowScalar;
+}
+
+static const kuSIMDLevel	SupportedSIMDLevel = DetectSIMDLevel();
+static kuSIMDLevel			ActiveSIMDLevel	   = SupportedSIMDLevel;
+static kuConvertRowFunc		ActiveRowFunc	   = GetRowFunc(SupportedSIMDLevel);
+
+void kuConvertRGBAToBGRFlip(const uint8_t * src, size_t srcStep, uint8_t * dst, size_t dstStep, int width, int height)
+{
+	kuConvertRowFunc convertRow = ActiveRowFunc;
+
+	for (int y = 0; y < height; y++)
+	{
+		convertRow(src + y * srcStep, dst + (height - 1 - y) * dstStep, width);
+	}
+}
+
+void kuConvertRGBAToBGRFlip(const cv::Mat & src, cv::Mat & dst)
+{
+	CV_Assert(src.type() == CV_8UC4 && src.data != dst.data);
+
+	dst.create(src.rows, src.cols, CV_8UC3);
+
+	kuConvertRGBAToBGRFlip(src.data, src.step, dst.data, dst.step, src.cols, src.rows);
+}
+
+kuSIMDLevel kuGetColorConvertSIMDLevel()
+{
+	return ActiveSIMDLevel;
+}
+
+void kuSetColorConvertSIMDLevel(kuSIMDLevel level)
+{
+	ActiveSIMDLevel = level < SupportedSIMDLevel ? level : SupportedSIMDLevel;
+	ActiveRowFunc	= GetRowFunc(ActiveSIMDLevel);
+}
+
+const char * kuGetSIMDLevelName(kuSIMDLevel level)
+{
+	switch (level)
+	{
+	case kuSIMD_AVX2: return "AVX2";
+	case kuSIMD_SSE4: return "SSE4";
+	default:		  return "Scalar";
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef KU_COLORCONVERT_H
+#define KU_COLORCONVERT_H
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+enum kuSIMDLevel { kuSIMD_Scalar, kuSIMD_SSE4, kuSIMD_AVX2 };
+
+// Single pass equivalent of
+//		cv::cvtColor(src, dst, CV_RGBA2BGR);
+//		cv::flip(dst, dst, 0);
+// 4 channel source to 3 channel destination, channels 0 and 2 swapped, alpha dropped,
+// rows written bottom-up. dst must not alias src. The kernel is picked at runtime
+// from the best instruction set the CPU supports.
+void		kuConvertRGBAToBGRFlip(const uint8_t * src, size_t srcStep, uint8_t * dst, size_t dstStep, int width, int height);
+// dst is only (re)allocated if it is not already a matching CV_8UC3 image
+void		kuConvertRGBAToBGRFlip(const cv::Mat & src, cv::Mat & dst);
+
+kuSIMDLevel	kuGetColorConvertSIMDLevel();
+// Forces a kernel (clamped to what the CPU supports), used by the benchmark
+void		kuSetColorConvertSIMDLevel(kuSIMDLevel level);
+const char*	kuGetSIMDLevelName(kuSIMDLevel level);
+
+// Compares the fused kernels against cvtColor + flip at 720p and 1080p and prints the results
+void		kuRunColorConvertBenchmark();
+
+#endif // !KU_COLORCONVERT_H
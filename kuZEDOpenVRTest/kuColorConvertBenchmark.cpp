@@ -0,0 +1,74 @@
+#include "kuColorConvert.h"
+
+#include <iostream>
+#include <iomanip>
+
+#include "kuClock.h"
+
+static double TimeOpenCV(const cv::Mat & src, cv::Mat & dst, int iterations)
+{
+	// Exactly what the render loop used to do: two full passes over the frame
+	uint64_t begin = kuGetTimeNs();
+	for (int i = 0; i < iterations; i++)
+	{
+		cv::cvtColor(src, dst, CV_RGBA2BGR);
+		cv::flip(dst, dst, 0);
+	}
+	return (kuGetTimeNs() - begin) * 1e-6 / iterations;
+}
+
+static double TimeFused(const cv::Mat & src, cv::Mat & dst, int iterations)
+{
+	uint64_t begin = kuGetTimeNs();
+	for (int i = 0; i < iterations; i++)
+	{
+		kuConvertRGBAToBGRFlip(src, dst);
+	}
+	return (kuGetTimeNs() - begin) * 1e-6 / iterations;
+}
+
+void kuRunColorConvertBenchmark()
+{
+	const int	iterations	  = 200;
+	const int	resolutions[] = { 1280, 720,
+								  1920, 1080 };
+
+	kuSIMDLevel bestLevel = kuGetColorConvertSIMDLevel();
+
+	std::cout << "RGBA -> BGR + vertical flip, " << iterations << " iterations, best kernel: "
+			  << kuGetSIMDLevelName(bestLevel) << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	for (int r = 0; r < 2; r++)
+	{
+		int width  = resolutions[2 * r];
+		int height = resolutions[2 * r + 1];
+
+		cv::Mat src(height, width, CV_8UC4);
+		cv::randu(src, cv::Scalar(0, 0, 0, 0), cv::Scalar(256, 256, 256, 256));
+
+		// Preallocated destinations, as in the render loop
+		cv::Mat dstCV(height, width, CV_8UC3);
+		cv::Mat dstFused(height, width, CV_8UC3);
+
+		TimeOpenCV(src, dstCV, 5);											// Warm up
+		double timeCV = TimeOpenCV(src, dstCV, iterations);
+
+		std::cout << width << "x" << height << "  cvtColor + flip: " << timeCV << " ms" << std::endl;
+
+		for (int level = kuSIMD_Scalar; level <= bestLevel; level++)
+		{
+			kuSetColorConvertSIMDLevel((kuSIMDLevel)level);
+
+			TimeFused(src, dstFused, 5);
+			double timeFused = TimeFused(src, dstFused, iterations);
+			bool   match	 = cv::norm(dstCV, dstFused, cv::NORM_INF) == 0.0;
+
+			std::cout << width << "x" << height << "  fused " << std::setw(6) << kuGetSIMDLevelName((kuSIMDLevel)level)
+					  << ": " << timeFused << " ms (x" << timeCV / timeFused << ")"
+					  << (match ? "" : "  MISMATCH") << std::endl;
+		}
+	}
+
+	kuSetColorConvertSIMDLevel(bestLevel);
+}
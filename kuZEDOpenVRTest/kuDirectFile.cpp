@@ -0,0 +1,228 @@
+#include "kuDirectFile.h"
+
+#include <string.h>
+#include <iostream>
+
+#include "kuClock.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+// Unbuffered writes need sector aligned memory, offsets and sizes. 4 KB covers every current disk.
+static const size_t kuDirectAlignment = 4096;
+
+kuDirectFile::kuDirectFile()
+	: m_fUnbuffered(false), m_fFailed(false), m_Block(nullptr), m_BlockSize(0), m_BlockFill(0), m_Size(0),
+	  m_NumBlocks(0), m_WriteTime(0.0)
+#ifdef _WIN32
+	, m_FileHandle(INVALID_HANDLE_VALUE)
+#else
+	, m_FileDescriptor(-1)
+#endif
+{
+}
+
+kuDirectFile::~kuDirectFile()
+{
+	this->Close();
+}
+
+bool kuDirectFile::Open(const char * path, size_t blockSize)
+{
+	this->Close();
+
+	m_Path		= path;
+	m_BlockSize = (blockSize + kuDirectAlignment - 1) & ~(kuDirectAlignment - 1);
+
+#ifdef _WIN32
+	m_Block		 = (uint8_t *)_aligned_malloc(m_BlockSize, kuDirectAlignment);
+	m_FileHandle = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+							   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	m_fUnbuffered = m_FileHandle != INVALID_HANDLE_VALUE;
+	if (!m_fUnbuffered)
+	{
+		m_FileHandle = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	}
+	bool opened = m_FileHandle != INVALID_HANDLE_VALUE;
+#else
+	if (posix_memalign((void **)&m_Block, kuDirectAlignment, m_BlockSize) != 0)
+	{
+		m_Block = nullptr;
+	}
+#ifdef O_DIRECT
+	m_FileDescriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+#endif
+	m_fUnbuffered = m_FileDescriptor >= 0;
+	if (!m_fUnbuffered)
+	{
+		m_FileDescriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	bool opened = m_FileDescriptor >= 0;
+#endif
+
+	if (!opened || !m_Block)
+	{
+		std::cout << "DirectFile: cannot open " << path << std::endl;
+		this->Close();
+		return false;
+	}
+	if (!m_fUnbuffered)
+	{
+		std::cout << "DirectFile: " << path << " does not support unbuffered writes, using the file cache." << std::endl;
+	}
+
+	m_fFailed	= false;
+	m_BlockFill = 0;
+	m_Size		= 0;
+	m_NumBlocks = 0;
+	m_WriteTime = 0.0;
+
+	return true;
+}
+
+bool kuDirectFile::Close()
+{
+	bool ok = !m_fFailed;
+
+#ifdef _WIN32
+	if (m_FileHandle != INVALID_HANDLE_VALUE)
+	{
+		// The tail goes out padded to the alignment, cut it back afterwards
+		if (m_BlockFill)
+		{
+			size_t padded = m_fUnbuffered ? (m_BlockFill + kuDirectAlignment - 1) & ~(kuDirectAlignment - 1) : m_BlockFill;
+			memset(m_Block + m_BlockFill, 0, padded - m_BlockFill);
+			ok &= WriteBlock(padded);
+		}
+		CloseHandle(m_FileHandle);
+		m_FileHandle = INVALID_HANDLE_VALUE;
+
+		HANDLE file = CreateFileA(m_Path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			LARGE_INTEGER size;
+			size.QuadPart = (LONGLONG)m_Size;
+			ok &= SetFilePointerEx(file, size, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+			CloseHandle(file);
+		}
+	}
+	if (m_Block)
+	{
+		_aligned_free(m_Block);
+	}
+#else
+	if (m_FileDescriptor >= 0)
+	{
+		if (m_BlockFill)
+		{
+			size_t padded = m_fUnbuffered ? (m_BlockFill + kuDirectAlignment - 1) & ~(kuDirectAlignment - 1) : m_BlockFill;
+			memset(m_Block + m_BlockFill, 0, padded - m_BlockFill);
+			ok &= WriteBlock(padded);
+		}
+		ok &= ftruncate(m_FileDescriptor, (off_t)m_Size) == 0;
+		close(m_FileDescriptor);
+		m_FileDescriptor = -1;
+	}
+	free(m_Block);
+#endif
+
+	m_Block		= nullptr;
+	m_BlockFill = 0;
+
+	return ok;
+}
+
+bool kuDirectFile::IsOpen()
+{
+	return m_Block != nullptr;
+}
+
+bool kuDirectFile::IsUnbuffered()
+{
+	return m_fUnbuffered;
+}
+
+bool kuDirectFile::WriteBlock(size_t size)
+{
+	uint64_t start = kuGetTimeNs();
+
+#ifdef _WIN32
+	DWORD written = 0;
+	bool  ok	  = WriteFile(m_FileHandle, m_Block, (DWORD)size, &written, nullptr) && written == size;
+#else
+	bool  ok	  = write(m_FileDescriptor, m_Block, size) == (ssize_t)size;
+#endif
+
+	m_WriteTime += (kuGetTimeNs() - start) * 1e-9;
+	m_NumBlocks++;
+
+	if (!ok && !m_fFailed)
+	{
+		std::cout << "DirectFile: write to " << m_Path << " failed at " << m_Size << " bytes." << std::endl;
+		m_fFailed = true;
+	}
+	return ok;
+}
+
+bool kuDirectFile::Write(const void * data, size_t size)
+{
+	const uint8_t * src = (const uint8_t *)data;
+
+	while (size)
+	{
+		size_t n = m_BlockSize - m_BlockFill < size ? m_BlockSize - m_BlockFill : size;
+		memcpy(m_Block + m_BlockFill, src, n);
+		m_BlockFill += n;
+		m_Size		+= n;
+		src			+= n;
+		size		-= n;
+
+		if (m_BlockFill == m_BlockSize)
+		{
+			WriteBlock(m_BlockSize);
+			m_BlockFill = 0;
+		}
+	}
+	return !m_fFailed;
+}
+
+bool kuDirectFile::WriteZeros(size_t size)
+{
+	while (size)
+	{
+		size_t n = m_BlockSize - m_BlockFill < size ? m_BlockSize - m_BlockFill : size;
+		memset(m_Block + m_BlockFill, 0, n);
+		m_BlockFill += n;
+		m_Size		+= n;
+		size		-= n;
+
+		if (m_BlockFill == m_BlockSize)
+		{
+			WriteBlock(m_BlockSize);
+			m_BlockFill = 0;
+		}
+	}
+	return !m_fFailed;
+}
+
+uint64_t kuDirectFile::GetSize()
+{
+	return m_Size;
+}
+
+uint64_t kuDirectFile::GetNumBlocksWritten()
+{
+	return m_NumBlocks;
+}
+
+double kuDirectFile::GetWriteTime()
+{
+	return m_WriteTime;
+}
@@ -0,0 +1,52 @@
+#ifndef KU_DIRECTFILE_H
+#define KU_DIRECTFILE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Sequential writer that bypasses the OS file cache (FILE_FLAG_NO_BUFFERING / O_DIRECT).
+// Data is gathered into an aligned block and written a whole block at a time, so
+// recording hundreds of MB/s neither evicts the page cache nor stalls on it. Falls back
+// to buffered writes where the file system does not support unbuffered I/O.
+class kuDirectFile
+{
+public:
+	kuDirectFile();
+	~kuDirectFile();
+
+	bool		Open(const char * path, size_t blockSize = 8 << 20);
+	// Flushes the last partial block and trims the file to the bytes written
+	bool		Close();
+	bool		IsOpen();
+	bool		IsUnbuffered();
+
+	bool		Write(const void * data, size_t size);
+	bool		WriteZeros(size_t size);
+	uint64_t	GetSize();											// Bytes written so far
+
+	uint64_t	GetNumBlocksWritten();
+	double		GetWriteTime();										// s spent in the write calls
+
+private:
+	std::string		m_Path;
+	bool			m_fUnbuffered;
+	bool			m_fFailed;
+	uint8_t		*	m_Block;
+	size_t			m_BlockSize;
+	size_t			m_BlockFill;
+	uint64_t		m_Size;
+	uint64_t		m_NumBlocks;
+	double			m_WriteTime;
+#ifdef _WIN32
+	void		*	m_FileHandle;
+#else
+	int				m_FileDescriptor;
+#endif
+
+	bool		WriteBlock(size_t size);
+};
+
+#endif // !KU_DIRECTFILE_H
@@ -0,0 +1,120 @@
+#include "kuFrameTimeline.h"
+
+#if KU_FRAME_TIMELINE
+
+#include <stdio.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+kuFrameTimeline	kuTimeline;
+
+struct kuTimelineInterval {
+	const char	*	Name;
+	bool			Camera;											// Camera ring, otherwise HMD ring
+	int				From;
+	int				To;
+};
+
+static const kuTimelineInterval Intervals[] = {
+	{ "camera exposure to grab",	true,	kuCamStamp_Exposure,		kuCamStamp_GrabEnd		},
+	{ "camera grab",				true,	kuCamStamp_GrabBegin,		kuCamStamp_GrabEnd		},
+	{ "camera retrieve",			true,	kuCamStamp_GrabEnd,			kuCamStamp_RetrieveEnd	},
+	{ "camera exposure to publish",	true,	kuCamStamp_Exposure,		kuCamStamp_Published	},
+	{ "compositor wait",			false,	kuHMDStamp_WaitBegin,		kuHMDStamp_WaitEnd		},
+	{ "convert + upload",			false,	kuHMDStamp_UploadBegin,		kuHMDStamp_UploadEnd	},
+	{ "content pass",				false,	kuHMDStamp_ContentBegin,	kuHMDStamp_ContentEnd	},
+	{ "eye draw",					false,	kuHMDStamp_DrawBegin,		kuHMDStamp_DrawEnd		},
+	{ "submit",						false,	kuHMDStamp_SubmitBegin,		kuHMDStamp_SubmitEnd	},
+	{ "frame CPU",					false,	kuHMDStamp_WaitEnd,			kuHMDStamp_SubmitEnd	},
+	{ "motion to photon",			false,	kuHMDStamp_PoseSample,		kuHMDStamp_Photon		},
+	{ "camera publish to photon",	false,	kuHMDStamp_CamPublished,	kuHMDStamp_Photon		},
+	{ "camera to photon",			false,	kuHMDStamp_CamExposure,		kuHMDStamp_Photon		},
+};
+
+// Nearest-rank percentile of sorted samples
+static double Percentile(const std::vector<double> & sorted, double p)
+{
+	size_t rank = (size_t)(p * 0.01 * sorted.size() + 0.5);
+	rank = rank < 1 ? 1 : (rank > sorted.size() ? sorted.size() : rank);
+	return sorted[rank - 1];
+}
+
+template <typename RecordType>
+static void CollectInterval(const RecordType * records, int numRecords, int from, int to, std::vector<double> & samples)
+{
+	for (int i = 0; i < numRecords; i++)
+	{
+		uint64_t begin = records[i].Time[from];
+		uint64_t end   = records[i].Time[to];
+		if (begin && end && end >= begin)
+		{
+			samples.push_back((end - begin) * 1e-6);					// ms
+		}
+	}
+}
+
+void kuFrameTimeline::Report(const char * path)
+{
+	typedef kuTimelineRing<kuNumCamStamps, kuCamTimelineSize>::Record CamRecord;
+	typedef kuTimelineRing<kuNumHMDStamps, kuHMDTimelineSize>::Record HMDRecord;
+
+	std::vector<CamRecord> camRecords(kuCamTimelineSize);
+	std::vector<HMDRecord> hmdRecords(kuHMDTimelineSize);
+
+	int numCam = Camera.Snapshot(camRecords.data(), kuCamTimelineSize);
+	int numHMD = HMD.Snapshot(hmdRecords.data(), kuHMDTimelineSize);
+
+	FILE * file = path ? fopen(path, "w") : nullptr;
+	if (file)
+	{
+		fprintf(file, "stage,samples,p50_ms,p95_ms,p99_ms,max_ms\n");
+	}
+
+	std::cout << "Frame timeline: " << numCam << " camera frames, " << numHMD << " HMD frames" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+
+	std::vector<double> samples;
+	for (size_t i = 0; i < sizeof(Intervals) / sizeof(Intervals[0]); i++)
+	{
+		const kuTimelineInterval & interval = Intervals[i];
+
+		samples.clear();
+		if (interval.Camera)
+		{
+			CollectInterval(camRecords.data(), numCam, interval.From, interval.To, samples);
+		}
+		else
+		{
+			CollectInterval(hmdRecords.data(), numHMD, interval.From, interval.To, samples);
+		}
+
+		if (samples.empty())
+		{
+			continue;
+		}
+		std::sort(samples.begin(), samples.end());
+
+		double p50 = Percentile(samples, 50.0);
+		double p95 = Percentile(samples, 95.0);
+		double p99 = Percentile(samples, 99.0);
+
+		std::cout << "  " << std::left << std::setw(28) << interval.Name << std::right
+				  << " p50 " << std::setw(8) << p50 << "  p95 " << std::setw(8) << p95
+				  << "  p99 " << std::setw(8) << p99 << "  max " << std::setw(8) << samples.back()
+				  << " ms (" << samples.size() << ")" << std::endl;
+
+		if (file)
+		{
+			fprintf(file, "%s,%d,%.3f,%.3f,%.3f,%.3f\n", interval.Name, (int)samples.size(), p50, p95, p99, samples.back());
+		}
+	}
+
+	if (file)
+	{
+		fclose(file);
+	}
+}
+
+#endif // KU_FRAME_TIMELINE
@@ -0,0 +1,177 @@
+#ifndef KU_FRAMETIMELINE_H
+#define KU_FRAMETIMELINE_H
+
+#pragma once
+
+#ifndef KU_FRAME_TIMELINE
+#define KU_FRAME_TIMELINE	1								// 0: every KU_TIMELINE_* macro compiles to nothing
+#endif
+
+#include <stdint.h>
+
+#include "kuClock.h"
+
+// Stamps of one camera frame, taken on the capture thread
+enum kuCamStamp {
+	kuCamStamp_Exposure = 0,								// Image timestamp of the camera, host clock
+	kuCamStamp_GrabBegin,
+	kuCamStamp_GrabEnd,										// grab() returned
+	kuCamStamp_RetrieveEnd,									// Images copied out of the SDK
+	kuCamStamp_Published,									// Handed to the render thread
+	kuNumCamStamps
+};
+
+// Stamps of one HMD frame, taken on the render thread
+enum kuHMDStamp {
+	kuHMDStamp_WaitBegin = 0,								// Entering WaitGetPoses
+	kuHMDStamp_WaitEnd,										// Frame start
+	kuHMDStamp_CamExposure,									// Exposure / publish time of the camera frame shown
+	kuHMDStamp_CamPublished,
+	kuHMDStamp_UploadBegin,									// Colour conversion + texture upload of a new camera frame
+	kuHMDStamp_UploadEnd,
+	kuHMDStamp_PoseSample,									// Head pose measured by the late update
+	kuHMDStamp_ContentBegin,								// Camera image (re)projection pass
+	kuHMDStamp_ContentEnd,
+	kuHMDStamp_DrawBegin,									// Eye passes, background + model
+	kuHMDStamp_DrawEnd,
+	kuHMDStamp_SubmitBegin,
+	kuHMDStamp_SubmitEnd,
+	kuHMDStamp_Photon,										// Predicted photon time of the frame
+	kuNumHMDStamps
+};
+
+#if KU_FRAME_TIMELINE
+
+#include <atomic>
+#include <string.h>
+
+#define kuCamTimelineSize	2048
+#define kuHMDTimelineSize	4096
+
+// Fixed-size ring of per-frame stamp records with a single producer thread.
+// Stamps go to a private record, End() copies it into the ring under a per-slot
+// sequence counter, so any thread can take a consistent snapshot without locks.
+template <int NumStamps, int Size>
+class kuTimelineRing
+{
+public:
+	struct Record {
+		uint64_t	Id;
+		uint64_t	Time[NumStamps];								// 0 = not stamped this frame
+	};
+
+	kuTimelineRing() : m_Head(0)
+	{
+		for (int i = 0; i < Size; i++)
+		{
+			m_Slots[i].Seq.store(0, std::memory_order_relaxed);
+		}
+		memset(&m_Current, 0, sizeof(m_Current));
+	}
+
+	// Producer thread only
+	void Begin(uint64_t id)
+	{
+		memset(m_Current.Time, 0, sizeof(m_Current.Time));
+		m_Current.Id = id;
+	}
+
+	void Stamp(int stamp, uint64_t timeNs)
+	{
+		m_Current.Time[stamp] = timeNs;
+	}
+
+	void End()
+	{
+		uint64_t n	  = m_Head.load(std::memory_order_relaxed);
+		Slot	&slot = m_Slots[n % Size];
+
+		// Odd while being written
+		slot.Seq.store(2 * n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.Data = m_Current;
+		slot.Seq.store(2 * n + 2, std::memory_order_release);
+
+		m_Head.store(n + 1, std::memory_order_release);
+	}
+
+	// Any thread. Copies the completed records (oldest first), returns how many.
+	int Snapshot(Record * out, int maxRecords)
+	{
+		uint64_t head  = m_Head.load(std::memory_order_acquire);
+		uint64_t count = head < Size ? head : Size;
+		int		 num   = 0;
+
+		for (uint64_t n = head - count; n < head && num < maxRecords; n++)
+		{
+			const Slot & slot = m_Slots[n % Size];
+
+			uint64_t seq = slot.Seq.load(std::memory_order_acquire);
+			if (seq != 2 * n + 2)
+			{
+				continue;											// Being overwritten
+			}
+			out[num] = slot.Data;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.Seq.load(std::memory_order_relaxed) == seq)
+			{
+				num++;
+			}
+		}
+		return num;
+	}
+
+private:
+	struct Slot {
+		std::atomic<uint64_t>	Seq;
+		Record					Data;
+	};
+
+	alignas(64) std::atomic<uint64_t>	m_Head;
+	Record								m_Current;
+	Slot								m_Slots[Size];
+};
+
+// Per-frame timeline of the camera and HMD pipelines. Use through the KU_TIMELINE_* macros.
+class kuFrameTimeline
+{
+public:
+	kuTimelineRing<kuNumCamStamps, kuCamTimelineSize>	Camera;
+	kuTimelineRing<kuNumHMDStamps, kuHMDTimelineSize>	HMD;
+
+	// p50/p95/p99 of every stage interval over the frames still in the rings,
+	// printed and, if path is given, written as CSV
+	void	Report(const char * path = nullptr);
+};
+
+extern kuFrameTimeline	kuTimeline;
+
+#define KU_TIMELINE_CAM_BEGIN(id)				kuTimeline.Camera.Begin(id)
+#define KU_TIMELINE_CAM_STAMP(stamp)			kuTimeline.Camera.Stamp(stamp, kuGetTimeNs())
+#define KU_TIMELINE_CAM_STAMP_AT(stamp, t)		kuTimeline.Camera.Stamp(stamp, t)
+#define KU_TIMELINE_CAM_END()					kuTimeline.Camera.End()
+
+#define KU_TIMELINE_HMD_BEGIN(id)				kuTimeline.HMD.Begin(id)
+#define KU_TIMELINE_HMD_STAMP(stamp)			kuTimeline.HMD.Stamp(stamp, kuGetTimeNs())
+#define KU_TIMELINE_HMD_STAMP_AT(stamp, t)		kuTimeline.HMD.Stamp(stamp, t)
+#define KU_TIMELINE_HMD_END()					kuTimeline.HMD.End()
+
+#define KU_TIMELINE_REPORT(path)				kuTimeline.Report(path)
+
+#else
+
+#define KU_TIMELINE_CAM_BEGIN(id)				((void)0)
+#define KU_TIMELINE_CAM_STAMP(stamp)			((void)0)
+#define KU_TIMELINE_CAM_STAMP_AT(stamp, t)		((void)0)
+#define KU_TIMELINE_CAM_END()					((void)0)
+
+#define KU_TIMELINE_HMD_BEGIN(id)				((void)0)
+#define KU_TIMELINE_HMD_STAMP(stamp)			((void)0)
+#define KU_TIMELINE_HMD_STAMP_AT(stamp, t)		((void)0)
+#define KU_TIMELINE_HMD_END()					((void)0)
+
+#define KU_TIMELINE_REPORT(path)				((void)0)
+
+#endif // KU_FRAME_TIMELINE
+
+#endif // !KU_FRAMETIMELINE_H
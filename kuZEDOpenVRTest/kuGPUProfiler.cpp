@@ -0,0 +1,265 @@
+#include "kuGPUProfiler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#include "kuClock.h"
+
+kuGPUProfiler::kuGPUProfiler()
+	: m_fEnabled(false), m_CurrentFrame(-1), m_FrameCount(0), m_NumLateFrames(0), m_NumOverflows(0), m_NumPasses(0)
+{
+	for (int i = 0; i < kuGPUProfilerLatency; i++)
+	{
+		m_Frames[i].NumIntervals = 0;
+		m_Frames[i].fPending	 = false;
+	}
+}
+
+kuGPUProfiler::~kuGPUProfiler()
+{
+}
+
+bool kuGPUProfiler::Init()
+{
+	if (!GLEW_ARB_timer_query)
+	{
+		std::cout << "GPU profiler: GL_ARB_timer_query not supported, disabled." << std::endl;
+		return false;
+	}
+
+	// Some implementations expose the extension with a zero-bit counter
+	GLint counterBits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counterBits);
+	if (counterBits == 0)
+	{
+		std::cout << "GPU profiler: no timestamp counter, disabled." << std::endl;
+		return false;
+	}
+
+	for (int i = 0; i < kuGPUProfilerLatency; i++)
+	{
+		glGenQueries(2 * kuMaxGPUIntervals, m_Frames[i].Queries);
+		m_Frames[i].NumIntervals = 0;
+		m_Frames[i].fPending	 = false;
+	}
+
+	m_fEnabled = true;
+	return true;
+}
+
+void kuGPUProfiler::Release()
+{
+	if (!m_fEnabled)
+	{
+		return;
+	}
+
+	for (int i = 0; i < kuGPUProfilerLatency; i++)
+	{
+		glDeleteQueries(2 * kuMaxGPUIntervals, m_Frames[i].Queries);
+	}
+	m_fEnabled = false;
+}
+
+bool kuGPUProfiler::IsEnabled()
+{
+	return m_fEnabled;
+}
+
+int kuGPUProfiler::AddPass(const char * name)
+{
+	if (m_NumPasses == kuMaxGPUPasses)
+	{
+		return -1;
+	}
+
+	PassStats & stats = m_Passes[m_NumPasses];
+	stats.Name		   = name;
+	stats.LastGPUTime  = 0.0;
+	stats.TotalGPUTime = 0.0;
+	stats.TotalCPUTime = 0.0;
+	stats.NumFrames	   = 0;
+	m_OpenInterval[m_NumPasses] = -1;
+
+	return m_NumPasses++;
+}
+
+void kuGPUProfiler::BeginFrame()
+{
+	if (!m_fEnabled)
+	{
+		return;
+	}
+
+	m_CurrentFrame = (m_CurrentFrame + 1) % kuGPUProfilerLatency;
+
+	// Queries issued kuGPUProfilerLatency frames ago
+	FrameQueries & frame = m_Frames[m_CurrentFrame];
+	if (frame.fPending)
+	{
+		this->ReadBack(frame);
+	}
+
+	frame.NumIntervals = 0;
+	frame.fPending	   = false;
+
+	for (int pass = 0; pass < m_NumPasses; pass++)
+	{
+		m_OpenInterval[pass] = -1;
+	}
+}
+
+void kuGPUProfiler::EndFrame()
+{
+	if (!m_fEnabled)
+	{
+		return;
+	}
+
+	m_Frames[m_CurrentFrame].fPending = m_Frames[m_CurrentFrame].NumIntervals > 0;
+	m_FrameCount++;
+}
+
+void kuGPUProfiler::BeginPass(int pass)
+{
+	if (!m_fEnabled || pass < 0 || m_CurrentFrame < 0)
+	{
+		return;
+	}
+
+	FrameQueries & frame = m_Frames[m_CurrentFrame];
+	if (frame.NumIntervals == kuMaxGPUIntervals)
+	{
+		m_NumOverflows++;
+		return;
+	}
+
+	int index = frame.NumIntervals++;
+	frame.Intervals[index].Pass		= pass;
+	frame.Intervals[index].CPUBegin = kuGetTimeNs();
+	frame.Intervals[index].CPUEnd	= 0;
+	m_OpenInterval[pass] = index;
+
+	glQueryCounter(frame.Queries[2 * index], GL_TIMESTAMP);
+}
+
+void kuGPUProfiler::EndPass(int pass)
+{
+	if (!m_fEnabled || pass < 0 || m_CurrentFrame < 0 || m_OpenInterval[pass] < 0)
+	{
+		return;
+	}
+
+	FrameQueries & frame = m_Frames[m_CurrentFrame];
+	int			   index = m_OpenInterval[pass];
+
+	glQueryCounter(frame.Queries[2 * index + 1], GL_TIMESTAMP);
+
+	frame.Intervals[index].CPUEnd = kuGetTimeNs();
+	m_OpenInterval[pass] = -1;
+}
+
+void kuGPUProfiler::ReadBack(FrameQueries & frame)
+{
+	// The last end query completes last, check it only
+	int lastEnd = -1;
+	for (int i = 0; i < frame.NumIntervals; i++)
+	{
+		if (frame.Intervals[i].CPUEnd)
+		{
+			lastEnd = i;
+		}
+	}
+	if (lastEnd < 0)
+	{
+		return;
+	}
+
+	GLint available = 0;
+	glGetQueryObjectiv(frame.Queries[2 * lastEnd + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		m_NumLateFrames++;
+		return;
+	}
+
+	double gpuTime[kuMaxGPUPasses] = { 0.0 };
+	double cpuTime[kuMaxGPUPasses] = { 0.0 };
+	bool   used[kuMaxGPUPasses]	   = { false };
+
+	for (int i = 0; i < frame.NumIntervals; i++)
+	{
+		const Interval & interval = frame.Intervals[i];
+		if (!interval.CPUEnd)
+		{
+			continue;												// Never ended
+		}
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.Queries[2 * i], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.Queries[2 * i + 1], GL_QUERY_RESULT, &end);
+
+		gpuTime[interval.Pass] += end > begin ? (end - begin) * 1e-6 : 0.0;
+		cpuTime[interval.Pass] += (interval.CPUEnd - interval.CPUBegin) * 1e-6;
+		used[interval.Pass]		= true;
+	}
+
+	for (int pass = 0; pass < m_NumPasses; pass++)
+	{
+		if (!used[pass])
+		{
+			continue;
+		}
+
+		PassStats & stats = m_Passes[pass];
+		stats.LastGPUTime	= gpuTime[pass];
+		stats.TotalGPUTime += gpuTime[pass];
+		stats.TotalCPUTime += cpuTime[pass];
+		stats.History[stats.NumFrames % kuGPUHistorySize] = (float)gpuTime[pass];
+		stats.NumFrames++;
+	}
+}
+
+double kuGPUProfiler::GetPassTime(int pass)
+{
+	return (pass >= 0 && pass < m_NumPasses) ? m_Passes[pass].LastGPUTime : 0.0;
+}
+
+void kuGPUProfiler::PrintStats()
+{
+	if (!m_fEnabled || m_FrameCount == 0)
+	{
+		return;
+	}
+
+	std::cout << "GPU passes: " << m_FrameCount << " frames, " << m_NumLateFrames << " read back too late";
+	if (m_NumOverflows)
+	{
+		std::cout << ", " << m_NumOverflows << " intervals over kuMaxGPUIntervals";
+	}
+	std::cout << std::endl << std::fixed << std::setprecision(3);
+
+	std::vector<float> sorted;
+	for (int pass = 0; pass < m_NumPasses; pass++)
+	{
+		const PassStats & stats = m_Passes[pass];
+		if (stats.NumFrames == 0)
+		{
+			continue;
+		}
+
+		size_t num = (size_t)std::min<uint64_t>(stats.NumFrames, kuGPUHistorySize);
+		sorted.assign(stats.History, stats.History + num);
+		std::sort(sorted.begin(), sorted.end());
+
+		std::cout << "  " << std::left << std::setw(28) << stats.Name << std::right
+				  << " CPU avg " << std::setw(8) << stats.TotalCPUTime / stats.NumFrames
+				  << "  GPU avg " << std::setw(8) << stats.TotalGPUTime / stats.NumFrames
+				  << "  p50 " << std::setw(8) << sorted[num / 2]
+				  << "  p95 " << std::setw(8) << sorted[std::min(num - 1, num * 95 / 100)]
+				  << "  p99 " << std::setw(8) << sorted[std::min(num - 1, num * 99 / 100)]
+				  << " ms" << std::endl;
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef KU_GPUPROFILER_H
+#define KU_GPUPROFILER_H
+
+#pragma once
+
+#include <stdint.h>
+#include <GLEW/glew.h>
+
+#define kuGPUProfilerLatency		4						// Frames of queries in flight before results are read
+#define kuMaxGPUPasses				16
+#define kuMaxGPUIntervals			64						// Begin/End pairs per frame, a pass may run several times
+#define kuGPUHistorySize			1024					// Frames kept for the percentiles
+
+// GPU time of render passes from GL_TIMESTAMP query pairs. Every frame uses its own
+// set of queries out of a ring of kuGPUProfilerLatency sets; a set is read back when
+// the ring comes around to it, and only if the results are already available, so
+// the CPU never waits on the GPU. Timestamps rather than GL_TIME_ELAPSED so passes
+// may nest. Passes that run several times a frame (per eye) are summed.
+// The CPU time spent between Begin and End is measured alongside.
+class kuGPUProfiler
+{
+public:
+	kuGPUProfiler();
+	~kuGPUProfiler();
+
+	// Needs a current context. False (and every call a no-op) without timer queries.
+	bool		Init();
+	void		Release();
+	bool		IsEnabled();
+
+	int			AddPass(const char * name);
+
+	void		BeginFrame();
+	void		EndFrame();
+	void		BeginPass(int pass);
+	void		EndPass(int pass);
+
+	// Last read back GPU time of the pass in ms
+	double		GetPassTime(int pass);
+	void		PrintStats();
+
+private:
+	struct Interval {
+		int			Pass;
+		uint64_t	CPUBegin;
+		uint64_t	CPUEnd;
+	};
+
+	struct FrameQueries {
+		GLuint		Queries[2 * kuMaxGPUIntervals];			// Begin / end timestamp per interval
+		Interval	Intervals[kuMaxGPUIntervals];
+		int			NumIntervals;
+		bool		fPending;
+	};
+
+	struct PassStats {
+		const char *	Name;
+		double			LastGPUTime;
+		double			TotalGPUTime;
+		double			TotalCPUTime;
+		uint64_t		NumFrames;
+		float			History[kuGPUHistorySize];			// GPU ms per frame
+	};
+
+	void		ReadBack(FrameQueries & frame);
+
+	bool			m_fEnabled;
+	FrameQueries	m_Frames[kuGPUProfilerLatency];
+	int				m_CurrentFrame;
+	uint64_t		m_FrameCount;
+	uint64_t		m_NumLateFrames;						// Results still not available when the set was reused
+	uint64_t		m_NumOverflows;
+
+	PassStats		m_Passes[kuMaxGPUPasses];
+	int				m_NumPasses;
+	int				m_OpenInterval[kuMaxGPUPasses];
+};
+
+#endif // !KU_GPUPROFILER_H
@@ -0,0 +1,240 @@
+#include "kuGeometryArena.h"
+
+#include <algorithm>
+
+// Smallest allocation of each buffer, in elements
+static const size_t	kuMinArenaVertices	= 65536;
+static const size_t	kuMinArenaIndices	= 3 * 65536;
+static const size_t	kuMinArenaDraws		= 256;
+
+// Replaces buffer by a larger one holding the same first usedBytes
+static void GrowBuffer(GLuint & buffer, size_t usedBytes, size_t newBytes)
+{
+	GLuint newBuffer;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+
+	if (buffer && usedBytes)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (buffer)
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = newBuffer;
+}
+
+kuGeometryArena::kuGeometryArena()
+	: m_EBO(0), m_NumIndices(0), m_IndexCapacity(0), m_DrawBuffer(0), m_DrawIDBuffer(0), m_NumDraws(0), m_DrawCapacity(0),
+	  m_IndirectBuffer(0), m_IndirectCapacity(0)
+{
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		m_Pools[i].VAO		   = 0;
+		m_Pools[i].VBO		   = 0;
+		m_Pools[i].NumVertices = 0;
+		m_Pools[i].Capacity	   = 0;
+	}
+}
+
+kuGeometryArena::~kuGeometryArena()
+{
+}
+
+kuArenaRange kuGeometryArena::Add(kuVertexLayout layout, const void * vertexData, size_t numVertices, const GLuint * indexData,
+								  size_t numIndices, const kuArenaDrawData & drawData)
+{
+	Pool	&	pool   = m_Pools[layout];
+	size_t		stride = kuGetVertexStride(layout);
+	bool		resetup = false;
+
+	if (pool.NumVertices + numVertices > pool.Capacity)
+	{
+		size_t capacity = std::max(std::max(2 * pool.Capacity, pool.NumVertices + numVertices), kuMinArenaVertices);
+		GrowBuffer(pool.VBO, pool.NumVertices * stride, capacity * stride);
+		pool.Capacity = capacity;
+		resetup		  = true;
+	}
+	if (m_NumIndices + numIndices > m_IndexCapacity)
+	{
+		size_t capacity = std::max(std::max(2 * m_IndexCapacity, m_NumIndices + numIndices), kuMinArenaIndices);
+		GrowBuffer(m_EBO, m_NumIndices * sizeof(GLuint), capacity * sizeof(GLuint));
+		m_IndexCapacity = capacity;
+		resetup			= true;
+	}
+	if (m_NumDraws + 1 > m_DrawCapacity)
+	{
+		uint32_t capacity = std::max(2 * m_DrawCapacity, (uint32_t)kuMinArenaDraws);
+		GrowBuffer(m_DrawBuffer, m_NumDraws * sizeof(kuArenaDrawData), capacity * sizeof(kuArenaDrawData));
+
+		vector<GLuint> drawIDs(capacity);
+		for (uint32_t i = 0; i < capacity; i++)
+		{
+			drawIDs[i] = i;
+		}
+		GrowBuffer(m_DrawIDBuffer, 0, capacity * sizeof(GLuint));
+		glBindBuffer(GL_ARRAY_BUFFER, m_DrawIDBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, capacity * sizeof(GLuint), drawIDs.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_DrawCapacity = capacity;
+		resetup		   = true;
+	}
+
+	// Growing replaced buffers the VAOs point at
+	if (resetup)
+	{
+		for (int i = 0; i < kuVertexLayout_Count; i++)
+		{
+			if (m_Pools[i].VBO || i == layout)
+			{
+				this->SetupPool((kuVertexLayout)i);
+			}
+		}
+	}
+
+	kuArenaRange range;
+	range.Layout	 = layout;
+	range.BaseVertex = (GLint)pool.NumVertices;
+	range.FirstIndex = (GLuint)m_NumIndices;
+	range.DrawID	 = m_NumDraws;
+
+	glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+	glBufferSubData(GL_ARRAY_BUFFER, pool.NumVertices * stride, numVertices * stride, vertexData);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_EBO);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, m_NumIndices * sizeof(GLuint), numIndices * sizeof(GLuint), indexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_DrawBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, m_NumDraws * sizeof(kuArenaDrawData), sizeof(kuArenaDrawData), &drawData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	pool.NumVertices += numVertices;
+	m_NumIndices	 += numIndices;
+	m_NumDraws++;
+
+	return range;
+}
+
+void kuGeometryArena::SetupPool(kuVertexLayout layout)
+{
+	Pool & pool = m_Pools[layout];
+	if (!pool.VAO)
+	{
+		glGenVertexArrays(1, &pool.VAO);
+	}
+
+	glBindVertexArray(pool.VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+	kuSetVertexAttributes(layout);
+
+	// Draw ID from the command's BaseInstance, the same for all views of a stereo draw
+	glBindBuffer(GL_ARRAY_BUFFER, m_DrawIDBuffer);
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid *)0);
+	glVertexAttribDivisor(3, kuArenaMaxViews);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void kuGeometryArena::Release()
+{
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		if (m_Pools[i].VAO)
+		{
+			glDeleteVertexArrays(1, &m_Pools[i].VAO);
+			glDeleteBuffers(1, &m_Pools[i].VBO);
+		}
+		m_Pools[i].VAO		   = 0;
+		m_Pools[i].VBO		   = 0;
+		m_Pools[i].NumVertices = 0;
+		m_Pools[i].Capacity	   = 0;
+	}
+
+	GLuint buffers[4] = { m_EBO, m_DrawBuffer, m_DrawIDBuffer, m_IndirectBuffer };
+	for (int i = 0; i < 4; i++)
+	{
+		if (buffers[i])
+		{
+			glDeleteBuffers(1, &buffers[i]);
+		}
+	}
+	m_EBO			   = 0;
+	m_DrawBuffer	   = 0;
+	m_DrawIDBuffer	   = 0;
+	m_IndirectBuffer   = 0;
+	m_NumIndices	   = 0;
+	m_IndexCapacity	   = 0;
+	m_NumDraws		   = 0;
+	m_DrawCapacity	   = 0;
+	m_IndirectCapacity = 0;
+}
+
+void kuGeometryArena::Draw(kuShaderHandler & shader, const vector<kuDrawElementsIndirectCommand> * commands)
+{
+	// Every layout's commands in one upload, orphaning last draw's buffer
+	m_Commands.clear();
+	size_t firstCommand[kuVertexLayout_Count];
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		firstCommand[i] = m_Commands.size();
+		m_Commands.insert(m_Commands.end(), commands[i].begin(), commands[i].end());
+	}
+	if (m_Commands.empty())
+	{
+		return;
+	}
+
+	if (!m_IndirectBuffer)
+	{
+		glGenBuffers(1, &m_IndirectBuffer);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+	m_IndirectCapacity = std::max(m_IndirectCapacity, m_Commands.size());
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, m_IndirectCapacity * sizeof(kuDrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_Commands.size() * sizeof(kuDrawElementsIndirectCommand), m_Commands.data());
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_DrawBuffer);
+	m_Uniforms.Resolve(shader);
+	shader.Set(m_Uniforms.ArenaDraw, true);
+
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		if (commands[i].empty())
+		{
+			continue;
+		}
+
+		shader.Set(m_Uniforms.OctahedralNormals, i != kuVertexLayout_Float);
+		glBindVertexArray(m_Pools[i].VAO);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid *)(firstCommand[i] * sizeof(kuDrawElementsIndirectCommand)),
+									(GLsizei)commands[i].size(), 0);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+size_t kuGeometryArena::GetBufferSize()
+{
+	size_t bytes = m_NumIndices * sizeof(GLuint) + m_NumDraws * sizeof(kuArenaDrawData);
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		bytes += m_Pools[i].NumVertices * kuGetVertexStride((kuVertexLayout)i);
+	}
+	return bytes;
+}
+
+uint32_t kuGeometryArena::GetNumDraws()
+{
+	return m_NumDraws;
+}
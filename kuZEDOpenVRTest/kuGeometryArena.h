@@ -0,0 +1,90 @@
+#ifndef KU_GEOMETRYARENA_H
+#define KU_GEOMETRYARENA_H
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <GLEW/glew.h>
+#include <GLM/glm.hpp>
+
+#include "kuMesh.h"
+#include "kuShaderHandler.h"
+
+using namespace std;
+
+// Instances of one command that share its per-draw data, the views of a single-pass stereo draw
+#define kuArenaMaxViews		2
+
+// Layout glMultiDrawElementsIndirect reads
+struct kuDrawElementsIndirectCommand {
+	GLuint		Count;
+	GLuint		InstanceCount;
+	GLuint		FirstIndex;
+	GLint		BaseVertex;
+	GLuint		BaseInstance;										// Draw ID, selects the per-draw data
+};
+
+// Per-draw data in the shader storage buffer, std430 layout of DrawData in ModelVertexShader.vert
+struct kuArenaDrawData {
+	glm::vec4	PositionOffset;										// Packed position decode, xyz used
+	glm::vec4	PositionScale;
+};
+
+// Where a mesh landed in the arena
+struct kuArenaRange {
+	kuVertexLayout	Layout;
+	GLint			BaseVertex;
+	GLuint			FirstIndex;
+	GLuint			DrawID;
+};
+
+// Shared geometry for many meshes: one vertex buffer and VAO per vertex layout, one index
+// buffer and one shader storage buffer of per-draw data. Meshes are appended and never
+// freed, buffers grow by doubling. Drawing any number of meshes costs one
+// glMultiDrawElementsIndirect per vertex layout in use. The draw ID reaches the shader as
+// an instanced vertex attribute starting at the command's BaseInstance and advancing every
+// kuArenaMaxViews instances, so commands with one instance per eye keep it. Needs GL 4.3.
+class kuGeometryArena
+{
+public:
+	kuGeometryArena();
+	~kuGeometryArena();
+
+	// vertexData is numVertices vertices in the given layout, indices are relative to them
+	kuArenaRange	Add(kuVertexLayout layout, const void * vertexData, size_t numVertices, const GLuint * indexData, size_t numIndices,
+						const kuArenaDrawData & drawData);
+	void			Release();
+
+	// One list of commands per vertex layout, indexed by kuVertexLayout
+	void			Draw(kuShaderHandler & shader, const vector<kuDrawElementsIndirectCommand> * commands);
+
+	size_t			GetBufferSize();										// Bytes in use over all buffers
+	uint32_t		GetNumDraws();
+
+private:
+	struct Pool {
+		GLuint		VAO;
+		GLuint		VBO;
+		size_t		NumVertices;
+		size_t		Capacity;
+	};
+
+	Pool		m_Pools[kuVertexLayout_Count];
+	GLuint		m_EBO;
+	size_t		m_NumIndices;
+	size_t		m_IndexCapacity;
+	GLuint		m_DrawBuffer;											// SSBO of kuArenaDrawData
+	GLuint		m_DrawIDBuffer;											// 0, 1, 2, ... read once per instance
+	uint32_t	m_NumDraws;
+	uint32_t	m_DrawCapacity;
+	GLuint		m_IndirectBuffer;
+	size_t		m_IndirectCapacity;										// Commands
+
+	vector<kuDrawElementsIndirectCommand>	m_Commands;						// All layouts back to back, for the upload
+	kuMeshUniforms							m_Uniforms;
+
+	void	SetupPool(kuVertexLayout layout);
+};
+
+#endif // !KU_GEOMETRYARENA_H
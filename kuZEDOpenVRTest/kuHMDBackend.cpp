@@ -0,0 +1,361 @@
+#include "kuHMDBackend.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <thread>
+#include <iostream>
+
+#include "kuTrace.h"
+
+#pragma region // kuOpenVRBackend //
+kuOpenVRBackend::kuOpenVRBackend()
+	: m_HMD(nullptr), m_TrackingOrigin(vr::TrackingUniverseStanding)
+{
+}
+
+kuOpenVRBackend::~kuOpenVRBackend()
+{
+	this->Shutdown();
+}
+
+bool kuOpenVRBackend::Init()
+{
+	KU_PROFILE_ZONE("kuOpenVRBackend::Init");
+
+	vr::EVRInitError eError = vr::VRInitError_None;
+	m_HMD = vr::VR_Init(&eError, vr::VRApplication_Scene);
+
+	if (eError != vr::VRInitError_None) {
+		fprintf(stderr, "OpenVR Initialization Error: %s\n", vr::VR_GetVRInitErrorAsEnglishDescription(eError));
+		m_HMD = nullptr;
+		return false;
+	}
+
+	const std::string & driver = GetHMDString(vr::Prop_TrackingSystemName_String);		// Graphic card name
+	const std::string & model  = GetHMDString(vr::Prop_ModelNumber_String);				// HMD device name
+	const std::string & serial = GetHMDString(vr::Prop_SerialNumber_String);				// HMD device serial
+
+	uint32_t width, height;
+	GetRenderTargetSize(width, height);
+
+	fprintf(stderr, "HMD: %s '%s' #%s (%d x %d @ %g Hz)\n", driver.c_str(), model.c_str(), serial.c_str(), width, height, GetDisplayFrequency());
+
+	// Initialize the compositor
+	vr::IVRCompositor * compositor = vr::VRCompositor();
+	if (!compositor) {
+		fprintf(stderr, "OpenVR Compositor initialization failed. See log file for details\n");
+		this->Shutdown();
+		return false;
+	}
+	m_TrackingOrigin = compositor->GetTrackingSpace();
+
+	return true;
+}
+
+void kuOpenVRBackend::Shutdown()
+{
+	if (m_HMD)
+	{
+		vr::VR_Shutdown();
+		m_HMD = nullptr;
+	}
+}
+
+const char * kuOpenVRBackend::GetName()
+{
+	return "OpenVR";
+}
+
+void kuOpenVRBackend::GetRenderTargetSize(uint32_t & width, uint32_t & height)
+{
+	m_HMD->GetRecommendedRenderTargetSize(&width, &height);
+}
+
+float kuOpenVRBackend::GetDisplayFrequency()
+{
+	return m_HMD->GetFloatTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float);
+}
+
+float kuOpenVRBackend::GetSecondsFromVsyncToPhotons()
+{
+	return m_HMD->GetFloatTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SecondsFromVsyncToPhotons_Float);
+}
+
+vr::HmdMatrix44_t kuOpenVRBackend::GetProjectionMatrix(vr::EVREye eye, float nearZ, float farZ)
+{
+	return m_HMD->GetProjectionMatrix(eye, nearZ, farZ);
+}
+
+vr::HmdMatrix34_t kuOpenVRBackend::GetEyeToHeadTransform(vr::EVREye eye)
+{
+	return m_HMD->GetEyeToHeadTransform(eye);
+}
+
+void kuOpenVRBackend::WaitGetPoses(vr::TrackedDevicePose_t * renderPoses)
+{
+	vr::VRCompositor()->WaitGetPoses(renderPoses, vr::k_unMaxTrackedDeviceCount, nullptr, 0);
+}
+
+float kuOpenVRBackend::GetTimeSinceLastVsync()
+{
+	float sinceVsync = 0.0f;
+	m_HMD->GetTimeSinceLastVsync(&sinceVsync, nullptr);
+	return sinceVsync;
+}
+
+void kuOpenVRBackend::GetHMDPose(float secondsFromNow, vr::TrackedDevicePose_t & hmdPose)
+{
+	m_HMD->GetDeviceToAbsoluteTrackingPose(m_TrackingOrigin, secondsFromNow, &hmdPose, 1);
+}
+
+void kuOpenVRBackend::Submit(vr::EVREye eye, GLuint textureID, const vr::VRTextureBounds_t * bounds, const vr::HmdMatrix34_t & renderPose)
+{
+	// Submit with the pose actually rendered with, so the compositor reprojects from it
+	vr::VRTextureWithPose_t texture;
+	texture.handle					  = reinterpret_cast<void*>(intptr_t(textureID));
+	texture.eType					  = vr::TextureType_OpenGL;
+	texture.eColorSpace				  = vr::ColorSpace_Gamma;
+	texture.mDeviceToAbsoluteTracking = renderPose;
+
+	vr::VRCompositor()->Submit(eye, &texture, bounds, vr::Submit_TextureWithPose);
+}
+
+void kuOpenVRBackend::PostPresentHandoff()
+{
+	vr::VRCompositor()->PostPresentHandoff();
+}
+
+std::string kuOpenVRBackend::GetHMDString(vr::TrackedDeviceProperty prop)
+{
+	uint32_t unRequiredBufferLen = m_HMD->GetStringTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, prop, nullptr, 0);
+	if (unRequiredBufferLen == 0)
+	{
+		return "";
+	}
+
+	char* pchBuffer = new char[unRequiredBufferLen];
+	unRequiredBufferLen = m_HMD->GetStringTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, prop, pchBuffer, unRequiredBufferLen);
+	std::string sResult = pchBuffer;
+	delete[] pchBuffer;
+	return sResult;
+}
+#pragma endregion
+
+#pragma region // kuNullHMDBackend //
+kuNullHMDBackend::kuNullHMDBackend(kuHeadTrajectory * trajectory, const kuNullHMDConfig & config)
+	: m_Trajectory(trajectory), m_Config(config), m_StartTime(0), m_LastVsyncIndex(0), m_NumFrames(0), m_NumMissedVsyncs(0),
+	  m_CaptureInterval(0)
+{
+	m_VsyncPeriod	   = (uint64_t)(1e9 / config.RefreshRate);
+	m_CapturedFrame[0] = 0;
+	m_CapturedFrame[1] = 0;
+}
+
+kuNullHMDBackend::~kuNullHMDBackend()
+{
+}
+
+bool kuNullHMDBackend::Init()
+{
+	m_StartTime		 = kuGetTimeNs();
+	m_LastVsyncIndex = 0;
+
+	fprintf(stderr, "HMD: null (%d x %d @ %g Hz)\n", m_Config.Width, m_Config.Height, m_Config.RefreshRate);
+	return true;
+}
+
+void kuNullHMDBackend::Shutdown()
+{
+	if (m_NumFrames)
+	{
+		std::cout << "Null HMD: " << m_NumFrames << " frames, " << m_NumMissedVsyncs << " missed vsyncs" << std::endl;
+	}
+}
+
+const char * kuNullHMDBackend::GetName()
+{
+	return "Null";
+}
+
+void kuNullHMDBackend::GetRenderTargetSize(uint32_t & width, uint32_t & height)
+{
+	width  = m_Config.Width;
+	height = m_Config.Height;
+}
+
+float kuNullHMDBackend::GetDisplayFrequency()
+{
+	return m_Config.RefreshRate;
+}
+
+float kuNullHMDBackend::GetSecondsFromVsyncToPhotons()
+{
+	return m_Config.VsyncToPhotons;
+}
+
+vr::HmdMatrix44_t kuNullHMDBackend::GetProjectionMatrix(vr::EVREye /*eye*/, float nearZ, float farZ)
+{
+	// Symmetric OpenGL perspective, row major like OpenVR
+	float f		 = 1.0f / tanf(0.5f * m_Config.FovY * 3.14159265f / 180.0f);
+	float aspect = (float)m_Config.Width / (float)m_Config.Height;
+
+	vr::HmdMatrix44_t mat = {};
+	mat.m[0][0] = f / aspect;
+	mat.m[1][1] = f;
+	mat.m[2][2] = (farZ + nearZ) / (nearZ - farZ);
+	mat.m[2][3] = 2.0f * farZ * nearZ / (nearZ - farZ);
+	mat.m[3][2] = -1.0f;
+	return mat;
+}
+
+vr::HmdMatrix34_t kuNullHMDBackend::GetEyeToHeadTransform(vr::EVREye eye)
+{
+	vr::HmdMatrix34_t mat = {};
+	mat.m[0][0] = 1.0f;
+	mat.m[1][1] = 1.0f;
+	mat.m[2][2] = 1.0f;
+	mat.m[0][3] = (eye == vr::Eye_Left ? -0.5f : 0.5f) * m_Config.IPD;
+	return mat;
+}
+
+void kuNullHMDBackend::WaitGetPoses(vr::TrackedDevicePose_t * renderPoses)
+{
+	uint64_t runningStart = (uint64_t)(m_Config.RunningStart * 1e9);
+	uint64_t now		  = kuGetTimeNs();
+
+	// Next vsync whose running start is still ahead
+	uint64_t index = (now + runningStart - m_StartTime) / m_VsyncPeriod + 1;
+	if (index <= m_LastVsyncIndex)
+	{
+		index = m_LastVsyncIndex + 1;
+	}
+	else if (m_LastVsyncIndex && index > m_LastVsyncIndex + 1)
+	{
+		m_NumMissedVsyncs += index - m_LastVsyncIndex - 1;
+	}
+	m_LastVsyncIndex = index;
+
+	uint64_t vsyncTime = m_StartTime + index * m_VsyncPeriod;
+	uint64_t wakeTime  = vsyncTime - runningStart;
+
+	// Coarse sleep, then spin the last bit since sleeps overshoot by up to a millisecond
+	if (wakeTime > now + 1000000)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds(wakeTime - now - 1000000));
+	}
+	while (kuGetTimeNs() < wakeTime)
+	{
+		std::this_thread::yield();
+	}
+
+	// Like the compositor: render pose predicted to when this frame is lit. Only the HMD is tracked.
+	memset(renderPoses, 0, vr::k_unMaxTrackedDeviceCount * sizeof(vr::TrackedDevicePose_t));
+	GetPoseAt(vsyncTime + (uint64_t)(m_Config.VsyncToPhotons * 1e9), renderPoses[vr::k_unTrackedDeviceIndex_Hmd]);
+}
+
+float kuNullHMDBackend::GetTimeSinceLastVsync()
+{
+	return (float)(((kuGetTimeNs() - m_StartTime) % m_VsyncPeriod) * 1e-9);
+}
+
+void kuNullHMDBackend::GetHMDPose(float secondsFromNow, vr::TrackedDevicePose_t & hmdPose)
+{
+	GetPoseAt(kuGetTimeNs() + (int64_t)(secondsFromNow * 1e9), hmdPose);
+}
+
+void kuNullHMDBackend::GetPoseAt(uint64_t timeNs, vr::TrackedDevicePose_t & hmdPose)
+{
+	double t = (int64_t)(timeNs - m_StartTime) * 1e-9;
+
+	// The trajectory is exact, so the prediction is perfect; velocity by central difference
+	vr::HmdMatrix34_t before, after;
+	m_Trajectory->GetPose(t, hmdPose.mDeviceToAbsoluteTracking);
+	m_Trajectory->GetPose(t - 0.001, before);
+	m_Trajectory->GetPose(t + 0.001, after);
+
+	for (int i = 0; i < 3; i++)
+	{
+		hmdPose.vVelocity.v[i]		  = (after.m[i][3] - before.m[i][3]) / 0.002f;
+		hmdPose.vAngularVelocity.v[i] = 0.0f;
+	}
+	hmdPose.eTrackingResult	   = vr::TrackingResult_Running_OK;
+	hmdPose.bPoseIsValid	   = true;
+	hmdPose.bDeviceIsConnected = true;
+}
+
+void kuNullHMDBackend::Submit(vr::EVREye eye, GLuint textureID, const vr::VRTextureBounds_t * bounds, const vr::HmdMatrix34_t & /*renderPose*/)
+{
+	if (m_CaptureInterval <= 0 || m_NumFrames % m_CaptureInterval != 0)
+	{
+		return;
+	}
+
+	GLint width = 0, height = 0;
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+
+	cv::Mat & image = m_CapturedEye[eye];
+	image.create(height, width, CV_8UC4);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, image.data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// GL rows start at the bottom
+	cv::flip(image, image, 0);
+
+	// Keep only the eye's part of a shared texture, v counted from the top like the compositor does
+	if (bounds)
+	{
+		cv::Rect eyeRect((int)(bounds->uMin * width + 0.5f), (int)(bounds->vMin * height + 0.5f),
+						 (int)((bounds->uMax - bounds->uMin) * width + 0.5f), (int)((bounds->vMax - bounds->vMin) * height + 0.5f));
+		image = image(eyeRect & cv::Rect(0, 0, width, height)).clone();
+	}
+	m_CapturedFrame[eye] = m_NumFrames + 1;
+
+	if (!m_CaptureDirectory.empty())
+	{
+		char path[512];
+		snprintf(path, sizeof(path), "%s/eye%d_%06llu.png", m_CaptureDirectory.c_str(), (int)eye, (unsigned long long)m_NumFrames);
+		cv::imwrite(path, image);
+	}
+}
+
+void kuNullHMDBackend::PostPresentHandoff()
+{
+	m_NumFrames++;
+}
+
+void kuNullHMDBackend::SetCapture(int everyNFrames, const char * directory)
+{
+	m_CaptureInterval  = everyNFrames;
+	m_CaptureDirectory = directory ? directory : "";
+}
+
+bool kuNullHMDBackend::GetCapturedEye(vr::EVREye eye, cv::Mat & image, uint64_t * frameIndex)
+{
+	if (m_CapturedFrame[eye] == 0)
+	{
+		return false;
+	}
+
+	image = m_CapturedEye[eye];
+	if (frameIndex)
+	{
+		*frameIndex = m_CapturedFrame[eye] - 1;
+	}
+	return true;
+}
+
+uint64_t kuNullHMDBackend::GetNumFrames()
+{
+	return m_NumFrames;
+}
+
+uint64_t kuNullHMDBackend::GetNumMissedVsyncs()
+{
+	return m_NumMissedVsyncs;
+}
+#pragma endregion
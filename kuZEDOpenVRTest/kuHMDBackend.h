@@ -0,0 +1,146 @@
+#ifndef KU_HMDBACKEND_H
+#define KU_HMDBACKEND_H
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <GLEW/glew.h>
+#include <OpenVR.h>
+#include <opencv2/opencv.hpp>
+
+#include "kuClock.h"
+#include "kuHeadTrajectory.h"
+
+// Everything the render loop needs from the HMD runtime: display description,
+// frame pacing, head poses and eye texture submission. OpenVR types are used
+// throughout so poses and matrices convert the same way for every backend.
+class kuHMDBackend
+{
+public:
+	virtual ~kuHMDBackend() {}
+
+	virtual bool				Init() = 0;
+	virtual void				Shutdown() = 0;
+	virtual const char		*	GetName() = 0;
+
+	virtual void				GetRenderTargetSize(uint32_t & width, uint32_t & height) = 0;
+	virtual float				GetDisplayFrequency() = 0;
+	virtual float				GetSecondsFromVsyncToPhotons() = 0;
+	virtual vr::HmdMatrix44_t	GetProjectionMatrix(vr::EVREye eye, float nearZ, float farZ) = 0;
+	virtual vr::HmdMatrix34_t	GetEyeToHeadTransform(vr::EVREye eye) = 0;
+
+	// Blocks until the next frame may start, returns the runtime's render poses of all
+	// k_unMaxTrackedDeviceCount tracked devices, the HMD at k_unTrackedDeviceIndex_Hmd
+	virtual void				WaitGetPoses(vr::TrackedDevicePose_t * renderPoses) = 0;
+	virtual float				GetTimeSinceLastVsync() = 0;
+	// HMD pose predicted secondsFromNow ahead, 0 for the current pose
+	virtual void				GetHMDPose(float secondsFromNow, vr::TrackedDevicePose_t & hmdPose) = 0;
+
+	// Eye textures are GL_RGBA8 2D textures, renderPose is the pose they were rendered with.
+	// bounds selects the eye's part of a texture shared by both eyes, nullptr for all of it.
+	virtual void				Submit(vr::EVREye eye, GLuint textureID, const vr::VRTextureBounds_t * bounds,
+									   const vr::HmdMatrix34_t & renderPose) = 0;
+	virtual void				PostPresentHandoff() = 0;
+};
+
+// SteamVR through OpenVR, the real headset.
+class kuOpenVRBackend : public kuHMDBackend
+{
+public:
+	kuOpenVRBackend();
+	~kuOpenVRBackend();
+
+	bool				Init();
+	void				Shutdown();
+	const char		*	GetName();
+
+	void				GetRenderTargetSize(uint32_t & width, uint32_t & height);
+	float				GetDisplayFrequency();
+	float				GetSecondsFromVsyncToPhotons();
+	vr::HmdMatrix44_t	GetProjectionMatrix(vr::EVREye eye, float nearZ, float farZ);
+	vr::HmdMatrix34_t	GetEyeToHeadTransform(vr::EVREye eye);
+
+	void				WaitGetPoses(vr::TrackedDevicePose_t * renderPoses);
+	float				GetTimeSinceLastVsync();
+	void				GetHMDPose(float secondsFromNow, vr::TrackedDevicePose_t & hmdPose);
+
+	void				Submit(vr::EVREye eye, GLuint textureID, const vr::VRTextureBounds_t * bounds, const vr::HmdMatrix34_t & renderPose);
+	void				PostPresentHandoff();
+
+private:
+	vr::IVRSystem			*	m_HMD;
+	vr::ETrackingUniverseOrigin	m_TrackingOrigin;
+
+	std::string					GetHMDString(vr::TrackedDeviceProperty prop);
+};
+
+struct kuNullHMDConfig {
+	uint32_t	Width;												// Per-eye render target
+	uint32_t	Height;
+	float		RefreshRate;										// Hz
+	float		VsyncToPhotons;										// s
+	float		RunningStart;										// s before vsync WaitGetPoses returns
+	float		FovY;												// degree, symmetric frustum
+	float		IPD;												// m
+
+	kuNullHMDConfig() : Width(1512), Height(1680), RefreshRate(90.0f), VsyncToPhotons(0.011f), RunningStart(0.003f),
+						FovY(110.0f), IPD(0.064f) {}
+};
+
+// In-process stand-in for HMD + compositor. Vsyncs are simulated on the host clock,
+// WaitGetPoses sleeps until RunningStart before the next one like the SteamVR
+// compositor does, and head poses come from a kuHeadTrajectory. Submitted eye
+// textures can be read back for verification. Both eyes share one symmetric frustum
+// and submitted frames are taken as rendered, without reprojection to their render pose.
+class kuNullHMDBackend : public kuHMDBackend
+{
+public:
+	kuNullHMDBackend(kuHeadTrajectory * trajectory, const kuNullHMDConfig & config = kuNullHMDConfig());
+	~kuNullHMDBackend();
+
+	bool				Init();
+	void				Shutdown();
+	const char		*	GetName();
+
+	void				GetRenderTargetSize(uint32_t & width, uint32_t & height);
+	float				GetDisplayFrequency();
+	float				GetSecondsFromVsyncToPhotons();
+	vr::HmdMatrix44_t	GetProjectionMatrix(vr::EVREye eye, float nearZ, float farZ);
+	vr::HmdMatrix34_t	GetEyeToHeadTransform(vr::EVREye eye);
+
+	void				WaitGetPoses(vr::TrackedDevicePose_t * renderPoses);
+	float				GetTimeSinceLastVsync();
+	void				GetHMDPose(float secondsFromNow, vr::TrackedDevicePose_t & hmdPose);
+
+	void				Submit(vr::EVREye eye, GLuint textureID, const vr::VRTextureBounds_t * bounds, const vr::HmdMatrix34_t & renderPose);
+	void				PostPresentHandoff();
+
+	// Reads back the eye textures of every Nth frame (0 = off), kept in memory and
+	// written as PNG into directory if one is given. Read back stalls the GPU.
+	void				SetCapture(int everyNFrames, const char * directory = nullptr);
+	// Last captured eye image (BGRA, top row first), false if none yet
+	bool				GetCapturedEye(vr::EVREye eye, cv::Mat & image, uint64_t * frameIndex = nullptr);
+
+	uint64_t			GetNumFrames();
+	uint64_t			GetNumMissedVsyncs();
+
+private:
+	kuHeadTrajectory		*	m_Trajectory;
+	kuNullHMDConfig				m_Config;
+
+	uint64_t					m_StartTime;
+	uint64_t					m_VsyncPeriod;						// ns
+	uint64_t					m_LastVsyncIndex;
+	uint64_t					m_NumFrames;
+	uint64_t					m_NumMissedVsyncs;
+
+	int							m_CaptureInterval;
+	std::string					m_CaptureDirectory;
+	cv::Mat						m_CapturedEye[2];
+	uint64_t					m_CapturedFrame[2];
+
+	void						GetPoseAt(uint64_t timeNs, vr::TrackedDevicePose_t & hmdPose);
+};
+
+#endif // !KU_HMDBACKEND_H
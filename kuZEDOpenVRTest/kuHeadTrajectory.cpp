@@ -0,0 +1,258 @@
+#include "kuHeadTrajectory.h"
+
+#include <string.h>
+#include <cmath>
+#include <iostream>
+
+#include "kuSessionFile.h"
+
+static const double kuPI = 3.14159265358979;
+
+// Unit quaternion (w, x, y, z) + position to an OpenVR pose
+static void QuatToPose(const float q[4], const float p[3], vr::HmdMatrix34_t & pose)
+{
+	float w = q[0], x = q[1], y = q[2], z = q[3];
+
+	pose.m[0][0] = 1 - 2 * (y * y + z * z);	pose.m[0][1] = 2 * (x * y - w * z);		pose.m[0][2] = 2 * (x * z + w * y);
+	pose.m[1][0] = 2 * (x * y + w * z);		pose.m[1][1] = 1 - 2 * (x * x + z * z);	pose.m[1][2] = 2 * (y * z - w * x);
+	pose.m[2][0] = 2 * (x * z - w * y);		pose.m[2][1] = 2 * (y * z + w * x);		pose.m[2][2] = 1 - 2 * (x * x + y * y);
+
+	pose.m[0][3] = p[0];
+	pose.m[1][3] = p[1];
+	pose.m[2][3] = p[2];
+}
+
+// Rotation part of an OpenVR pose to a unit quaternion (w, x, y, z)
+static void PoseToQuat(const vr::HmdMatrix34_t & pose, float q[4], float p[3])
+{
+	const float (*m)[4] = pose.m;
+	float trace = m[0][0] + m[1][1] + m[2][2];
+
+	if (trace > 0.0f)
+	{
+		float s = 2.0f * sqrtf(1.0f + trace);
+		q[0] = 0.25f * s;
+		q[1] = (m[2][1] - m[1][2]) / s;
+		q[2] = (m[0][2] - m[2][0]) / s;
+		q[3] = (m[1][0] - m[0][1]) / s;
+	}
+	else if (m[0][0] > m[1][1] && m[0][0] > m[2][2])
+	{
+		float s = 2.0f * sqrtf(1.0f + m[0][0] - m[1][1] - m[2][2]);
+		q[0] = (m[2][1] - m[1][2]) / s;
+		q[1] = 0.25f * s;
+		q[2] = (m[0][1] + m[1][0]) / s;
+		q[3] = (m[0][2] + m[2][0]) / s;
+	}
+	else if (m[1][1] > m[2][2])
+	{
+		float s = 2.0f * sqrtf(1.0f + m[1][1] - m[0][0] - m[2][2]);
+		q[0] = (m[0][2] - m[2][0]) / s;
+		q[1] = (m[0][1] + m[1][0]) / s;
+		q[2] = 0.25f * s;
+		q[3] = (m[1][2] + m[2][1]) / s;
+	}
+	else
+	{
+		float s = 2.0f * sqrtf(1.0f + m[2][2] - m[0][0] - m[1][1]);
+		q[0] = (m[1][0] - m[0][1]) / s;
+		q[1] = (m[0][2] + m[2][0]) / s;
+		q[2] = (m[1][2] + m[2][1]) / s;
+		q[3] = 0.25f * s;
+	}
+
+	p[0] = m[0][3];
+	p[1] = m[1][3];
+	p[2] = m[2][3];
+}
+
+kuScriptedTrajectory::kuScriptedTrajectory(float yawAmplitude, float yawFrequency, float pitchAmplitude, float pitchFrequency,
+										   float swayAmplitude, float height)
+	: m_YawAmplitude(yawAmplitude), m_YawFrequency(yawFrequency), m_PitchAmplitude(pitchAmplitude), m_PitchFrequency(pitchFrequency),
+	  m_SwayAmplitude(swayAmplitude), m_Height(height)
+{
+}
+
+kuScriptedTrajectory::~kuScriptedTrajectory()
+{
+}
+
+void kuScriptedTrajectory::GetPose(double timeSec, vr::HmdMatrix34_t & pose)
+{
+	double yaw	 = m_YawAmplitude * kuPI / 180.0 * sin(2.0 * kuPI * m_YawFrequency * timeSec);
+	double pitch = m_PitchAmplitude * kuPI / 180.0 * sin(2.0 * kuPI * m_PitchFrequency * timeSec);
+
+	// Yaw about +y, then pitch about the head's x axis
+	float qYaw[4]	= { (float)cos(0.5 * yaw), 0.0f, (float)sin(0.5 * yaw), 0.0f };
+	float qPitch[4] = { (float)cos(0.5 * pitch), (float)sin(0.5 * pitch), 0.0f, 0.0f };
+	float q[4]		= { qYaw[0] * qPitch[0],
+						qYaw[0] * qPitch[1],
+						qYaw[2] * qPitch[0],
+						-qYaw[2] * qPitch[1] };
+
+	float p[3] = { (float)(m_SwayAmplitude * sin(2.0 * kuPI * 0.5 * m_YawFrequency * timeSec)),
+				   (float)(m_Height + 0.5 * m_SwayAmplitude * sin(2.0 * kuPI * m_PitchFrequency * timeSec)),
+				   0.0f };
+
+	QuatToPose(q, p, pose);
+}
+
+kuRecordedTrajectory::kuRecordedTrajectory()
+{
+}
+
+kuRecordedTrajectory::~kuRecordedTrajectory()
+{
+}
+
+bool kuRecordedTrajectory::Load(const char * path)
+{
+	FILE * file = fopen(path, "rb");
+	if (!file)
+	{
+		std::cout << "Trajectory: cannot open " << path << std::endl;
+		return false;
+	}
+
+	m_Samples.clear();
+
+	char magic[8] = {};
+	bool isSession = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, "KUSESSN", 8) == 0;
+	bool loaded;
+	if (isSession)
+	{
+		fclose(file);
+		loaded = LoadSession(path);
+	}
+	else
+	{
+		rewind(file);
+		loaded = LoadCSV(file);
+		fclose(file);
+	}
+
+	if (!loaded || m_Samples.size() < 2)
+	{
+		std::cout << "Trajectory: " << path << " needs at least two samples" << std::endl;
+		m_Samples.clear();
+		return false;
+	}
+
+	std::cout << "Trajectory: " << m_Samples.size() << " samples, " << GetDuration() << " s from " << path << std::endl;
+	return true;
+}
+
+bool kuRecordedTrajectory::LoadCSV(FILE * file)
+{
+	char line[512];
+	while (fgets(line, sizeof(line), file))
+	{
+		Sample s;
+		if (sscanf(line, "%lf,%f,%f,%f,%f,%f,%f,%f", &s.Time, &s.Position[0], &s.Position[1], &s.Position[2],
+				   &s.Rotation[0], &s.Rotation[1], &s.Rotation[2], &s.Rotation[3]) != 8)
+		{
+			continue;													// Header or broken line
+		}
+		if (!m_Samples.empty() && s.Time <= m_Samples.back().Time)
+		{
+			continue;
+		}
+		m_Samples.push_back(s);
+	}
+
+	return true;
+}
+
+bool kuRecordedTrajectory::LoadSession(const char * path)
+{
+	kuSessionReader session;
+	if (!session.Open(path))
+	{
+		return false;
+	}
+
+	// Render poses are predictions to the frame's photon time, so that is their sample time
+	uint64_t numPoses  = session.GetNumChunks(kuSessionChunk_Poses);
+	uint64_t startTime = 0;
+	for (uint64_t i = 0; i < numPoses; i++)
+	{
+		const kuSessionPoses		  * poses = session.GetPoses(i);
+		const vr::TrackedDevicePose_t & hmd	  = poses->Poses[vr::k_unTrackedDeviceIndex_Hmd];
+		if (!hmd.bPoseIsValid)
+		{
+			continue;
+		}
+		if (m_Samples.empty())
+		{
+			startTime = poses->PhotonTime;
+		}
+
+		Sample s;
+		s.Time = (poses->PhotonTime - startTime) * 1e-9;
+		if (!m_Samples.empty() && s.Time <= m_Samples.back().Time)
+		{
+			continue;
+		}
+		PoseToQuat(hmd.mDeviceToAbsoluteTracking, s.Rotation, s.Position);
+		m_Samples.push_back(s);
+	}
+
+	return true;
+}
+
+double kuRecordedTrajectory::GetDuration()
+{
+	return m_Samples.empty() ? 0.0 : m_Samples.back().Time - m_Samples.front().Time;
+}
+
+void kuRecordedTrajectory::GetPose(double timeSec, vr::HmdMatrix34_t & pose)
+{
+	static const float identityRot[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	static const float origin[3]	  = { 0.0f, 0.0f, 0.0f };
+
+	if (m_Samples.empty())
+	{
+		QuatToPose(identityRot, origin, pose);
+		return;
+	}
+
+	// Loop the recording
+	double duration = GetDuration();
+	double t		= m_Samples.front().Time + fmod(timeSec < 0.0 ? 0.0 : timeSec, duration);
+
+	// Last sample at or before t
+	size_t lo = 0, hi = m_Samples.size() - 1;
+	while (hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (m_Samples[mid].Time <= t)	lo = mid;
+		else							hi = mid;
+	}
+
+	const Sample & a = m_Samples[lo];
+	const Sample & b = m_Samples[hi];
+	float		   f = (float)((t - a.Time) / (b.Time - a.Time));
+	f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+
+	// Position lerp, rotation nlerp along the shorter arc
+	float p[3], q[4];
+	float sign = a.Rotation[0] * b.Rotation[0] + a.Rotation[1] * b.Rotation[1] +
+				 a.Rotation[2] * b.Rotation[2] + a.Rotation[3] * b.Rotation[3] < 0.0f ? -1.0f : 1.0f;
+	float norm = 0.0f;
+	for (int i = 0; i < 4; i++)
+	{
+		q[i]  = (1.0f - f) * a.Rotation[i] + f * sign * b.Rotation[i];
+		norm += q[i] * q[i];
+	}
+	norm = sqrtf(norm);
+	for (int i = 0; i < 4; i++)
+	{
+		q[i] /= norm;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		p[i] = (1.0f - f) * a.Position[i] + f * b.Position[i];
+	}
+
+	QuatToPose(q, p, pose);
+}
@@ -0,0 +1,69 @@
+#ifndef KU_HEADTRAJECTORY_H
+#define KU_HEADTRAJECTORY_H
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <OpenVR.h>
+
+// Head pose as a function of time, drives kuNullHMDBackend.
+class kuHeadTrajectory
+{
+public:
+	virtual ~kuHeadTrajectory() {}
+
+	// Pose in tracking space (OpenVR convention, meters) timeSec after the start
+	virtual void	GetPose(double timeSec, vr::HmdMatrix34_t & pose) = 0;
+};
+
+// Procedural motion: standing head swinging in yaw and pitch with a small positional sway.
+// Sinusoids, so the angular speed sweeps from zero to its peak every half period.
+class kuScriptedTrajectory : public kuHeadTrajectory
+{
+public:
+	kuScriptedTrajectory(float yawAmplitude = 30.0f, float yawFrequency = 0.25f,		// degree, Hz
+						 float pitchAmplitude = 10.0f, float pitchFrequency = 0.4f,
+						 float swayAmplitude = 0.02f, float height = 1.6f);			// m
+	~kuScriptedTrajectory();
+
+	void	GetPose(double timeSec, vr::HmdMatrix34_t & pose);
+
+private:
+	float	m_YawAmplitude;
+	float	m_YawFrequency;
+	float	m_PitchAmplitude;
+	float	m_PitchFrequency;
+	float	m_SwayAmplitude;
+	float	m_Height;
+};
+
+// Recorded motion, loaded from a CSV with the header line
+//     time_s,x,y,z,qw,qx,qy,qz
+// or from the HMD poses of a recorded session (kuSessionFile.h).
+// Poses are interpolated between samples and the recording loops.
+class kuRecordedTrajectory : public kuHeadTrajectory
+{
+public:
+	kuRecordedTrajectory();
+	~kuRecordedTrajectory();
+
+	bool	Load(const char * path);
+	void	GetPose(double timeSec, vr::HmdMatrix34_t & pose);
+
+	double	GetDuration();
+
+private:
+	struct Sample {
+		double	Time;
+		float	Position[3];
+		float	Rotation[4];											// w, x, y, z
+	};
+
+	std::vector<Sample>	m_Samples;
+
+	bool	LoadCSV(FILE * file);
+	bool	LoadSession(const char * path);
+};
+
+#endif // !KU_HEADTRAJECTORY_H
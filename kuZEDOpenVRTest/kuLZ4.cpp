@@ -0,0 +1,288 @@
+#include "kuLZ4.h"
+
+#include <string.h>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const int		HashLog		 = 16;
+static const size_t		MinMatch	 = 4;
+static const size_t		MFLimit		 = 12;						// A match must start at least this far from the end
+static const size_t		LastLiterals = 5;						// The last bytes are always literals
+static const size_t		MaxDistance	 = 65535;
+
+static inline uint32_t Read32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64_t Read64(const uint8_t * p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint32_t Hash(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - HashLog);
+}
+
+static inline int CountTrailingZeros(uint64_t v)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return (int)index;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+// Length of the common prefix of a and b, b < a, not reading past limit
+static inline size_t MatchLength(const uint8_t * a, const uint8_t * b, const uint8_t * limit)
+{
+	const uint8_t * start = a;
+	while (a + 8 <= limit)
+	{
+		uint64_t diff = Read64(a) ^ Read64(b);
+		if (diff)
+		{
+			return (a - start) + (CountTrailingZeros(diff) >> 3);
+		}
+		a += 8;
+		b += 8;
+	}
+	while (a < limit && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return a - start;
+}
+
+static inline uint8_t * WriteLength(uint8_t * op, size_t length)
+{
+	while (length >= 255)
+	{
+		*op++	= 255;
+		length -= 255;
+	}
+	*op++ = (uint8_t)length;
+	return op;
+}
+
+static uint8_t * WriteSequence(uint8_t * op, const uint8_t * literals, size_t numLiterals, size_t offset, size_t matchLength)
+{
+	uint8_t * token = op++;
+
+	*token = (uint8_t)((numLiterals < 15 ? numLiterals : 15) << 4);
+	if (numLiterals >= 15)
+	{
+		op = WriteLength(op, numLiterals - 15);
+	}
+	memcpy(op, literals, numLiterals);
+	op += numLiterals;
+
+	if (matchLength)
+	{
+		op[0] = (uint8_t)offset;
+		op[1] = (uint8_t)(offset >> 8);
+		op	 += 2;
+
+		size_t code = matchLength - MinMatch;
+		*token |= (uint8_t)(code < 15 ? code : 15);
+		if (code >= 15)
+		{
+			op = WriteLength(op, code - 15);
+		}
+	}
+	return op;
+}
+
+size_t kuLZ4CompressBound(size_t n)
+{
+	return n + n / 255 + 16;
+}
+
+size_t kuLZ4Compress(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstCapacity)
+{
+	if (dstCapacity < kuLZ4CompressBound(srcSize) || srcSize > 0x7E000000)
+	{
+		return 0;
+	}
+
+	// Positions of the last occurrence of each hashed 4 byte sequence, per thread so workers can share the codec
+	thread_local std::vector<uint32_t> hashTable;
+	hashTable.assign((size_t)1 << HashLog, 0);
+	uint32_t * table = hashTable.data();
+
+	const uint8_t * ip		   = src;
+	const uint8_t * anchor	   = src;
+	const uint8_t * end		   = src + srcSize;
+	const uint8_t * matchLimit = end - LastLiterals;
+	uint8_t		  * op		   = dst;
+
+	if (srcSize >= MFLimit + 1)
+	{
+		const uint8_t * mfLimit = end - MFLimit;
+
+		// Skip faster through data that does not compress
+		unsigned attempts = 1 << 6;
+		ip++;
+		while (ip < mfLimit)
+		{
+			uint32_t		sequence = Read32(ip);
+			uint32_t		h		 = Hash(sequence);
+			const uint8_t * ref		 = src + table[h];
+			table[h] = (uint32_t)(ip - src);
+
+			if (ref >= ip || (size_t)(ip - ref) > MaxDistance || Read32(ref) != sequence)
+			{
+				ip += attempts++ >> 6;
+				continue;
+			}
+			attempts = 1 << 6;
+
+			// Extend backwards over pending literals
+			while (ip > anchor && ref > src && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+
+			size_t length = MinMatch + MatchLength(ip + MinMatch, ref + MinMatch, matchLimit);
+			op	   = WriteSequence(op, anchor, ip - anchor, ip - ref, length);
+			ip	  += length;
+			anchor = ip;
+
+			if (ip < mfLimit)
+			{
+				table[Hash(Read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+			}
+		}
+	}
+
+	op = WriteSequence(op, anchor, end - anchor, 0, 0);
+	return op - dst;
+}
+
+bool kuLZ4Decompress(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstSize)
+{
+	const uint8_t * ip	   = src;
+	const uint8_t * ipEnd  = src + srcSize;
+	uint8_t		  * op	   = dst;
+	uint8_t		  * opEnd  = dst + dstSize;
+
+	while (ip < ipEnd)
+	{
+		unsigned token = *ip++;
+
+		// Literals
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15)
+		{
+			unsigned b;
+			do
+			{
+				if (ip >= ipEnd)
+				{
+					return false;
+				}
+				b			 = *ip++;
+				numLiterals += b;
+			} while (b == 255);
+		}
+		if (numLiterals > (size_t)(ipEnd - ip) || numLiterals > (size_t)(opEnd - op))
+		{
+			return false;
+		}
+		// Short runs are copied as one fixed 16 byte block when both buffers have the room
+		if (numLiterals <= 16 && ipEnd - ip >= 16 && opEnd - op >= 16)
+		{
+			memcpy(op, ip, 16);
+		}
+		else
+		{
+			memcpy(op, ip, numLiterals);
+		}
+		ip += numLiterals;
+		op += numLiterals;
+
+		// The last sequence has no match
+		if (ip == ipEnd)
+		{
+			break;
+		}
+
+		if (ipEnd - ip < 2)
+		{
+			return false;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+		{
+			return false;
+		}
+
+		size_t length = (token & 15);
+		if (length == 15)
+		{
+			unsigned b;
+			do
+			{
+				if (ip >= ipEnd)
+				{
+					return false;
+				}
+				b		= *ip++;
+				length += b;
+			} while (b == 255);
+		}
+		length += MinMatch;
+		if (length > (size_t)(opEnd - op))
+		{
+			return false;
+		}
+
+		// Overlapping matches repeat the last offset bytes, so copy forward one at a time
+		const uint8_t * match = op - offset;
+		if (offset >= 16 && length <= 32 && opEnd - op >= 32)
+		{
+			memcpy(op, match, 16);
+			memcpy(op + 16, match + 16, 16);
+			op += length;
+		}
+		else if (offset >= length)
+		{
+			memcpy(op, match, length);
+			op += length;
+		}
+		else if (offset >= 8)
+		{
+			uint8_t * copyEnd = op + length;
+			while (op < copyEnd)
+			{
+				size_t n = copyEnd - op < (ptrdiff_t)offset ? copyEnd - op : offset;
+				memcpy(op, match, n);
+				op	  += n;
+				match += n;
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+			{
+				op[i] = match[i];
+			}
+			op += length;
+		}
+	}
+
+	return op == opEnd;
+}
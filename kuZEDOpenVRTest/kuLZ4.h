@@ -0,0 +1,19 @@
+#ifndef KU_LZ4_H
+#define KU_LZ4_H
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format (no frame header, no checksums), compatible with LZ4_compress_default
+// and LZ4_decompress_safe. Greedy single-probe matcher, a few hundred MB/s per core.
+
+// Worst case compressed size of n bytes
+size_t		kuLZ4CompressBound(size_t n);
+// Returns the compressed size, 0 if dstCapacity < kuLZ4CompressBound(srcSize) or srcSize > 2 GB
+size_t		kuLZ4Compress(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstCapacity);
+// False on corrupt input or if the output is not exactly dstSize bytes
+bool		kuLZ4Decompress(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstSize);
+
+#endif // !KU_LZ4_H
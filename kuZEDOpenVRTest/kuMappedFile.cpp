@@ -0,0 +1,161 @@
+#include "kuMappedFile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+kuMappedFile::kuMappedFile()
+	: m_Data(nullptr), m_Size(0)
+#ifdef _WIN32
+	, m_FileHandle(INVALID_HANDLE_VALUE), m_MappingHandle(nullptr)
+#else
+	, m_FileDescriptor(-1)
+#endif
+{
+}
+
+kuMappedFile::~kuMappedFile()
+{
+	this->Close();
+}
+
+bool kuMappedFile::Open(const char * path)
+{
+	this->Close();
+
+#ifdef _WIN32
+	m_FileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_FileHandle == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "MappedFile: cannot open " << path << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(m_FileHandle, &size);
+	m_Size = (uint64_t)size.QuadPart;
+
+	if (m_Size > 0)
+	{
+		m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_MappingHandle)
+		{
+			m_Data = (const uint8_t *)MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+#else
+	m_FileDescriptor = open(path, O_RDONLY);
+	if (m_FileDescriptor < 0)
+	{
+		std::cout << "MappedFile: cannot open " << path << std::endl;
+		return false;
+	}
+
+	struct stat st;
+	fstat(m_FileDescriptor, &st);
+	m_Size = (uint64_t)st.st_size;
+
+	if (m_Size > 0)
+	{
+		void * data = mmap(nullptr, (size_t)m_Size, PROT_READ, MAP_SHARED, m_FileDescriptor, 0);
+		m_Data = data == MAP_FAILED ? nullptr : (const uint8_t *)data;
+	}
+#endif
+
+	if (!m_Data)
+	{
+		std::cout << "MappedFile: cannot map " << path << " (" << m_Size << " bytes)" << std::endl;
+		this->Close();
+		return false;
+	}
+
+	return true;
+}
+
+void kuMappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_Data)
+	{
+		UnmapViewOfFile(m_Data);
+	}
+	if (m_MappingHandle)
+	{
+		CloseHandle(m_MappingHandle);
+		m_MappingHandle = nullptr;
+	}
+	if (m_FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_FileHandle);
+		m_FileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_Data)
+	{
+		munmap((void *)m_Data, (size_t)m_Size);
+	}
+	if (m_FileDescriptor >= 0)
+	{
+		close(m_FileDescriptor);
+		m_FileDescriptor = -1;
+	}
+#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+bool kuMappedFile::IsOpen()
+{
+	return m_Data != nullptr;
+}
+
+const uint8_t * kuMappedFile::GetData()
+{
+	return m_Data;
+}
+
+uint64_t kuMappedFile::GetSize()
+{
+	return m_Size;
+}
+
+void kuMappedFile::Prefetch(uint64_t offset, uint64_t size)
+{
+	if (!m_Data || offset >= m_Size)
+	{
+		return;
+	}
+	if (size > m_Size - offset)
+	{
+		size = m_Size - offset;
+	}
+
+#ifdef _WIN32
+	// PrefetchVirtualMemory needs Windows 8, look it up so the binary still starts on 7
+	struct MemoryRange { PVOID VirtualAddress; SIZE_T NumberOfBytes; };		// WIN32_MEMORY_RANGE_ENTRY
+	typedef BOOL (WINAPI * PrefetchFunc)(HANDLE, ULONG_PTR, MemoryRange *, ULONG);
+	static PrefetchFunc prefetch = (PrefetchFunc)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+	if (prefetch)
+	{
+		MemoryRange range;
+		range.VirtualAddress = (PVOID)(m_Data + offset);
+		range.NumberOfBytes	 = (SIZE_T)size;
+		prefetch(GetCurrentProcess(), 1, &range, 0);
+	}
+#else
+	// madvise wants a page aligned start
+	uint64_t pageMask = (uint64_t)sysconf(_SC_PAGESIZE) - 1;
+	uint64_t begin	  = offset & ~pageMask;
+	madvise((void *)(m_Data + begin), (size_t)(offset + size - begin), MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef KU_MAPPEDFILE_H
+#define KU_MAPPEDFILE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file. Pages are faulted in by the OS on
+// first access, so opening is cheap regardless of the file size.
+class kuMappedFile
+{
+public:
+	kuMappedFile();
+	~kuMappedFile();
+
+	bool				Open(const char * path);
+	void				Close();
+
+	bool				IsOpen();
+	const uint8_t	*	GetData();
+	uint64_t			GetSize();
+
+	// Hint that the range will be read soon / sequentially (no-op where unsupported)
+	void				Prefetch(uint64_t offset, uint64_t size);
+
+private:
+	const uint8_t	*	m_Data;
+	uint64_t			m_Size;
+#ifdef _WIN32
+	void			*	m_FileHandle;
+	void			*	m_MappingHandle;
+#else
+	int					m_FileDescriptor;
+#endif
+};
+
+#endif // !KU_MAPPEDFILE_H
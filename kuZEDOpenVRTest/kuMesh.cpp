@@ -1,38 +1,226 @@
 #include "kuMesh.h"
+#include "kuGeometryArena.h"
+#include "kuMeshOptimizer.h"
 
-kuMesh::kuMesh(vector<kuVertex> vertices, vector<GLuint> indices, vector<kuTexture> textures)
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// Packed positions are used while the 16 bit grid step stays below this fraction of the
+// mean edge length, so quantisation never shows as more than a sliver of a triangle
+static const float kuMaxQuantizationStep = 0.01f;
+
+// Round to nearest half float, denormals flushed to zero
+static GLushort FloatToHalf(float value)
 {
-	this->vertices = vertices;
-	this->indices  = indices;
-	this->textures = textures;
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign	  = (bits >> 16) & 0x8000;
+	int32_t	 exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent <= 0)
+	{
+		return (GLushort)sign;
+	}
+	if (exponent >= 31)
+	{
+		return (GLushort)(sign | 0x7c00);
+	}
 
-	this->setupMesh();
+	uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+	return (GLushort)(half + ((mantissa >> 12) & 1));				// Carry into the exponent is still the right rounding
 }
 
-void kuMesh::Draw(kuShaderHandler shader)
+// Octahedral mapping of a unit vector to 2 x snorm16
+static void EncodeOctahedral(const glm::vec3 & n, GLshort encoded[2])
 {
-	GLuint	diffuseNr  = 1;
-	GLuint  specularNr = 1;
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float u	 = l1 > 0.0f ? n.x / l1 : 0.0f;
+	float v	 = l1 > 0.0f ? n.y / l1 : 0.0f;
+	if (n.z < 0.0f)
+	{
+		float fu = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float fv = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+
+	encoded[0] = (GLshort)floorf(u * 32767.0f + 0.5f);
+	encoded[1] = (GLshort)floorf(v * 32767.0f + 0.5f);
+}
+
+// Layouts without texture coordinates have nothing to pack, PackVertices() calls both alike
+static void PackTexCoord(const kuVertex &, kuPackedVertex &)
+{
+}
+
+static void PackTexCoord(const kuVertex & vertex, kuPackedVertexTexCoord & packed)
+{
+	packed.TexCoord[0] = FloatToHalf(vertex.TexCoord.x);
+	packed.TexCoord[1] = FloatToHalf(vertex.TexCoord.y);
+}
+
+template <class PackedVertex>
+static void PackVertices(const kuVertex * vertexData, size_t numVertices, const glm::vec3 & offset, const glm::vec3 & scale,
+						 vector<uint8_t> & packed)
+{
+	packed.assign(numVertices * sizeof(PackedVertex), 0);
+	PackedVertex * out = (PackedVertex *)packed.data();
+
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float t = scale[c] > 0.0f ? (vertexData[i].Position[c] - offset[c]) / scale[c] : 0.0f;
+			out[i].Position[c] = (GLushort)floorf(glm::clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		}
+		EncodeOctahedral(vertexData[i].Normal, out[i].Normal);
+		PackTexCoord(vertexData[i], out[i]);
+	}
+}
+
+size_t kuGetVertexStride(kuVertexLayout layout)
+{
+	switch (layout)
+	{
+	case kuVertexLayout_Packed:			return sizeof(kuPackedVertex);
+	case kuVertexLayout_PackedTexCoord:	return sizeof(kuPackedVertexTexCoord);
+	default:							return sizeof(kuVertex);
+	}
+}
+
+void kuSetVertexAttributes(kuVertexLayout layout)
+{
+	GLsizei stride = (GLsizei)kuGetVertexStride(layout);
+
+	if (layout == kuVertexLayout_Float)
+	{
+		// position
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(kuVertex), (GLvoid *)0);
+
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(kuVertex), (GLvoid *)offsetof(kuVertex, Normal));
+
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(kuVertex), (GLvoid *)offsetof(kuVertex, TexCoord));
+	}
+	else
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid *)offsetof(kuPackedVertex, Position));
+
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (GLvoid *)offsetof(kuPackedVertex, Normal));
+
+		// Without texcoords the attribute stays disabled and reads as (0, 0)
+		if (layout == kuVertexLayout_PackedTexCoord)
+		{
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid *)offsetof(kuPackedVertexTexCoord, TexCoord));
+		}
+	}
+}
+
+kuMesh::kuMesh(vector<kuVertex> vertices, vector<GLuint> indices, vector<kuTexture> textures, vector<kuMeshLOD> lods,
+			   bool packVertices, kuGeometryArena * arena)
+{
+	this->vertices = std::move(vertices);
+	this->indices  = std::move(indices);
+	this->textures = std::move(textures);
+	this->lods	   = std::move(lods);
+
+	this->setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), packVertices, arena);
+}
+
+kuMesh::kuMesh(const kuVertex * vertexData, size_t numVertices, const GLuint * indexData, size_t numIndices,
+			   const kuMeshLOD * lodData, size_t numLODs, bool packVertices, kuGeometryArena * arena)
+{
+	this->lods.assign(lodData, lodData + numLODs);
+
+	this->setupMesh(vertexData, numVertices, indexData, numIndices, packVertices, arena);
+}
+
+void kuMeshUniforms::Resolve(kuShaderHandler & shader)
+{
+	if (this->Program == shader.GetShaderProgramID())
+	{
+		return;
+	}
+
+	this->Program			= shader.GetShaderProgramID();
+	this->PositionOffset	= shader.GetUniform<glm::vec3>("PositionOffset");
+	this->PositionScale		= shader.GetUniform<glm::vec3>("PositionScale");
+	this->OctahedralNormals = shader.GetUniform<bool>("OctahedralNormals");
+	this->ArenaDraw			= shader.GetUniform<bool>("ArenaDraw");
+	this->MaterialAmbient	= shader.GetUniform<glm::vec3>("material.ambient");
+	this->MaterialDiffuse	= shader.GetUniform<glm::vec3>("material.diffuse");
+	this->MaterialSpecular	= shader.GetUniform<glm::vec3>("material.specular");
+}
+
+void kuMesh::Draw(kuShaderHandler & shader, int lod)
+{
+	if (this->Arena)
+	{
+		vector<kuDrawElementsIndirectCommand> commands[kuVertexLayout_Count];
+		this->AppendDrawCommands(lod, commands);
+		this->Arena->Draw(shader, commands);
+		return;
+	}
+
+	// Sampler names only need building when the program changes
+	if (this->Uniforms.Program != shader.GetShaderProgramID())
+	{
+		GLuint	diffuseNr  = 1;
+		GLuint  specularNr = 1;
+
+		this->TextureSamplers.clear();
+		for (int i = 0; i < this->textures.size(); i++)
+		{
+			stringstream ss;
+			string number;
+			string name = this->textures[i].type;
+			if (name == "texture_diffuse")
+				ss << diffuseNr++; // Transfer GLuint to stream
+			else if (name == "texture_specular")
+				ss << specularNr++; // Transfer GLuint to stream
+			number = ss.str();
+
+			this->TextureSamplers.push_back(shader.GetUniform<int>((name + number).c_str()));
+		}
+		this->Uniforms.Resolve(shader);
+	}
 
 	for (int i = 0; i < this->textures.size(); i++)
 	{
 		glActiveTexture(GL_TEXTURE0 + i);
-		stringstream ss;
-		string number;
-		string name = this->textures[i].type;
-		if (name == "texture_diffuse")
-			ss << diffuseNr++; // Transfer GLuint to stream
-		else if (name == "texture_specular")
-			ss << specularNr++; // Transfer GLuint to stream
-		number = ss.str();
-
-		glUniform1f(glGetUniformLocation(shader.GetShaderProgramID(), ( name + number).c_str()), i);
+		shader.Set(this->TextureSamplers[i], i);
 		glBindTexture(GL_TEXTURE_2D, this->textures[i].TextureID);	
 	}
 	glActiveTexture(GL_TEXTURE0);
 
+	shader.Set(this->Uniforms.PositionOffset, this->PositionOffset);
+	shader.Set(this->Uniforms.PositionScale, this->PositionScale);
+	shader.Set(this->Uniforms.OctahedralNormals, this->VertexLayout != kuVertexLayout_Float);
+	shader.Set(this->Uniforms.ArenaDraw, false);
+
+	lod = this->clampLOD(lod);
+	const kuMeshLOD & level = this->lods[lod];
+
 	glBindVertexArray(this->VAO);
-	glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+	if (this->CulledLOD == lod)
+	{
+		if (!this->DrawCounts.empty())
+		{
+			glMultiDrawElements(GL_TRIANGLES, this->DrawCounts.data(), GL_UNSIGNED_INT, this->DrawOffsets.data(), (GLsizei)this->DrawCounts.size());
+		}
+	}
+	else
+	{
+		glDrawElements(GL_TRIANGLES, level.NumIndices, GL_UNSIGNED_INT, (GLvoid *)(level.FirstIndex * sizeof(GLuint)));
+	}
 	glBindVertexArray(0);
 
 	for (GLuint i = 0; i < this->textures.size(); i++)
@@ -43,6 +231,8 @@ void kuMesh::Draw(kuShaderHandler shader)
 }
 
 kuMesh::kuMesh()
+	: VAO(0), VBO(0), EBO(0), Arena(nullptr), ArenaBaseVertex(0), ArenaFirstIndex(0), ArenaDrawID(0), BoundsCenter(0.0f, 0.0f, 0.0f), BoundsRadius(0.0f), CulledLOD(-1), DrawIndexCount(0),
+	  VertexLayout(kuVertexLayout_Float), VertexBufferSize(0), PositionOffset(0.0f, 0.0f, 0.0f), PositionScale(1.0f, 1.0f, 1.0f)
 {
 }
 
@@ -51,8 +241,257 @@ kuMesh::~kuMesh()
 {
 }
 
-void kuMesh::setupMesh()
+int kuMesh::GetNumLODs()
+{
+	return (int)this->lods.size();
+}
+
+const glm::vec3 & kuMesh::GetBoundsCenter()
 {
+	return this->BoundsCenter;
+}
+
+float kuMesh::GetBoundsRadius()
+{
+	return this->BoundsRadius;
+}
+
+kuMeshCullStats kuMesh::Cull(int lod, const glm::mat4 * clipMats, int numViews)
+{
+	kuMeshCullStats stats;
+
+	lod = this->clampLOD(lod);
+	this->CulledLOD		 = lod;
+	this->DrawIndexCount = 0;
+	this->DrawCounts.clear();
+	this->DrawOffsets.clear();
+
+	// Frustum planes (Gribb and Hartmann) and the eye, all in model space. The eye is
+	// where clip x, y and w are all zero, i.e. where rows 0, 1 and 3 meet as planes.
+	const int	maxViews = 2;
+	glm::vec4	planes[maxViews][6];
+	glm::vec3	eyes[maxViews];
+	numViews = numViews < maxViews ? numViews : maxViews;
+	for (int v = 0; v < numViews; v++)
+	{
+		const glm::mat4 & m = clipMats[v];
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++)
+		{
+			rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+		}
+		for (int p = 0; p < 6; p++)
+		{
+			glm::vec4 plane	 = (p & 1) ? rows[3] - rows[p / 2] : rows[3] + rows[p / 2];
+			float	  length = glm::length(glm::vec3(plane.x, plane.y, plane.z));
+			planes[v][p]	 = length > 0.0f ? plane * (1.0f / length) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+
+		glm::vec3 n0(rows[0].x, rows[0].y, rows[0].z), n1(rows[1].x, rows[1].y, rows[1].z), n3(rows[3].x, rows[3].y, rows[3].z);
+		float	  det = glm::dot(n0, glm::cross(n1, n3));
+		eyes[v] = det != 0.0f ? (glm::cross(n1, n3) * rows[0].w + glm::cross(n3, n0) * rows[1].w + glm::cross(n0, n1) * rows[3].w) * (-1.0f / det)
+							  : glm::vec3(0.0f, 0.0f, 0.0f);
+	}
+
+	GLuint first = this->LODMeshlets[lod], last = this->LODMeshlets[lod + 1];
+	for (GLuint i = first; i < last; i++)
+	{
+		const kuMeshlet & meshlet = this->Meshlets[i];
+		bool inFrustum = false, frontFacing = false;
+		for (int v = 0; v < numViews; v++)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				inside = glm::dot(glm::vec3(planes[v][p].x, planes[v][p].y, planes[v][p].z), meshlet.Center) + planes[v][p].w > -meshlet.Radius;
+			}
+			inFrustum = inFrustum || inside;
+
+			glm::vec3 toMeshlet = meshlet.Center - eyes[v];
+			frontFacing = frontFacing ||
+						  glm::dot(toMeshlet, meshlet.ConeAxis) < meshlet.ConeCutoff * glm::length(toMeshlet) + meshlet.Radius;
+		}
+
+		stats.Meshlets++;
+		stats.Triangles += meshlet.NumIndices / 3;
+		if (!inFrustum || !frontFacing)
+		{
+			(!inFrustum ? stats.FrustumCulled : stats.BackfaceCulled)++;
+			stats.TrianglesCulled += meshlet.NumIndices / 3;
+			continue;
+		}
+
+		// Meshlets are consecutive in the index buffer, extend the last range when possible
+		const GLvoid * offset = (const GLvoid *)(meshlet.FirstIndex * sizeof(GLuint));
+		if (!this->DrawCounts.empty() &&
+			(const char *)this->DrawOffsets.back() + this->DrawCounts.back() * sizeof(GLuint) == (const char *)offset)
+		{
+			this->DrawCounts.back() += meshlet.NumIndices;
+		}
+		else
+		{
+			this->DrawCounts.push_back(meshlet.NumIndices);
+			this->DrawOffsets.push_back(offset);
+		}
+		this->DrawIndexCount += meshlet.NumIndices;
+	}
+
+	return stats;
+}
+
+GLsizei kuMesh::GetDrawIndexCount(int lod)
+{
+	lod = this->clampLOD(lod);
+	return this->CulledLOD == lod ? this->DrawIndexCount : this->lods[lod].NumIndices;
+}
+
+void kuMesh::AppendDrawCommands(int lod, vector<kuDrawElementsIndirectCommand> * commands, int numViews)
+{
+	if (!this->Arena)
+	{
+		return;
+	}
+
+	lod = this->clampLOD(lod);
+	vector<kuDrawElementsIndirectCommand> & out = commands[this->VertexLayout];
+
+	kuDrawElementsIndirectCommand command;
+	command.InstanceCount = numViews;
+	command.BaseVertex	  = this->ArenaBaseVertex;
+	command.BaseInstance  = this->ArenaDrawID;
+
+	if (this->CulledLOD == lod)
+	{
+		for (size_t i = 0; i < this->DrawCounts.size(); i++)
+		{
+			command.Count	   = this->DrawCounts[i];
+			command.FirstIndex = this->ArenaFirstIndex + (GLuint)((size_t)this->DrawOffsets[i] / sizeof(GLuint));
+			out.push_back(command);
+		}
+	}
+	else
+	{
+		command.Count	   = this->lods[lod].NumIndices;
+		command.FirstIndex = this->ArenaFirstIndex + this->lods[lod].FirstIndex;
+		out.push_back(command);
+	}
+}
+
+int kuMesh::clampLOD(int lod)
+{
+	return lod < 0 ? 0 : (lod < (int)this->lods.size() ? lod : (int)this->lods.size() - 1);
+}
+
+kuVertexLayout kuMesh::GetVertexLayout()
+{
+	return this->VertexLayout;
+}
+
+size_t kuMesh::GetVertexBufferSize()
+{
+	return this->VertexBufferSize;
+}
+
+void kuMesh::setupMesh(const kuVertex * vertexData, size_t numVertices, const GLuint * indexData, size_t numIndices, bool packVertices,
+					   kuGeometryArena * arena)
+{
+	if (this->lods.empty())
+	{
+		kuMeshLOD all = { 0, (GLsizei)numIndices, 0.0f };
+		this->lods.push_back(all);
+	}
+
+	// Sphere around the box, enough for picking a LOD
+	glm::vec3 lo(0.0f, 0.0f, 0.0f), hi(0.0f, 0.0f, 0.0f);
+	for (size_t i = 0; i < numVertices; i++)
+	{
+		const glm::vec3 & p = vertexData[i].Position;
+		lo = i ? glm::vec3(p.x < lo.x ? p.x : lo.x, p.y < lo.y ? p.y : lo.y, p.z < lo.z ? p.z : lo.z) : p;
+		hi = i ? glm::vec3(p.x > hi.x ? p.x : hi.x, p.y > hi.y ? p.y : hi.y, p.z > hi.z ? p.z : hi.z) : p;
+	}
+	glm::vec3 extent   = hi - lo;
+	this->BoundsCenter = (lo + hi) * 0.5f;
+	this->BoundsRadius = 0.5f * sqrtf(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+
+	// Meshlets of every LOD for culling
+	this->Meshlets.clear();
+	this->LODMeshlets.assign(1, 0);
+	for (size_t i = 0; i < this->lods.size(); i++)
+	{
+		kuBuildMeshlets(vertexData, numVertices, indexData, this->lods[i].FirstIndex, this->lods[i].NumIndices, this->Meshlets);
+		this->LODMeshlets.push_back((GLuint)this->Meshlets.size());
+	}
+	this->CulledLOD		 = -1;
+	this->DrawIndexCount = 0;
+
+	// Packed only if the grid is fine against the triangles, texcoords only if there are any
+	this->VertexLayout	 = kuVertexLayout_Float;
+	this->PositionOffset = glm::vec3(0.0f, 0.0f, 0.0f);
+	this->PositionScale	 = glm::vec3(1.0f, 1.0f, 1.0f);
+	if (packVertices && numVertices > 0)
+	{
+		const kuMeshLOD & full		  = this->lods[0];
+		double			  edgeLength  = 0.0;
+		for (GLsizei i = 0; i + 2 < full.NumIndices; i += 3)
+		{
+			const GLuint * tri = indexData + full.FirstIndex + i;
+			for (int e = 0; e < 3; e++)
+			{
+				glm::vec3 d = vertexData[tri[e]].Position - vertexData[tri[(e + 1) % 3]].Position;
+				edgeLength += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+			}
+		}
+		edgeLength /= full.NumIndices > 0 ? full.NumIndices : 1;
+
+		float step		= std::max(extent.x, std::max(extent.y, extent.z)) / 65535.0f;
+		bool  texCoords = false;
+		for (size_t i = 0; i < numVertices && !texCoords; i++)
+		{
+			texCoords = vertexData[i].TexCoord.x != 0.0f || vertexData[i].TexCoord.y != 0.0f;
+		}
+
+		if (step <= kuMaxQuantizationStep * edgeLength)
+		{
+			this->VertexLayout	 = texCoords ? kuVertexLayout_PackedTexCoord : kuVertexLayout_Packed;
+			this->PositionOffset = lo;
+			this->PositionScale	 = extent;
+		}
+	}
+
+	vector<uint8_t>	packed;
+	size_t			stride = kuGetVertexStride(this->VertexLayout);
+	if (this->VertexLayout == kuVertexLayout_Packed)
+	{
+		PackVertices<kuPackedVertex>(vertexData, numVertices, this->PositionOffset, this->PositionScale, packed);
+	}
+	else if (this->VertexLayout == kuVertexLayout_PackedTexCoord)
+	{
+		PackVertices<kuPackedVertexTexCoord>(vertexData, numVertices, this->PositionOffset, this->PositionScale, packed);
+	}
+	this->VertexBufferSize = numVertices * stride;
+
+	cout << "Vertex buffer: " << numVertices << " x " << stride << " B "
+		 << (this->VertexLayout == kuVertexLayout_Float ? "float" : "packed") << ", " << this->VertexBufferSize / 1024 << " KB" << endl;
+
+	const GLvoid * uploadData = packed.empty() ? (const GLvoid *)vertexData : packed.data();
+
+	this->Arena = arena;
+	if (arena)
+	{
+		kuArenaDrawData drawData;
+		drawData.PositionOffset = glm::vec4(this->PositionOffset, 0.0f);
+		drawData.PositionScale	= glm::vec4(this->PositionScale, 0.0f);
+
+		kuArenaRange range		= arena->Add(this->VertexLayout, uploadData, numVertices, indexData, numIndices, drawData);
+		this->VAO				= 0;
+		this->VBO				= 0;
+		this->EBO				= 0;
+		this->ArenaBaseVertex	= range.BaseVertex;
+		this->ArenaFirstIndex	= range.FirstIndex;
+		this->ArenaDrawID		= range.DrawID;
+		return;
+	}
+
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
@@ -60,22 +499,12 @@ void kuMesh::setupMesh()
 	glBindVertexArray(this->VAO);
 	
 	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-	glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(kuVertex), 
-				 &this->vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, this->VertexBufferSize, uploadData, GL_STATIC_DRAW);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint),
-				 &this->indices[0], GL_STATIC_DRAW);
-
-	// position
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(kuVertex), (GLvoid *)0);
-
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(kuVertex), (GLvoid *)offsetof(kuVertex, Normal));
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLuint), indexData, GL_STATIC_DRAW);
 
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(kuVertex), (GLvoid *)offsetof(kuVertex, TexCoord));
+	kuSetVertexAttributes(this->VertexLayout);
 
 	glBindVertexArray(0);
 }
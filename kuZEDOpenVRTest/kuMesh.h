@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <GLEW/glew.h>
@@ -31,22 +32,149 @@ struct kuMaterial {
 	glm::vec3		Specular;
 };
 
+// GPU vertex layouts. Packed stores positions as 16 bit fractions of the mesh's bounding box,
+// normals octahedral in 2 x 16 bit snorm and texcoords as half floats, or not at all when
+// every texcoord is zero. ModelVertexShader.vert decodes both layouts.
+enum kuVertexLayout {
+	kuVertexLayout_Float,											// kuVertex as is, 32 bytes
+	kuVertexLayout_Packed,											// kuPackedVertex, 12 bytes
+	kuVertexLayout_PackedTexCoord,									// kuPackedVertexTexCoord, 16 bytes
+	kuVertexLayout_Count
+};
+
+struct kuPackedVertex {
+	GLushort		Position[4];									// unorm16 within the bounding box, [3] unused
+	GLshort			Normal[2];										// snorm16 octahedral
+};
+
+struct kuPackedVertexTexCoord {
+	GLushort		Position[4];
+	GLshort			Normal[2];
+	GLushort		TexCoord[2];									// Half float
+};
+
+size_t		kuGetVertexStride(kuVertexLayout layout);
+// Points attributes 0 - 2 of the bound VAO at the bound GL_ARRAY_BUFFER
+void		kuSetVertexAttributes(kuVertexLayout layout);
+
+// Handles of the uniforms kuMesh, kuGeometryArena and kuModelObject set, looked up again
+// only when a different program comes along
+struct kuMeshUniforms {
+	GLuint					Program;
+	kuUniform<glm::vec3>	PositionOffset;
+	kuUniform<glm::vec3>	PositionScale;
+	kuUniform<bool>			OctahedralNormals;
+	kuUniform<bool>			ArenaDraw;
+	kuUniform<glm::vec3>	MaterialAmbient;
+	kuUniform<glm::vec3>	MaterialDiffuse;
+	kuUniform<glm::vec3>	MaterialSpecular;
+
+	kuMeshUniforms() : Program(0) {}
+	void	Resolve(kuShaderHandler & shader);
+};
+
+class kuGeometryArena;
+struct kuArenaRange;
+struct kuDrawElementsIndirectCommand;
+
+// One level of detail: a range of the mesh's index buffer over the shared vertices
+struct kuMeshLOD {
+	GLuint		FirstIndex;
+	GLsizei		NumIndices;
+	float		Error;												// Max distance from LOD 0, model units
+};
+
+// A small cluster of consecutive triangles of one LOD, with bounds for culling (model space)
+struct kuMeshlet {
+	glm::vec3	Center;												// Bounding sphere
+	float		Radius;
+	glm::vec3	ConeAxis;											// Average facing of the triangles
+	float		ConeCutoff;											// Sine of the cone's half angle, 1 disables backface culling
+	GLuint		FirstIndex;
+	GLsizei		NumIndices;
+};
+
+// Culling results of one kuMesh::Cull call
+struct kuMeshCullStats {
+	uint64_t	Meshlets;
+	uint64_t	FrustumCulled;										// Meshlets outside every view
+	uint64_t	BackfaceCulled;										// Meshlets facing away from every view
+	uint64_t	Triangles;
+	uint64_t	TrianglesCulled;
+
+	kuMeshCullStats() : Meshlets(0), FrustumCulled(0), BackfaceCulled(0), Triangles(0), TrianglesCulled(0) {}
+};
+
 class kuMesh
 {
 public:
 	vector<kuVertex>	vertices;
-	vector<GLuint>		indices;
+	vector<GLuint>		indices;										// All LODs back to back
 	vector<kuTexture>	textures;
+	vector<kuMeshLOD>	lods;											// Finest first, a single LOD over all indices if none given
+
+	// packVertices lets setupMesh pick a packed layout when it is precise enough for the mesh.
+	// With an arena the geometry goes into its shared buffers instead of the mesh's own.
+	kuMesh(vector<kuVertex> vertices, vector<GLuint> indices, vector<kuTexture> textures, vector<kuMeshLOD> lods = vector<kuMeshLOD>(),
+		   bool packVertices = true, kuGeometryArena * arena = nullptr);
+	// Uploads straight from the given arrays (e.g. a kuMeshCache mapping), vertices/indices stay empty
+	kuMesh(const kuVertex * vertexData, size_t numVertices, const GLuint * indexData, size_t numIndices,
+		   const kuMeshLOD * lodData = nullptr, size_t numLODs = 0, bool packVertices = true, kuGeometryArena * arena = nullptr);
+	void Draw(kuShaderHandler & shader, int lod = 0);
 
-	kuMesh(vector<kuVertex> vertices, vector<GLuint> indices, vector<kuTexture> textures);
-	void Draw(kuShaderHandler shader);
+	// Keeps only the meshlets of the LOD that some view can see, for the following Draw calls
+	// of that LOD. clipMats map model space to clip space, one per view (eye).
+	kuMeshCullStats		Cull(int lod, const glm::mat4 * clipMats, int numViews);
+	// Indices the next Draw of the LOD submits, after culling
+	GLsizei				GetDrawIndexCount(int lod);
+	// Arena meshes: the index ranges Draw would submit, as indirect commands in the arena's
+	// buffers. Appended to commands[GetVertexLayout()]. numViews instances per command,
+	// one per eye for single-pass stereo.
+	void				AppendDrawCommands(int lod, vector<kuDrawElementsIndirectCommand> * commands, int numViews = 1);
+
+	int					GetNumLODs();
+	// Bounding sphere in model space
+	const glm::vec3	&	GetBoundsCenter();
+	float				GetBoundsRadius();
+
+	kuVertexLayout		GetVertexLayout();
+	size_t				GetVertexBufferSize();						// Bytes of vertex data on the GPU
 
 	kuMesh();
 	~kuMesh();
+
+	// Copies share the GL objects; moves keep the CPU arrays from being copied into the model's list
+	kuMesh(const kuMesh &) = default;
+	kuMesh(kuMesh &&) = default;
+	kuMesh & operator=(const kuMesh &) = default;
+	kuMesh & operator=(kuMesh &&) = default;
 private:
-	GLuint	VAO, VBO, EBO;
+	GLuint				VAO, VBO, EBO;								// 0 for arena meshes
+	kuGeometryArena	*	Arena;
+	GLint				ArenaBaseVertex;
+	GLuint				ArenaFirstIndex;
+	GLuint				ArenaDrawID;
+	glm::vec3	BoundsCenter;
+	float		BoundsRadius;
+
+	vector<kuMeshlet>		Meshlets;									// All LODs, in LOD order
+	vector<GLuint>			LODMeshlets;								// First meshlet of every LOD, plus the total
+	int						CulledLOD;									// LOD the draw ranges below belong to, -1 for none
+	vector<GLsizei>			DrawCounts;									// Visible index ranges, adjacent meshlets merged
+	vector<const GLvoid *>	DrawOffsets;
+	GLsizei					DrawIndexCount;
+
+	kuMeshUniforms			Uniforms;
+	vector<kuUniform<int> >	TextureSamplers;							// texture_diffuseN / texture_specularN per texture
+
+	kuVertexLayout	VertexLayout;
+	size_t			VertexBufferSize;
+	glm::vec3		PositionOffset;										// Packed position decode: offset + scale * unorm16
+	glm::vec3		PositionScale;
 	
-	void	setupMesh();
+	int		clampLOD(int lod);
+	void	setupMesh(const kuVertex * vertexData, size_t numVertices, const GLuint * indexData, size_t numIndices, bool packVertices,
+					  kuGeometryArena * arena);
 };
 
 #endif // !KU_MESH_H
@@ -0,0 +1,304 @@
+#include "kuMeshCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+#include "kuTrace.h"
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t RotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t kuHashBytes(const void * data, uint64_t size)
+{
+	// Eight bytes per step with a multiply-rotate mix, fast enough to run over the source on every launch
+	const uint64_t	k0	  = 0x9E3779B97F4A7C15ull;
+	const uint64_t	k1	  = 0xC2B2AE3D27D4EB4Full;
+	const uint8_t * bytes = (const uint8_t *)data;
+	uint64_t		h	  = k0 ^ size;
+
+	uint64_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		h = RotateLeft(h ^ (word * k1), 31) * k0;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, bytes + i, (size_t)(size - i));
+	h = RotateLeft(h ^ (tail * k1), 31) * k0;
+
+	h ^= h >> 33;
+	h *= k1;
+	h ^= h >> 29;
+	return h;
+}
+
+bool kuHashFile(const char * path, uint64_t & hash, uint64_t & size)
+{
+	KU_PROFILE_ZONE("kuHashFile");
+
+	kuMappedFile file;
+	if (!file.Open(path))
+	{
+		return false;
+	}
+
+	file.Prefetch(0, file.GetSize());
+	hash = kuHashBytes(file.GetData(), file.GetSize());
+	size = file.GetSize();
+	return true;
+}
+
+kuMeshCache::kuMeshCache()
+	: m_Header(nullptr), m_Entries(nullptr)
+{
+}
+
+kuMeshCache::~kuMeshCache()
+{
+	this->Close();
+}
+
+bool kuMeshCache::Open(const char * cachePath, const char * sourcePath, uint32_t importFlags, uint64_t optionsHash)
+{
+	KU_PROFILE_ZONE("kuMeshCache::Open");
+
+	this->Close();
+
+	if (!m_File.Open(cachePath))
+	{
+		return false;
+	}
+	if (!this->Validate())
+	{
+		std::cout << "Mesh cache: " << cachePath << " is broken, ignored." << std::endl;
+		this->Close();
+		return false;
+	}
+
+	uint64_t sourceHash, sourceSize;
+	if (!kuHashFile(sourcePath, sourceHash, sourceSize) ||
+		m_Header->Version != kuMeshCacheVersion || m_Header->VertexSize != sizeof(kuVertex) || m_Header->ImportFlags != importFlags ||
+		m_Header->OptionsHash != optionsHash ||
+		m_Header->SourceSize != sourceSize || m_Header->SourceHash != sourceHash)
+	{
+		std::cout << "Mesh cache: " << cachePath << " is out of date." << std::endl;
+		this->Close();
+		return false;
+	}
+
+	for (uint32_t i = 0; i < m_Header->NumMeshes; i++)
+	{
+		m_File.Prefetch(m_Entries[i].VertexOffset, m_Entries[i].NumVertices * sizeof(kuVertex));
+		m_File.Prefetch(m_Entries[i].IndexOffset, m_Entries[i].NumIndices * sizeof(GLuint));
+	}
+
+	return true;
+}
+
+bool kuMeshCache::Validate()
+{
+	uint64_t size = m_File.GetSize();
+	if (size < sizeof(kuMeshCacheHeader))
+	{
+		return false;
+	}
+
+	m_Header = (const kuMeshCacheHeader *)m_File.GetData();
+	if (memcmp(m_Header->Magic, "KUMESH", 7) != 0 ||
+		size < sizeof(kuMeshCacheHeader) + (uint64_t)m_Header->NumMeshes * sizeof(kuMeshCacheEntry))
+	{
+		return false;
+	}
+
+	// Every array has to lie inside the file
+	m_Entries = (const kuMeshCacheEntry *)(m_File.GetData() + sizeof(kuMeshCacheHeader));
+	for (uint32_t i = 0; i < m_Header->NumMeshes; i++)
+	{
+		const kuMeshCacheEntry & entry = m_Entries[i];
+		if (entry.VertexOffset > size || entry.NumVertices > (size - entry.VertexOffset) / sizeof(kuVertex) ||
+			entry.IndexOffset > size || entry.NumIndices > (size - entry.IndexOffset) / sizeof(GLuint) ||
+			entry.NumLODs > kuMeshCacheMaxLODs)
+		{
+			return false;
+		}
+		for (uint32_t l = 0; l < entry.NumLODs; l++)
+		{
+			if ((uint64_t)entry.LODs[l].FirstIndex + (uint64_t)entry.LODs[l].NumIndices > entry.NumIndices)
+			{
+				return false;
+			}
+		}
+
+		// And every index inside the vertex array, the meshlet builder indexes per-vertex tables with them
+		const GLuint * indices	= (const GLuint *)(m_File.GetData() + entry.IndexOffset);
+		GLuint		   maxIndex = 0;
+		for (uint64_t n = 0; n < entry.NumIndices; n++)
+		{
+			maxIndex = indices[n] > maxIndex ? indices[n] : maxIndex;
+		}
+		if (entry.NumIndices && maxIndex >= entry.NumVertices)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void kuMeshCache::Close()
+{
+	m_File.Close();
+	m_Header  = nullptr;
+	m_Entries = nullptr;
+}
+
+bool kuMeshCache::IsOpen()
+{
+	return m_Header != nullptr;
+}
+
+uint32_t kuMeshCache::GetNumMeshes()
+{
+	return m_Header ? m_Header->NumMeshes : 0;
+}
+
+const kuVertex * kuMeshCache::GetVertices(uint32_t mesh)
+{
+	return (const kuVertex *)(m_File.GetData() + m_Entries[mesh].VertexOffset);
+}
+
+uint64_t kuMeshCache::GetNumVertices(uint32_t mesh)
+{
+	return m_Entries[mesh].NumVertices;
+}
+
+const GLuint * kuMeshCache::GetIndices(uint32_t mesh)
+{
+	return (const GLuint *)(m_File.GetData() + m_Entries[mesh].IndexOffset);
+}
+
+uint64_t kuMeshCache::GetNumIndices(uint32_t mesh)
+{
+	return m_Entries[mesh].NumIndices;
+}
+
+const kuMeshLOD * kuMeshCache::GetLODs(uint32_t mesh)
+{
+	return m_Entries[mesh].LODs;
+}
+
+uint32_t kuMeshCache::GetNumLODs(uint32_t mesh)
+{
+	return m_Entries[mesh].NumLODs;
+}
+
+bool kuMeshCache::GetMaterial(uint32_t mesh, kuMaterial & material)
+{
+	const kuMeshCacheEntry & entry = m_Entries[mesh];
+
+	material.Ambient  = glm::vec3(entry.Ambient[0], entry.Ambient[1], entry.Ambient[2]);
+	material.Diffuse  = glm::vec3(entry.Diffuse[0], entry.Diffuse[1], entry.Diffuse[2]);
+	material.Specular = glm::vec3(entry.Specular[0], entry.Specular[1], entry.Specular[2]);
+
+	return entry.HasMaterial != 0;
+}
+
+bool kuMeshCache::Write(const char * cachePath, const char * sourcePath, uint32_t importFlags, uint64_t optionsHash,
+						const vector<kuMesh> & meshes, const vector<kuMaterial> & materials)
+{
+	KU_PROFILE_ZONE("kuMeshCache::Write");
+
+	kuMeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, "KUMESH", 7);
+	header.Version	   = kuMeshCacheVersion;
+	header.VertexSize  = sizeof(kuVertex);
+	header.ImportFlags = importFlags;
+	header.OptionsHash = optionsHash;
+	header.NumMeshes   = (uint32_t)meshes.size();
+	if (!kuHashFile(sourcePath, header.SourceHash, header.SourceSize))
+	{
+		return false;
+	}
+
+	// Lay the arrays out behind the entry table
+	vector<kuMeshCacheEntry> entries(meshes.size());
+	uint64_t				 offset = sizeof(kuMeshCacheHeader) + entries.size() * sizeof(kuMeshCacheEntry);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		kuMeshCacheEntry & entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+
+		entry.NumVertices  = meshes[i].vertices.size();
+		entry.VertexOffset = offset = AlignUp(offset, kuMeshCacheAlignment);
+		offset			  += entry.NumVertices * sizeof(kuVertex);
+		entry.NumIndices   = meshes[i].indices.size();
+		entry.IndexOffset  = offset = AlignUp(offset, kuMeshCacheAlignment);
+		offset			  += entry.NumIndices * sizeof(GLuint);
+
+		entry.NumLODs = (uint32_t)(meshes[i].lods.size() < kuMeshCacheMaxLODs ? meshes[i].lods.size() : kuMeshCacheMaxLODs);
+		for (uint32_t l = 0; l < entry.NumLODs; l++)
+		{
+			entry.LODs[l] = meshes[i].lods[l];
+		}
+
+		if (i < materials.size())
+		{
+			const kuMaterial & material = materials[i];
+			for (int c = 0; c < 3; c++)
+			{
+				entry.Ambient[c]  = material.Ambient[c];
+				entry.Diffuse[c]  = material.Diffuse[c];
+				entry.Specular[c] = material.Specular[c];
+			}
+			entry.HasMaterial = 1;
+		}
+	}
+
+	std::string tempPath = std::string(cachePath) + ".tmp";
+	FILE	  * file	 = fopen(tempPath.c_str(), "wb");
+	if (!file)
+	{
+		std::cout << "Mesh cache: cannot write " << tempPath << std::endl;
+		return false;
+	}
+
+	static const uint8_t zeros[kuMeshCacheAlignment] = {};
+	uint64_t			 position = sizeof(kuMeshCacheHeader) + entries.size() * sizeof(kuMeshCacheEntry);
+	bool				 ok		  = fwrite(&header, sizeof(header), 1, file) == 1 &&
+									fwrite(entries.data(), sizeof(kuMeshCacheEntry), entries.size(), file) == entries.size();
+	for (size_t i = 0; ok && i < meshes.size(); i++)
+	{
+		const kuMeshCacheEntry & entry	 = entries[i];
+		size_t					 vertexPad = (size_t)(entry.VertexOffset - position);
+		size_t					 indexPad  = (size_t)(entry.IndexOffset - entry.VertexOffset - entry.NumVertices * sizeof(kuVertex));
+
+		ok = fwrite(zeros, 1, vertexPad, file) == vertexPad &&
+			 fwrite(meshes[i].vertices.data(), sizeof(kuVertex), (size_t)entry.NumVertices, file) == entry.NumVertices &&
+			 fwrite(zeros, 1, indexPad, file) == indexPad &&
+			 fwrite(meshes[i].indices.data(), sizeof(GLuint), (size_t)entry.NumIndices, file) == entry.NumIndices;
+		position = entry.IndexOffset + entry.NumIndices * sizeof(GLuint);
+	}
+	ok = fclose(file) == 0 && ok;
+
+	// rename() does not replace an existing file on Windows
+	remove(cachePath);
+	if (!ok || rename(tempPath.c_str(), cachePath) != 0)
+	{
+		std::cout << "Mesh cache: writing " << cachePath << " failed." << std::endl;
+		remove(tempPath.c_str());
+		return false;
+	}
+
+	std::cout << "Mesh cache: wrote " << cachePath << std::endl;
+	return true;
+}
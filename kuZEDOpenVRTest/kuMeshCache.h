@@ -0,0 +1,91 @@
+#ifndef KU_MESHCACHE_H
+#define KU_MESHCACHE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "kuMappedFile.h"
+#include "kuMesh.h"
+
+// Mesh cache file: the processed vertex and index data of every mesh of a model,
+// stored next to the source as <source>.kumesh and used instead of Assimp when it
+// still matches the source.
+//
+//   kuMeshCacheHeader
+//   kuMeshCacheEntry per mesh
+//   per mesh        kuVertex array, GLuint index array (all LODs), each 64 byte aligned
+//
+// A cache matches when the format version, vertex layout, import flags, load options
+// and the hash and size of the source file are all the same, so editing or replacing
+// the STL or changing how it is processed invalidates it automatically. Arrays are handed to OpenGL straight from the
+// mapping.
+static const uint32_t	kuMeshCacheVersion		= 3;
+static const uint32_t	kuMeshCacheMaxLODs		= 8;
+static const uint32_t	kuMeshCacheAlignment	= 64;
+static const char		kuMeshCacheExtension[]	= ".kumesh";
+
+struct kuMeshCacheHeader {
+	char				Magic[8];							// "KUMESH"
+	uint32_t			Version;
+	uint32_t			VertexSize;							// sizeof(kuVertex)
+	uint32_t			ImportFlags;						// aiPostProcessSteps the meshes were read with
+	uint32_t			NumMeshes;
+	uint64_t			SourceSize;
+	uint64_t			SourceHash;							// kuHashFile() of the source
+	uint64_t			OptionsHash;						// Whatever else changes the processed meshes, hashed by the loader
+};
+
+struct kuMeshCacheEntry {
+	uint64_t			VertexOffset;						// From the start of the file
+	uint64_t			NumVertices;
+	uint64_t			IndexOffset;
+	uint64_t			NumIndices;
+	float				Ambient[3];
+	float				Diffuse[3];
+	float				Specular[3];
+	uint32_t			HasMaterial;
+	uint32_t			NumLODs;
+	kuMeshLOD			LODs[kuMeshCacheMaxLODs];
+};
+
+// 64-bit hash of a whole file, read through a mapping. False if it cannot be opened.
+bool		kuHashFile(const char * path, uint64_t & hash, uint64_t & size);
+uint64_t	kuHashBytes(const void * data, uint64_t size);
+
+class kuMeshCache
+{
+public:
+	kuMeshCache();
+	~kuMeshCache();
+
+	// Maps cachePath, false if it is missing, broken or out of date for sourcePath
+	bool						Open(const char * cachePath, const char * sourcePath, uint32_t importFlags, uint64_t optionsHash);
+	void						Close();
+	bool						IsOpen();
+
+	uint32_t					GetNumMeshes();
+	const kuVertex			*	GetVertices(uint32_t mesh);
+	uint64_t					GetNumVertices(uint32_t mesh);
+	const GLuint			*	GetIndices(uint32_t mesh);
+	uint64_t					GetNumIndices(uint32_t mesh);
+	const kuMeshLOD			*	GetLODs(uint32_t mesh);
+	uint32_t					GetNumLODs(uint32_t mesh);
+	// False if the mesh had no material
+	bool						GetMaterial(uint32_t mesh, kuMaterial & material);
+
+	// Writes to a temporary file first and renames it, so a crash never leaves a half written cache behind
+	static bool					Write(const char * cachePath, const char * sourcePath, uint32_t importFlags, uint64_t optionsHash,
+									  const vector<kuMesh> & meshes, const vector<kuMaterial> & materials);
+
+private:
+	kuMappedFile				m_File;
+	const kuMeshCacheHeader	*	m_Header;
+	const kuMeshCacheEntry	*	m_Entries;
+
+	bool						Validate();
+};
+
+#endif // !KU_MESHCACHE_H
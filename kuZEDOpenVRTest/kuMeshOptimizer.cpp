@@ -0,0 +1,981 @@
+#include "kuMeshOptimizer.h"
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#include "kuParallel.h"
+#include "kuTrace.h"
+
+static const uint64_t	kuMinVerticesPerThread	= 16384;
+static const uint32_t	kuInvalidIndex			= 0xFFFFFFFFu;
+
+// Triangles using each vertex: those of vertex v are triangles[offsets[v] .. offsets[v + 1])
+static void BuildVertexTriangles(uint64_t numVertices, const vector<GLuint> & indices, vector<uint32_t> & offsets, vector<uint32_t> & triangles)
+{
+	offsets.assign(numVertices + 1, 0);
+	triangles.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		offsets[indices[i] + 1]++;
+	}
+	for (uint64_t v = 0; v < numVertices; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+	}
+}
+
+#pragma region // Welding //
+struct kuWeldCell {
+	int32_t		x, y, z;
+};
+
+static bool operator==(const kuWeldCell & a, const kuWeldCell & b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static uint64_t HashCell(const kuWeldCell & cell)
+{
+	uint64_t h = (uint32_t)cell.x * 0x9E3779B97F4A7C15ull;
+	h ^= (uint32_t)cell.y * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+	h ^= (uint32_t)cell.z * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+	return h ^ (h >> 31);
+}
+
+static int32_t QuantizeCoordinate(float value, float scale)
+{
+	double cell = floor((double)value * scale);
+	// One cell of headroom for the neighbour lookup
+	return cell < -2147483646.0 ? -2147483646 : (cell > 2147483646.0 ? 2147483646 : (int32_t)cell);
+}
+
+static int32_t FloatBits(float value)
+{
+	value += 0.0f;													// -0 to +0
+	int32_t bits;
+	memcpy(&bits, &value, 4);
+	return bits;
+}
+
+static float DistanceSquared(const glm::vec3 & a, const glm::vec3 & b)
+{
+	float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// Open addressing table from cell to the first representative vertex in it, one per shard.
+// Representatives of a cell are chained through next[].
+struct kuWeldShard {
+	vector<uint32_t>	Slots;
+	uint64_t			Mask;
+
+	uint32_t * Find(const kuWeldCell & cell, uint64_t hash, const vector<kuWeldCell> & cells)
+	{
+		for (uint64_t slot = hash & Mask;; slot = (slot + 1) & Mask)
+		{
+			if (Slots[slot] == kuInvalidIndex || cells[Slots[slot]] == cell)
+			{
+				return &Slots[slot];
+			}
+		}
+	}
+};
+
+void kuWeldVertices(vector<kuVertex> & vertices, vector<GLuint> & indices, float epsilon, int numThreads)
+{
+	KU_PROFILE_ZONE("kuWeldVertices");
+
+	uint64_t n = vertices.size();
+	if (n == 0)
+	{
+		return;
+	}
+
+	// Cells of epsilon size, so every vertex within epsilon is in the same or a neighbouring cell
+	bool			   exact = !(epsilon > 0.0f);
+	float			   scale = exact ? 0.0f : 1.0f / epsilon;
+	vector<kuWeldCell> cells(n);
+	vector<uint64_t>   hashes(n);
+	kuParallelFor(n, kuMinVerticesPerThread, numThreads, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++)
+		{
+			const glm::vec3 & p = vertices[i].Position;
+			kuWeldCell & cell = cells[i];
+			if (exact)
+			{
+				cell.x = FloatBits(p.x);
+				cell.y = FloatBits(p.y);
+				cell.z = FloatBits(p.z);
+			}
+			else
+			{
+				cell.x = QuantizeCoordinate(p.x, scale);
+				cell.y = QuantizeCoordinate(p.y, scale);
+				cell.z = QuantizeCoordinate(p.z, scale);
+			}
+			hashes[i] = HashCell(cell);
+		}
+	});
+
+	// Pass 1, one thread per shard of cells: group vertices within a cell. Vertices are
+	// visited in order, so a group's representative is its lowest index.
+	int					threads = (int)(n / kuMinVerticesPerThread + 1);
+	int					shards	= kuGetNumWorkerThreads(numThreads) < threads ? kuGetNumWorkerThreads(numThreads) : threads;
+	vector<kuWeldShard>	tables(shards);
+	vector<uint32_t>	remap(n), next(n, kuInvalidIndex);
+	float				epsilonSquared = exact ? 0.0f : epsilon * epsilon;
+	kuParallelFor(shards, 1, shards, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t s = begin; s < end; s++)
+		{
+			uint64_t count = 0;
+			for (uint64_t i = 0; i < n; i++)
+			{
+				count += (hashes[i] >> 40) % shards == s;
+			}
+
+			kuWeldShard & table = tables[s];
+			uint64_t	  size	= 16;
+			while (size < 2 * count)
+			{
+				size *= 2;
+			}
+			table.Slots.assign(size, kuInvalidIndex);
+			table.Mask = size - 1;
+
+			for (uint64_t i = 0; i < n; i++)
+			{
+				if ((hashes[i] >> 40) % shards != s)
+				{
+					continue;
+				}
+
+				uint32_t * head = table.Find(cells[i], hashes[i], cells);
+				uint32_t   rep	= *head;
+				while (rep != kuInvalidIndex && DistanceSquared(vertices[i].Position, vertices[rep].Position) > epsilonSquared)
+				{
+					rep = next[rep];
+				}
+				if (rep != kuInvalidIndex)
+				{
+					remap[i] = rep;
+				}
+				else
+				{
+					remap[i] = (uint32_t)i;
+					next[i]	 = *head;
+					*head	 = (uint32_t)i;
+				}
+			}
+		}
+	});
+
+	// Pass 2: representatives close to one in a neighbouring cell join the lowest indexed one
+	vector<uint32_t> parent(n);
+	kuParallelFor(n, kuMinVerticesPerThread, numThreads, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++)
+		{
+			parent[i] = (uint32_t)i;
+			if (exact || remap[i] != i)
+			{
+				continue;
+			}
+
+			for (int d = 0; d < 27; d++)
+			{
+				kuWeldCell neighbour = { cells[i].x + d % 3 - 1, cells[i].y + d / 3 % 3 - 1, cells[i].z + d / 9 - 1 };
+				if (d == 13)
+				{
+					continue;												// Own cell, done in pass 1
+				}
+
+				uint64_t	  hash	= HashCell(neighbour);
+				kuWeldShard & table = tables[(hash >> 40) % shards];
+				for (uint32_t rep = *table.Find(neighbour, hash, cells); rep != kuInvalidIndex; rep = next[rep])
+				{
+					if (rep < parent[i] && DistanceSquared(vertices[i].Position, vertices[rep].Position) <= epsilonSquared)
+					{
+						parent[i] = rep;
+					}
+				}
+			}
+		}
+	});
+
+	// Resolve chains in index order (every link points to a lower index) and number the survivors
+	vector<uint32_t> newIndex(n);
+	uint32_t		 numWelded = 0;
+	for (uint64_t i = 0; i < n; i++)
+	{
+		if (remap[i] == i)
+		{
+			remap[i] = parent[i] == i ? (uint32_t)i : remap[parent[i]];
+		}
+		else
+		{
+			remap[i] = remap[remap[i]];
+		}
+		if (remap[i] == i)
+		{
+			newIndex[i] = numWelded++;
+		}
+	}
+
+	vector<kuVertex> welded(numWelded);
+	kuParallelFor(n, kuMinVerticesPerThread, numThreads, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++)
+		{
+			if (remap[i] == i)
+			{
+				welded[newIndex[i]] = vertices[i];
+			}
+		}
+	});
+	vertices.swap(welded);
+
+	// Triangles whose corners merged have no area left
+	size_t numIndices = 0;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		GLuint a = newIndex[remap[indices[t]]];
+		GLuint b = newIndex[remap[indices[t + 1]]];
+		GLuint c = newIndex[remap[indices[t + 2]]];
+		if (a != b && b != c && a != c)
+		{
+			indices[numIndices++] = a;
+			indices[numIndices++] = b;
+			indices[numIndices++] = c;
+		}
+	}
+	indices.resize(numIndices);
+}
+#pragma endregion
+
+#pragma region // Normals //
+void kuComputeSmoothNormals(vector<kuVertex> & vertices, const vector<GLuint> & indices, int numThreads)
+{
+	KU_PROFILE_ZONE("kuComputeSmoothNormals");
+
+	uint64_t numVertices  = vertices.size();
+	uint64_t numTriangles = indices.size() / 3;
+
+	// Unnormalized cross products, their length is twice the triangle area
+	vector<glm::vec3> faceNormals(numTriangles);
+	kuParallelFor(numTriangles, kuMinVerticesPerThread, numThreads, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t t = begin; t < end; t++)
+		{
+			const glm::vec3 & v0 = vertices[indices[t * 3]].Position;
+			const glm::vec3 & v1 = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 & v2 = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3		  e0 = v1 - v0;
+			glm::vec3		  e1 = v2 - v0;
+			faceNormals[t] = glm::vec3(e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x);
+		}
+	});
+
+	// Triangles around each vertex, so the sums can be gathered without write conflicts
+	vector<uint32_t> offsets, triangles;
+	BuildVertexTriangles(numVertices, indices, offsets, triangles);
+
+	kuParallelFor(numVertices, kuMinVerticesPerThread, numThreads, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t v = begin; v < end; v++)
+		{
+			double sum[3] = { 0.0, 0.0, 0.0 };
+			for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++)
+			{
+				const glm::vec3 & n = faceNormals[triangles[k]];
+				sum[0] += n.x;
+				sum[1] += n.y;
+				sum[2] += n.z;
+			}
+
+			double length = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+			if (length > 0.0)
+			{
+				vertices[v].Normal = glm::vec3((float)(sum[0] / length), (float)(sum[1] / length), (float)(sum[2] / length));
+			}
+		}
+	});
+}
+#pragma endregion
+
+#pragma region // Vertex cache //
+kuVertexCacheStats kuAnalyzeVertexCache(const vector<GLuint> & indices, size_t numVertices, int cacheSize)
+{
+	// FIFO cache, a vertex is in it while fewer than cacheSize misses happened since it was loaded
+	vector<uint64_t> loadedAt(numVertices, 0);
+	uint64_t		 misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		GLuint v = indices[i];
+		if (loadedAt[v] == 0 || misses - loadedAt[v] >= (uint64_t)cacheSize)
+		{
+			loadedAt[v] = ++misses;
+		}
+	}
+
+	kuVertexCacheStats stats;
+	stats.ACMR = indices.size() ? (float)misses / (indices.size() / 3) : 0.0f;
+	stats.ATVR = numVertices ? (float)misses / numVertices : 0.0f;
+	return stats;
+}
+
+// Tipsify (Sander, Nehab and Barczak 2007). Fans around the vertex whose triangles fit
+// in the cache best, falls back to recently used vertices and finally to a scan when
+// it runs into a dead end. clusterStarts gets the first triangle after every such
+// jump, the places where the cache starts cold.
+static void Tipsify(const vector<GLuint> & indices, size_t numVertices, int cacheSize, vector<GLuint> & result,
+					vector<uint32_t> & clusterStarts)
+{
+	uint64_t		 numTriangles = indices.size() / 3;
+	vector<uint32_t> offsets, triangles;
+	BuildVertexTriangles(numVertices, indices, offsets, triangles);
+
+	vector<uint32_t> liveTriangles(numVertices);
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		liveTriangles[v] = offsets[v + 1] - offsets[v];
+	}
+
+	vector<uint64_t> cacheTime(numVertices, 0);
+	vector<char>	 emitted(numTriangles, 0);
+	vector<uint32_t> deadEnd;
+	vector<uint32_t> candidates;
+	uint64_t		 time	= cacheSize + 1;
+	size_t			 cursor = 0;
+
+	result.clear();
+	result.reserve(indices.size());
+	clusterStarts.clear();
+
+	int64_t fan = numVertices ? 0 : -1;
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++)
+		{
+			uint32_t t = triangles[k];
+			if (emitted[t])
+			{
+				continue;
+			}
+			emitted[t] = 1;
+
+			for (int c = 0; c < 3; c++)
+			{
+				GLuint v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > (uint64_t)cacheSize)
+				{
+					cacheTime[v] = time++;
+				}
+			}
+		}
+
+		// Next fan: the candidate whose remaining triangles still hit the cache, oldest first
+		int64_t best		 = -1;
+		int64_t bestPriority = -1;
+		for (size_t c = 0; c < candidates.size(); c++)
+		{
+			uint32_t v = candidates[c];
+			if (liveTriangles[v] == 0)
+			{
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= (uint64_t)cacheSize)
+			{
+				priority = (int64_t)(time - cacheTime[v]);
+			}
+			if (priority > bestPriority)
+			{
+				best		 = v;
+				bestPriority = priority;
+			}
+		}
+
+		if (best < 0)
+		{
+			// Dead end: most recent vertex with triangles left, else the next one in input order
+			while (!deadEnd.empty() && best < 0)
+			{
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveTriangles[v] > 0)
+				{
+					best = v;
+				}
+			}
+			while (best < 0 && cursor < numVertices)
+			{
+				if (liveTriangles[cursor] > 0)
+				{
+					best = cursor;
+				}
+				cursor++;
+			}
+			if (best >= 0)
+			{
+				clusterStarts.push_back((uint32_t)(result.size() / 3));
+			}
+		}
+		fan = best;
+	}
+}
+
+void kuOptimizeVertexCache(vector<GLuint> & indices, size_t numVertices, int cacheSize)
+{
+	KU_PROFILE_ZONE("kuOptimizeVertexCache");
+
+	vector<GLuint>	 result;
+	vector<uint32_t> clusterStarts;
+	Tipsify(indices, numVertices, cacheSize, result, clusterStarts);
+	indices.swap(result);
+}
+
+void kuOptimizeVertexCacheAndOverdraw(vector<GLuint> & indices, const vector<kuVertex> & vertices, float threshold, int cacheSize)
+{
+	KU_PROFILE_ZONE("kuOptimizeVertexCacheAndOverdraw");
+
+	vector<GLuint>	 ordered;
+	vector<uint32_t> hardStarts;
+	Tipsify(indices, vertices.size(), cacheSize, ordered, hardStarts);
+
+	uint32_t numTriangles = (uint32_t)(ordered.size() / 3);
+	if (numTriangles == 0)
+	{
+		indices.swap(ordered);
+		return;
+	}
+
+	// Split the cold-cache clusters further wherever the cache hit rate so far is within
+	// threshold of the whole cluster's, smaller clusters sort better
+	hardStarts.insert(hardStarts.begin(), 0);
+	hardStarts.push_back(numTriangles);
+
+	// Cache simulation that can be restarted cold in O(1): only loads after base count
+	vector<uint64_t> loadedAt(vertices.size(), 0);
+	uint64_t		 misses = 0, base = 0;
+	auto			 load	= [&](GLuint v) {
+		  if (loadedAt[v] <= base || misses - loadedAt[v] >= (uint64_t)cacheSize)
+		  {
+			  loadedAt[v] = ++misses;
+		  }
+	};
+
+	vector<uint32_t> clusterStarts;
+	for (size_t h = 0; h + 1 < hardStarts.size(); h++)
+	{
+		uint32_t begin = hardStarts[h], end = hardStarts[h + 1];
+		if (begin == end)
+		{
+			continue;
+		}
+
+		base = misses;
+		for (uint32_t i = begin * 3; i < end * 3; i++)
+		{
+			load(ordered[i]);
+		}
+		float clusterACMR = (float)(misses - base) / (end - begin);
+
+		uint32_t start = begin;
+		base = misses;
+		clusterStarts.push_back(begin);
+		for (uint32_t t = begin; t < end; t++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				load(ordered[t * 3 + c]);
+			}
+
+			uint32_t count = t + 1 - start;
+			if (t + 1 < end && count >= 8 && (float)(misses - base) / count <= threshold * clusterACMR)
+			{
+				clusterStarts.push_back(t + 1);
+				start = t + 1;
+				base  = misses;
+			}
+		}
+	}
+	clusterStarts.push_back(numTriangles);
+
+	// View independent order (Sander et al.): clusters further out along their own normal
+	// can hide more of the mesh, so they are drawn first
+	glm::vec3 meshCenter(0.0f, 0.0f, 0.0f);
+	double	  meshArea = 0.0;
+	size_t	  numClusters = clusterStarts.size() - 1;
+	vector<glm::vec3> centers(numClusters), normals(numClusters);
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		double center[3] = { 0.0, 0.0, 0.0 }, normal[3] = { 0.0, 0.0, 0.0 }, area = 0.0;
+		for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const glm::vec3 & v0 = vertices[ordered[t * 3]].Position;
+			const glm::vec3 & v1 = vertices[ordered[t * 3 + 1]].Position;
+			const glm::vec3 & v2 = vertices[ordered[t * 3 + 2]].Position;
+			glm::vec3		  e0 = v1 - v0;
+			glm::vec3		  e1 = v2 - v0;
+			double			  n[3] = { e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x };
+			double			  a	   = 0.5 * sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			center[0] += a * (v0.x + v1.x + v2.x) / 3.0;
+			center[1] += a * (v0.y + v1.y + v2.y) / 3.0;
+			center[2] += a * (v0.z + v1.z + v2.z) / 3.0;
+			for (int k = 0; k < 3; k++)
+			{
+				normal[k] += n[k];
+			}
+			area += a;
+		}
+
+		double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		double scale  = length > 0.0 ? 1.0 / length : 0.0;
+		normals[c] = glm::vec3((float)(normal[0] * scale), (float)(normal[1] * scale), (float)(normal[2] * scale));
+		centers[c] = area > 0.0 ? glm::vec3((float)(center[0] / area), (float)(center[1] / area), (float)(center[2] / area))
+								: vertices[ordered[clusterStarts[c] * 3]].Position;
+
+		meshCenter = meshCenter + glm::vec3((float)center[0], (float)center[1], (float)center[2]);
+		meshArea  += area;
+	}
+	if (meshArea > 0.0)
+	{
+		meshCenter = meshCenter * (float)(1.0 / meshArea);
+	}
+
+	vector<float>	 sortKey(numClusters);
+	vector<uint32_t> order(numClusters);
+	for (size_t c = 0; c < numClusters; c++)
+	{
+		glm::vec3 d = centers[c] - meshCenter;
+		sortKey[c]	= d.x * normals[c].x + d.y * normals[c].y + d.z * normals[c].z;
+		order[c]	= (uint32_t)c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sortKey](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+	indices.clear();
+	for (size_t i = 0; i < numClusters; i++)
+	{
+		uint32_t c = order[i];
+		indices.insert(indices.end(), ordered.begin() + clusterStarts[c] * 3, ordered.begin() + clusterStarts[c + 1] * 3);
+	}
+}
+
+void kuOptimizeVertexFetch(vector<kuVertex> & vertices, vector<GLuint> & indices)
+{
+	KU_PROFILE_ZONE("kuOptimizeVertexFetch");
+
+	// Vertices in order of first use, unused ones are dropped
+	vector<GLuint>	 remap(vertices.size(), kuInvalidIndex);
+	vector<kuVertex> ordered;
+	ordered.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		GLuint & v = remap[indices[i]];
+		if (v == kuInvalidIndex)
+		{
+			v = (GLuint)ordered.size();
+			ordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = v;
+	}
+	vertices.swap(ordered);
+}
+#pragma endregion
+
+#pragma region // Simplification //
+// Symmetric 4x4 quadric of area-weighted squared plane distances
+struct kuQuadric {
+	double		a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	double		Weight;
+
+	void Clear()
+	{
+		a00 = a01 = a02 = a03 = a11 = a12 = a13 = a22 = a23 = a33 = Weight = 0.0;
+	}
+
+	// Plane n.x + d = 0 with unit normal
+	void AddPlane(double nx, double ny, double nz, double d, double weight)
+	{
+		a00 += weight * nx * nx;	a01 += weight * nx * ny;	a02 += weight * nx * nz;	a03 += weight * nx * d;
+		a11 += weight * ny * ny;	a12 += weight * ny * nz;	a13 += weight * ny * d;
+		a22 += weight * nz * nz;	a23 += weight * nz * d;
+		a33 += weight * d * d;
+		Weight += weight;
+	}
+
+	void Add(const kuQuadric & q)
+	{
+		a00 += q.a00;	a01 += q.a01;	a02 += q.a02;	a03 += q.a03;
+		a11 += q.a11;	a12 += q.a12;	a13 += q.a13;
+		a22 += q.a22;	a23 += q.a23;
+		a33 += q.a33;
+		Weight += q.Weight;
+	}
+
+	double Evaluate(const glm::vec3 & p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+			   a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+			   a22 * z * z + 2.0 * a23 * z +
+			   a33;
+	}
+};
+
+struct kuCollapse {
+	uint32_t	From;
+	uint32_t	To;
+	double		Error;													// Squared distance
+};
+
+static glm::vec3 TriangleNormal(const glm::vec3 & v0, const glm::vec3 & v1, const glm::vec3 & v2)
+{
+	glm::vec3 e0 = v1 - v0;
+	glm::vec3 e1 = v2 - v0;
+	return glm::vec3(e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x);
+}
+
+static double Dot(const glm::vec3 & a, const glm::vec3 & b)
+{
+	return (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+}
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+	return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+// Moving from onto to must not turn any of from's other triangles over
+static bool CollapseFlips(const vector<kuVertex> & vertices, const vector<GLuint> & indices, const vector<uint32_t> & offsets,
+						  const vector<uint32_t> & triangles, uint32_t from, uint32_t to)
+{
+	const glm::vec3 & target = vertices[to].Position;
+	for (uint32_t k = offsets[from]; k < offsets[from + 1]; k++)
+	{
+		const GLuint * tri = &indices[triangles[k] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+		{
+			continue;													// Collapses away
+		}
+
+		glm::vec3 p[3];
+		glm::vec3 q[3];
+		for (int c = 0; c < 3; c++)
+		{
+			p[c] = vertices[tri[c]].Position;
+			q[c] = tri[c] == from ? target : p[c];
+		}
+		glm::vec3 before = TriangleNormal(p[0], p[1], p[2]);
+		glm::vec3 after	 = TriangleNormal(q[0], q[1], q[2]);
+		if (Dot(before, after) <= 0.25 * sqrt(Dot(before, before) * Dot(after, after)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+float kuSimplifyMesh(const vector<kuVertex> & vertices, const vector<GLuint> & indices, size_t targetIndexCount, float maxError,
+					 vector<GLuint> & result)
+{
+	KU_PROFILE_ZONE("kuSimplifyMesh");
+
+	uint32_t numVertices = (uint32_t)vertices.size();
+	result				 = indices;
+
+	// Edges used by a single triangle are open borders
+	vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			edges.push_back(EdgeKey(indices[t + c], indices[t + (c + 1) % 3]));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	vector<char> isBorder(numVertices, 0);
+	vector<uint64_t> borderEdges;
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+		{
+			j++;
+		}
+		if (j - i == 1)
+		{
+			borderEdges.push_back(edges[i]);
+			isBorder[edges[i] >> 32]		 = 1;
+			isBorder[edges[i] & 0xFFFFFFFFu] = 1;
+		}
+		i = j;
+	}
+
+	// Face planes, plus planes through border edges perpendicular to the face to keep borders in place
+	vector<kuQuadric> quadrics(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+	{
+		quadrics[v].Clear();
+	}
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		const glm::vec3 & v0	 = vertices[indices[t]].Position;
+		const glm::vec3 & v1	 = vertices[indices[t + 1]].Position;
+		const glm::vec3 & v2	 = vertices[indices[t + 2]].Position;
+		glm::vec3		  normal = TriangleNormal(v0, v1, v2);
+		double			  length = sqrt(Dot(normal, normal));
+		if (length <= 0.0)
+		{
+			continue;
+		}
+
+		double nx = normal.x / length, ny = normal.y / length, nz = normal.z / length;
+		double d  = -(nx * v0.x + ny * v0.y + nz * v0.z);
+		for (int c = 0; c < 3; c++)
+		{
+			quadrics[indices[t + c]].AddPlane(nx, ny, nz, d, 0.5 * length);
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			uint32_t a = indices[t + c], b = indices[t + (c + 1) % 3];
+			if (!isBorder[a] || !isBorder[b] || !std::binary_search(borderEdges.begin(), borderEdges.end(), EdgeKey(a, b)))
+			{
+				continue;
+			}
+
+			glm::vec3 edge	 = vertices[b].Position - vertices[a].Position;
+			double	  ex	 = edge.y * nz - edge.z * ny;
+			double	  ey	 = edge.z * nx - edge.x * nz;
+			double	  ez	 = edge.x * ny - edge.y * nx;
+			double	  el	 = sqrt(ex * ex + ey * ey + ez * ez);
+			if (el <= 0.0)
+			{
+				continue;
+			}
+			ex /= el;	ey /= el;	ez /= el;
+			double	  ed	 = -(ex * vertices[a].Position.x + ey * vertices[a].Position.y + ez * vertices[a].Position.z);
+			double	  weight = 10.0 * Dot(edge, edge);
+			quadrics[a].AddPlane(ex, ey, ez, ed, weight);
+			quadrics[b].AddPlane(ex, ey, ez, ed, weight);
+		}
+	}
+
+	// Passes of independent collapses, cheapest first, until the target or the error limit is hit
+	double			   maxErrorSquared = (double)maxError * maxError;
+	double			   reachedError	   = 0.0;
+	vector<kuCollapse> collapses;
+	vector<uint32_t>   offsets, triangles, remap(numVertices);
+	vector<char>	   locked(numVertices);
+	while (result.size() > targetIndexCount)
+	{
+		BuildVertexTriangles(numVertices, result, offsets, triangles);
+
+		edges.clear();
+		for (size_t t = 0; t + 2 < result.size(); t += 3)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				edges.push_back(EdgeKey(result[t + c], result[t + (c + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		collapses.clear();
+		for (size_t e = 0; e < edges.size(); e++)
+		{
+			uint32_t a = (uint32_t)(edges[e] >> 32), b = (uint32_t)(edges[e] & 0xFFFFFFFFu);
+
+			// Border vertices may only slide along border edges
+			bool	 borderEdge = isBorder[a] && isBorder[b] && std::binary_search(borderEdges.begin(), borderEdges.end(), edges[e]);
+			bool	 canAB		= !isBorder[a] || borderEdge;
+			bool	 canBA		= !isBorder[b] || borderEdge;
+			if (!canAB && !canBA)
+			{
+				continue;
+			}
+
+			kuQuadric q = quadrics[a];
+			q.Add(quadrics[b]);
+			double scale = q.Weight > 0.0 ? 1.0 / q.Weight : 0.0;
+			double errAB = canAB ? fabs(q.Evaluate(vertices[b].Position)) * scale : HUGE_VAL;
+			double errBA = canBA ? fabs(q.Evaluate(vertices[a].Position)) * scale : HUGE_VAL;
+
+			kuCollapse collapse;
+			collapse.From  = errAB <= errBA ? a : b;
+			collapse.To	   = errAB <= errBA ? b : a;
+			collapse.Error = errAB <= errBA ? errAB : errBA;
+			collapses.push_back(collapse);
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const kuCollapse & x, const kuCollapse & y) { return x.Error < y.Error; });
+
+		// Every collapse removes about two triangles; leave the rest for the next pass
+		size_t trianglesToRemove = (result.size() - targetIndexCount) / 3 + 1;
+		size_t removed			 = 0;
+		size_t numCollapsed		 = 0;
+		for (uint32_t v = 0; v < numVertices; v++)
+		{
+			remap[v]  = v;
+			locked[v] = 0;
+		}
+		for (size_t i = 0; i < collapses.size() && removed < trianglesToRemove; i++)
+		{
+			const kuCollapse & collapse = collapses[i];
+			if (collapse.Error > maxErrorSquared)
+			{
+				break;
+			}
+			if (locked[collapse.From] || locked[collapse.To] ||
+				CollapseFlips(vertices, result, offsets, triangles, collapse.From, collapse.To))
+			{
+				continue;
+			}
+
+			// The ring around the removed vertex changes, nothing else in it may move in this pass
+			for (uint32_t k = offsets[collapse.From]; k < offsets[collapse.From + 1]; k++)
+			{
+				const GLuint * tri = &result[triangles[k] * 3];
+				locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = 1;
+			}
+
+			remap[collapse.From] = collapse.To;
+			quadrics[collapse.To].Add(quadrics[collapse.From]);
+			removed		+= isBorder[collapse.From] ? 1 : 2;
+			reachedError = collapse.Error > reachedError ? collapse.Error : reachedError;
+			numCollapsed++;
+		}
+		if (numCollapsed == 0)
+		{
+			break;
+		}
+
+		size_t numIndices = 0;
+		for (size_t t = 0; t + 2 < result.size(); t += 3)
+		{
+			GLuint a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+			if (a != b && b != c && a != c)
+			{
+				result[numIndices++] = a;
+				result[numIndices++] = b;
+				result[numIndices++] = c;
+			}
+		}
+		result.resize(numIndices);
+	}
+
+	return (float)sqrt(reachedError);
+}
+#pragma endregion
+
+#pragma region // Meshlets //
+static void ComputeMeshletBounds(const kuVertex * vertices, const GLuint * indices, kuMeshlet & meshlet)
+{
+	const GLuint * first = indices + meshlet.FirstIndex;
+
+	// Sphere around the box of the vertices
+	glm::vec3 lo = vertices[first[0]].Position, hi = lo;
+	for (GLsizei i = 1; i < meshlet.NumIndices; i++)
+	{
+		lo = glm::min(lo, vertices[first[i]].Position);
+		hi = glm::max(hi, vertices[first[i]].Position);
+	}
+	meshlet.Center = (lo + hi) * 0.5f;
+	meshlet.Radius = 0.0f;
+	for (GLsizei i = 0; i < meshlet.NumIndices; i++)
+	{
+		meshlet.Radius = std::max(meshlet.Radius, glm::length(vertices[first[i]].Position - meshlet.Center));
+	}
+
+	// Cone around the unit triangle normals. With the axis a and the smallest dot(n, a) = c,
+	// every triangle faces away from a viewer at v when dot(Center - v, a) >= sqrt(1 - c^2) * |Center - v| + Radius.
+	vector<glm::vec3>	normals;
+	glm::vec3			axis(0.0f, 0.0f, 0.0f);
+	for (GLsizei i = 0; i < meshlet.NumIndices; i += 3)
+	{
+		glm::vec3 n		 = TriangleNormal(vertices[first[i]].Position, vertices[first[i + 1]].Position, vertices[first[i + 2]].Position);
+		float	  length = glm::length(n);
+		if (length > 0.0f)
+		{
+			normals.push_back(n / length);
+			axis += n / length;
+		}
+	}
+
+	float axisLength = glm::length(axis);
+	meshlet.ConeAxis   = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.ConeCutoff = 1.0f;
+	if (axisLength > 0.0f)
+	{
+		float minDot = 1.0f;
+		for (size_t i = 0; i < normals.size(); i++)
+		{
+			minDot = std::min(minDot, (float)Dot(normals[i], meshlet.ConeAxis));
+		}
+		// Wider than about 84 degrees off the axis culls too rarely to bother
+		if (minDot > 0.1f)
+		{
+			meshlet.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+	}
+}
+
+void kuBuildMeshlets(const kuVertex * vertices, size_t numVertices, const GLuint * indices, GLuint firstIndex, size_t numIndices,
+					 vector<kuMeshlet> & meshlets, int maxVertices, int maxTriangles)
+{
+	KU_PROFILE_ZONE("kuBuildMeshlets");
+
+	// Meshlet that last counted each vertex
+	vector<uint32_t>	owner(numVertices, kuInvalidIndex);
+	uint32_t			current	 = (uint32_t)meshlets.size();
+	int					used	 = 0;
+
+	kuMeshlet meshlet = {};
+	meshlet.FirstIndex = firstIndex;
+
+	for (size_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		const GLuint * tri	  = indices + firstIndex + i;
+		int			   newOne = (owner[tri[0]] != current) + (owner[tri[1]] != current && tri[1] != tri[0]) +
+								(owner[tri[2]] != current && tri[2] != tri[0] && tri[2] != tri[1]);
+
+		if (meshlet.NumIndices > 0 && (used + newOne > maxVertices || meshlet.NumIndices / 3 >= maxTriangles))
+		{
+			ComputeMeshletBounds(vertices, indices, meshlet);
+			meshlets.push_back(meshlet);
+
+			current++;
+			used			   = 0;
+			meshlet.FirstIndex = firstIndex + (GLuint)i;
+			meshlet.NumIndices = 0;
+		}
+
+		for (int c = 0; c < 3; c++)
+		{
+			if (owner[tri[c]] != current)
+			{
+				owner[tri[c]] = current;
+				used++;
+			}
+		}
+		meshlet.NumIndices += 3;
+	}
+
+	if (meshlet.NumIndices > 0)
+	{
+		ComputeMeshletBounds(vertices, indices, meshlet);
+		meshlets.push_back(meshlet);
+	}
+}
+#pragma endregion
@@ -0,0 +1,57 @@
+#ifndef KU_MESHOPTIMIZER_H
+#define KU_MESHOPTIMIZER_H
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "kuMesh.h"
+
+// Load-time passes over indexed triangle lists (kuVertex + GLuint indices, 3 per
+// triangle). All of them split the work over numThreads threads (0 = one per core).
+
+// Merges vertices whose positions are within epsilon (model units) of each other and
+// drops triangles that become degenerate. epsilon 0 merges bit-identical positions only.
+// Only positions are compared; the first vertex of every group is kept as is.
+void		kuWeldVertices(vector<kuVertex> & vertices, vector<GLuint> & indices, float epsilon, int numThreads = 0);
+
+// Replaces every vertex normal by the area-weighted average of the normals of the
+// triangles using it. Vertices without a usable triangle keep their normal.
+void		kuComputeSmoothNormals(vector<kuVertex> & vertices, const vector<GLuint> & indices, int numThreads = 0);
+
+struct kuVertexCacheStats {
+	float		ACMR;												// Vertex shader runs per triangle, 0.5 at best
+	float		ATVR;												// Vertex shader runs per vertex, 1 at best
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries over the index buffer
+kuVertexCacheStats	kuAnalyzeVertexCache(const vector<GLuint> & indices, size_t numVertices, int cacheSize = 16);
+
+// Reorders triangles for the post-transform cache (Tipsify)
+void		kuOptimizeVertexCache(vector<GLuint> & indices, size_t numVertices, int cacheSize = 16);
+// Tipsify, then cuts the result into clusters and sorts them so that triangles likely
+// to occlude others come first, from any view direction. threshold is the ACMR the
+// clusters may lose against the pure cache order (1.05 = 5 % worse).
+void		kuOptimizeVertexCacheAndOverdraw(vector<GLuint> & indices, const vector<kuVertex> & vertices, float threshold = 1.05f,
+											 int cacheSize = 16);
+// Renumbers vertices in the order the indices first use them and drops unused ones.
+// Run last, after the triangle order is final.
+void		kuOptimizeVertexFetch(vector<kuVertex> & vertices, vector<GLuint> & indices);
+
+// Quadric error metric edge collapse (Garland and Heckbert 1997) onto existing vertices,
+// so the result indexes the same vertex buffer. Collapses the cheapest edges first
+// until the index count is at most targetIndexCount or the next collapse would move the
+// surface further than maxError (model units). Open borders only collapse along
+// themselves. Returns the error reached, in model units.
+float		kuSimplifyMesh(const vector<kuVertex> & vertices, const vector<GLuint> & indices, size_t targetIndexCount, float maxError,
+						   vector<GLuint> & result);
+
+// Cuts numIndices indices starting at firstIndex into runs of consecutive triangles using
+// at most maxVertices distinct vertices and maxTriangles triangles, and appends their
+// bounds. Keeps the triangle order, so the meshlets draw as ranges of the index buffer.
+// Takes plain arrays so it also runs on kuMeshCache mappings.
+void		kuBuildMeshlets(const kuVertex * vertices, size_t numVertices, const GLuint * indices, GLuint firstIndex, size_t numIndices,
+							vector<kuMeshlet> & meshlets, int maxVertices = 64, int maxTriangles = 124);
+
+#endif // !KU_MESHOPTIMIZER_H
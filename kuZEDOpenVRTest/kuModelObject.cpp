@@ -1,13 +1,35 @@
 #include "kuModelObject.h"
 
+#include <string.h>
+#include <algorithm>
 
+#include "kuMeshCache.h"
+#include "kuMeshOptimizer.h"
+#include "kuSTLLoader.h"
+#include "kuTrace.h"
 
-kuModelObject::kuModelObject(char * filename)
+static const uint32_t kuModelImportFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals;
+
+
+
+// Cache key part for everything in kuModelLoadOptions
+static uint64_t HashLoadOptions(const kuModelLoadOptions & options)
+{
+	float values[6] = { options.WeldEpsilon, options.SmoothNormals ? 1.0f : 0.0f, options.OptimizeIndices ? 1.0f : 0.0f,
+						options.OverdrawThreshold, (float)options.NumLODs, options.LODMaxError };
+	return kuHashBytes(values, sizeof(values));
+}
+
+kuModelObject::kuModelObject(char * filename, const kuModelLoadOptions & options)
+	: m_LoadOptions(options), m_NumDraws(0), m_NumTrianglesDrawn(0), m_NumDrawCommands(0)
 {
 	this->LoadModel(filename);
+
+	m_MeshLOD.assign(m_ObjectMeshes.size(), 0);
 }
 
 kuModelObject::kuModelObject()
+	: m_NumDraws(0), m_NumTrianglesDrawn(0), m_NumDrawCommands(0)
 {
 }
 
@@ -16,57 +38,230 @@ kuModelObject::~kuModelObject()
 {
 }
 
-void kuModelObject::Draw(kuShaderHandler shader)
+void kuModelObject::Draw(kuShaderHandler & shader, int numViews)
+{
+	this->Draw(shader, m_ObjectMaterials[0], numViews);
+}
+
+void kuModelObject::Draw(kuShaderHandler & shader, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, int numViews)
+{
+	m_Uniforms.Resolve(shader);
+	shader.Set(m_Uniforms.MaterialAmbient, ambient);
+	shader.Set(m_Uniforms.MaterialDiffuse, diffuse);
+	shader.Set(m_Uniforms.MaterialSpecular, specular);
+
+	this->DrawMeshes(shader, numViews);
+}
+
+void kuModelObject::Draw(kuShaderHandler & shader, kuMaterial material, int numViews)
+{
+	this->Draw(shader, material.Ambient, material.Diffuse, material.Specular, numViews);
+}
+
+// All meshes in one go: their visible ranges become indirect commands into the arena
+void kuModelObject::DrawMeshes(kuShaderHandler & shader, int numViews)
 {
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.ambient"),
-				m_ObjectMaterials[0].Ambient.r, m_ObjectMaterials[0].Ambient.g, m_ObjectMaterials[0].Ambient.b);
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.diffuse"),
-				m_ObjectMaterials[0].Diffuse.r, m_ObjectMaterials[0].Diffuse.g, m_ObjectMaterials[0].Diffuse.b);
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.specular"),
-				m_ObjectMaterials[0].Specular.r, m_ObjectMaterials[0].Specular.g, m_ObjectMaterials[0].Specular.b);
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		m_DrawCommands[i].clear();
+	}
 
 	for (int i = 0; i < m_ObjectMeshes.size(); i++)
 	{
-		this->m_ObjectMeshes[i].Draw(shader);
+		int lod = i < m_MeshLOD.size() ? m_MeshLOD[i] : 0;
+		this->m_ObjectMeshes[i].AppendDrawCommands(lod, m_DrawCommands, numViews);
+
+		if (lod >= m_LODDrawCount.size())
+		{
+			m_LODDrawCount.resize(lod + 1, 0);
+		}
+		m_LODDrawCount[lod]++;
+		m_NumTrianglesDrawn += this->m_ObjectMeshes[i].GetDrawIndexCount(lod) / 3 * numViews;
 	}
+
+	m_Arena.Draw(shader, m_DrawCommands);
+
+	for (int i = 0; i < kuVertexLayout_Count; i++)
+	{
+		m_NumDrawCommands += m_DrawCommands[i].size();
+	}
+	m_NumDraws++;
 }
 
-void kuModelObject::Draw(kuShaderHandler shader, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular)
+void kuModelObject::SelectLOD(const glm::mat4 & modelMat, const glm::vec3 & cameraPos, float pixelScale,
+							  float maxPixelError, float hysteresis)
 {
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.ambient"), ambient.r, ambient.g, ambient.b);
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.diffuse"), diffuse.r, diffuse.g, diffuse.b);
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.specular"), specular.r, specular.g, specular.b);
+	// Errors and radii are in model units, the largest axis scale bounds them in world units
+	float scale = 0.0f;
+	for (int i = 0; i < 3; i++)
+	{
+		glm::vec3 axis(modelMat[i].x, modelMat[i].y, modelMat[i].z);
+		scale = std::max(scale, glm::length(axis));
+	}
 
+	m_MeshLOD.resize(m_ObjectMeshes.size(), 0);
 	for (int i = 0; i < m_ObjectMeshes.size(); i++)
 	{
-		this->m_ObjectMeshes[i].Draw(shader);
+		kuMesh	&	mesh	= m_ObjectMeshes[i];
+		int			numLODs = mesh.GetNumLODs();
+
+		glm::vec4 center   = modelMat * glm::vec4(mesh.GetBoundsCenter(), 1.0f);
+		float	  distance = glm::length(glm::vec3(center.x, center.y, center.z) - cameraPos) - mesh.GetBoundsRadius() * scale;
+		distance = std::max(distance, 1e-3f);
+
+		// Coarsest LOD within the error budget, and within the tighter budget for coarsening
+		int finer = 0, coarser = 0;
+		for (int lod = 1; lod < numLODs; lod++)
+		{
+			float errorPixels = mesh.lods[lod].Error * scale / distance * pixelScale;
+			if (errorPixels <= maxPixelError)
+			{
+				finer = lod;
+			}
+			if (errorPixels <= maxPixelError * (1.0f - hysteresis))
+			{
+				coarser = lod;
+			}
+		}
+
+		int & current = m_MeshLOD[i];
+		if (current >= numLODs || finer < current)
+		{
+			current = finer;
+		}
+		else if (coarser > current)
+		{
+			current = coarser;
+		}
 	}
 }
 
-void kuModelObject::Draw(kuShaderHandler shader, kuMaterial material)
+void kuModelObject::Cull(const glm::mat4 & modelMat, const glm::mat4 * viewProjMats, int numViews)
 {
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.ambient"),
-				material.Ambient.r, material.Ambient.g, material.Ambient.b);
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.diffuse"),
-				material.Diffuse.r, material.Diffuse.g, material.Diffuse.b);
-	glUniform3f(glGetUniformLocation(shader.GetShaderProgramID(), "material.specular"),
-				material.Specular.r, material.Specular.g, material.Specular.b);
+	const int maxViews = 2;
+	glm::mat4 clipMats[maxViews];
+	numViews = numViews < maxViews ? numViews : maxViews;
+	for (int v = 0; v < numViews; v++)
+	{
+		clipMats[v] = viewProjMats[v] * modelMat;
+	}
 
 	for (int i = 0; i < m_ObjectMeshes.size(); i++)
 	{
-		this->m_ObjectMeshes[i].Draw(shader);
+		kuMeshCullStats stats = m_ObjectMeshes[i].Cull(i < m_MeshLOD.size() ? m_MeshLOD[i] : 0, clipMats, numViews);
+
+		m_CullStats.Meshlets		+= stats.Meshlets;
+		m_CullStats.FrustumCulled	+= stats.FrustumCulled;
+		m_CullStats.BackfaceCulled	+= stats.BackfaceCulled;
+		m_CullStats.Triangles		+= stats.Triangles;
+		m_CullStats.TrianglesCulled += stats.TrianglesCulled;
+	}
+}
+
+void kuModelObject::PrintStats(const char * name)
+{
+	if (m_NumDraws == 0)
+	{
+		return;
+	}
+
+	cout << name << ": " << m_NumTrianglesDrawn / m_NumDraws << " triangles and " << (double)m_NumDrawCommands / m_NumDraws
+		 << " indirect commands per draw (" << m_ObjectMeshes.size() << " meshes, " << m_Arena.GetBufferSize() / 1024
+		 << " KB arena), LOD draws";
+	for (size_t lod = 0; lod < m_LODDrawCount.size(); lod++)
+	{
+		cout << " " << lod << ":" << m_LODDrawCount[lod];
+	}
+	cout << endl;
+
+	if (m_CullStats.Meshlets > 0)
+	{
+		cout << name << ": culled " << 100.0 * m_CullStats.TrianglesCulled / m_CullStats.Triangles << " % of triangles, "
+			 << 100.0 * m_CullStats.FrustumCulled / m_CullStats.Meshlets << " % of meshlets by frustum, "
+			 << 100.0 * m_CullStats.BackfaceCulled / m_CullStats.Meshlets << " % by normal cone" << endl;
 	}
 }
 
+void kuModelObject::Release()
+{
+	m_Arena.Release();
+}
+
 void kuModelObject::LoadModel(char * filename)
 {
-	Assimp::Importer	importer;
+	KU_PROFILE_ZONE("kuModelObject::LoadModel");
 
 	cout << "Loading model....." << filename << endl;
 
-	const aiScene * scene = importer.ReadFile(filename, aiProcess_Triangulate | 
-														aiProcess_FlipUVs | 
-														aiProcess_GenNormals );
+	// Processed meshes from the last import, as long as the source has not changed
+	string		cachePath = string(filename) + kuMeshCacheExtension;
+	uint64_t	optionsHash = HashLoadOptions(m_LoadOptions);
+	kuMeshCache	cache;
+	if (cache.Open(cachePath.c_str(), filename, kuModelImportFlags, optionsHash))
+	{
+		for (uint32_t i = 0; i < cache.GetNumMeshes(); i++)
+		{
+			this->m_ObjectMeshes.push_back(kuMesh(cache.GetVertices(i), cache.GetNumVertices(i),
+												  cache.GetIndices(i), cache.GetNumIndices(i),
+												  cache.GetLODs(i), cache.GetNumLODs(i), m_LoadOptions.PackVertices,
+												  &m_Arena));
+
+			kuMaterial material;
+			if (cache.GetMaterial(i, material))
+			{
+				m_ObjectMaterials.push_back(material);
+			}
+		}
+
+		cout << "Done (cached)." << endl;
+		return;
+	}
+
+	// STL has one mesh and no materials, read it directly instead of through Assimp's scene
+	string extension = strrchr(filename, '.') ? strrchr(filename, '.') : "";
+	for (size_t i = 0; i < extension.size(); i++)
+	{
+		extension[i] = (char)tolower(extension[i]);
+	}
+	if (extension == ".stl")
+	{
+		vector<kuVertex>	vertices;
+		vector<GLuint>		indices;
+		if (kuLoadSTL(filename, vertices, indices))
+		{
+			// STL stores three separate vertices per triangle, share them
+			if (m_LoadOptions.WeldEpsilon >= 0.0f)
+			{
+				size_t numVertices = vertices.size();
+				size_t bytes	   = vertices.size() * sizeof(kuVertex) + indices.size() * sizeof(GLuint);
+
+				kuWeldVertices(vertices, indices, m_LoadOptions.WeldEpsilon);
+				if (m_LoadOptions.SmoothNormals)
+				{
+					kuComputeSmoothNormals(vertices, indices);
+				}
+
+				cout << "Weld: " << numVertices << " -> " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, "
+					 << bytes / 1024 << " KB -> " << (vertices.size() * sizeof(kuVertex) + indices.size() * sizeof(GLuint)) / 1024
+					 << " KB" << endl;
+			}
+			this->OptimizeMesh(vertices, indices);
+			vector<kuMeshLOD> lods = this->BuildLODs(vertices, indices);
+
+			this->m_ObjectMeshes.push_back(kuMesh(std::move(vertices), std::move(indices), vector<kuTexture>(), std::move(lods),
+												  m_LoadOptions.PackVertices, &m_Arena));
+			this->m_ObjectMaterials.push_back(kuGetSTLDefaultMaterial());
+
+			kuMeshCache::Write(cachePath.c_str(), filename, kuModelImportFlags, optionsHash, m_ObjectMeshes, m_ObjectMaterials);
+
+			cout << "Done." << endl;
+			return;
+		}
+	}
+
+	Assimp::Importer	importer;
+
+	const aiScene * scene = importer.ReadFile(filename, kuModelImportFlags);
 	// aiProcessPreset_TargetRealtime_MaxQuality iHոլ
 	if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
@@ -84,6 +279,8 @@ void kuModelObject::LoadModel(char * filename)
 	// Process ASSIMP's root node recursively
 	this->ProcessNode(scene->mRootNode, scene);
 
+	kuMeshCache::Write(cachePath.c_str(), filename, kuModelImportFlags, optionsHash, m_ObjectMeshes, m_ObjectMaterials);
+
 	cout << "Done." << endl;
 }
 
@@ -92,6 +289,8 @@ void kuModelObject::LoadModel(char * filename)
 // aiNodḙmember mMeshesusindexӤw
 void kuModelObject::ProcessNode(aiNode * node, const aiScene * scene)
 {
+	KU_PROFILE_ZONE("kuModelObject::ProcessNode");
+
 	for (int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh * mesh = scene->mMeshes[node->mMeshes[i]];			// hqscenemMeshes̭ھnode̦sindexnmeshX
@@ -107,6 +306,8 @@ void kuModelObject::ProcessNode(aiNode * node, const aiScene * scene)
 
 kuMesh kuModelObject::processMesh(aiMesh * mesh, const aiScene * scene)
 {
+	KU_PROFILE_ZONE("kuModelObject::processMesh");
+
 	vector<kuVertex>		vertices;
 	vector<GLuint>			indices;
 	vector<kuTexture>		textures;
@@ -171,7 +372,78 @@ kuMesh kuModelObject::processMesh(aiMesh * mesh, const aiScene * scene)
 		m_ObjectMaterials.push_back(materialTemp);
 	}
 
-	return kuMesh(vertices, indices, textures);
+	this->OptimizeMesh(vertices, indices);
+	vector<kuMeshLOD> lods = this->BuildLODs(vertices, indices);
+
+	return kuMesh(std::move(vertices), std::move(indices), textures, std::move(lods), m_LoadOptions.PackVertices, &m_Arena);
+}
+
+// Triangle order for the post-transform cache and overdraw, then vertex order for fetch locality
+void kuModelObject::OptimizeMesh(vector<kuVertex> & vertices, vector<GLuint> & indices)
+{
+	if (!m_LoadOptions.OptimizeIndices)
+	{
+		return;
+	}
+
+	kuVertexCacheStats before = kuAnalyzeVertexCache(indices, vertices.size());
+	kuOptimizeVertexCacheAndOverdraw(indices, vertices, m_LoadOptions.OverdrawThreshold);
+	kuOptimizeVertexFetch(vertices, indices);
+	kuVertexCacheStats after = kuAnalyzeVertexCache(indices, vertices.size());
+
+	cout << "Vertex cache: ACMR " << before.ACMR << " -> " << after.ACMR << ", ATVR " << before.ATVR << " -> " << after.ATVR
+		 << " (16 entry FIFO)" << endl;
+}
+
+// Simplifies each level from the previous one to about half its triangles and appends its
+// indices, so all levels share the vertex buffer. Stops early once a level barely shrinks.
+vector<kuMeshLOD> kuModelObject::BuildLODs(const vector<kuVertex> & vertices, vector<GLuint> & indices)
+{
+	vector<kuMeshLOD>	lods;
+	kuMeshLOD			full = { 0, (GLsizei)indices.size(), 0.0f };
+	lods.push_back(full);
+
+	if (m_LoadOptions.NumLODs <= 1 || indices.empty())
+	{
+		return lods;
+	}
+
+	glm::vec3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+	for (size_t i = 1; i < vertices.size(); i++)
+	{
+		boundsMin = glm::min(boundsMin, vertices[i].Position);
+		boundsMax = glm::max(boundsMax, vertices[i].Position);
+	}
+	float maxError = m_LoadOptions.LODMaxError * 0.5f * glm::length(boundsMax - boundsMin);
+
+	vector<GLuint> previous = indices;
+	while (lods.size() < m_LoadOptions.NumLODs && lods.size() < kuMeshCacheMaxLODs)
+	{
+		vector<GLuint>	simplified;
+		float			error = kuSimplifyMesh(vertices, previous, previous.size() / 6 * 3, maxError, simplified);
+		if (simplified.empty() || simplified.size() > previous.size() * 9 / 10)
+		{
+			break;
+		}
+		if (m_LoadOptions.OptimizeIndices)
+		{
+			kuOptimizeVertexCache(simplified, vertices.size());
+		}
+
+		kuMeshLOD lod = { (GLuint)indices.size(), (GLsizei)simplified.size(), lods.back().Error + error };
+		lods.push_back(lod);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		previous.swap(simplified);
+	}
+
+	cout << "LOD:";
+	for (size_t i = 0; i < lods.size(); i++)
+	{
+		cout << " " << lods[i].NumIndices / 3 << " (" << lods[i].Error << ")";
+	}
+	cout << " triangles (error)" << endl;
+
+	return lods;
 }
 
 vector<kuTexture> kuModelObject::loadMaterialTextures(aiMaterial * mat, aiTextureType type, string typeName)
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <stdint.h>
 #include <vector>
 #include <GLEW/glew.h>
 #include <GLM/glm.hpp>
@@ -12,37 +13,81 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "kuGeometryArena.h"
 #include "kuMesh.h"
 #include "kuShaderHandler.h"
 
 using namespace std;
 
+// How models are processed after loading. Part of the mesh cache key.
+struct kuModelLoadOptions {
+	float		WeldEpsilon;										// STL: merge vertices closer than this (model units), < 0 keeps the triangle soup
+	bool		SmoothNormals;										// STL: area-weighted vertex normals after welding
+	bool		OptimizeIndices;									// Reorder triangles for the vertex cache and less overdraw
+	float		OverdrawThreshold;									// ACMR the overdraw order may cost over the pure cache order, 1.05 = 5 %
+	int			NumLODs;											// Levels of detail including the full mesh, each about half the previous one
+	float		LODMaxError;										// Max simplification error per level, relative to the mesh's bounding radius
+	bool		PackVertices;										// Allow the 12/16 byte quantised GPU vertex layout where it is precise enough
+
+	kuModelLoadOptions() : WeldEpsilon(1e-5f), SmoothNormals(true), OptimizeIndices(true), OverdrawThreshold(1.05f),
+						   NumLODs(4), LODMaxError(0.05f), PackVertices(true) {}
+};
+
 class kuModelObject
 {
 public:
 
-	kuModelObject(char * filename);
-	kuModelObject(char * filename, kuShaderHandler shader);
+	kuModelObject(char * filename, const kuModelLoadOptions & options = kuModelLoadOptions());
+	kuModelObject(char * filename, kuShaderHandler & shader);
 	kuModelObject();
 	~kuModelObject();
 
-	void Draw(kuShaderHandler shader);
+	// numViews > 1 draws every mesh once per view in the same call (single-pass stereo),
+	// the shader picks the view from gl_InstanceID
+	void Draw(kuShaderHandler & shader, int numViews = 1);
 	void Draw();
-	void Draw(kuShaderHandler shader, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular);
+	void Draw(kuShaderHandler & shader, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, int numViews = 1);
 	void Draw(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular);
-	void Draw(kuShaderHandler shader, kuMaterial material);
+	void Draw(kuShaderHandler & shader, kuMaterial material, int numViews = 1);
 	void Draw(kuMaterial material);
 	
 	void SetMaterial(kuMaterial material);
 
+	// Picks each mesh's LOD for the coming frame from its projected error. pixelScale turns an
+	// error/distance ratio into pixels, i.e. framebuffer height / (2 tan(fovy / 2)). Call once
+	// per frame rather than per eye, so both eyes get the same geometry. A coarser LOD is only
+	// taken once its error drops below (1 - hysteresis) * maxPixelError, so it does not flicker.
+	void SelectLOD(const glm::mat4 & modelMat, const glm::vec3 & cameraPos, float pixelScale,
+				   float maxPixelError = 1.0f, float hysteresis = 0.25f);
+	// Drops the meshlets of the selected LODs that no view can see, until the next call.
+	// viewProjMats map world space to clip space, one per eye. Call after SelectLOD.
+	void Cull(const glm::mat4 & modelMat, const glm::mat4 * viewProjMats, int numViews);
+	void PrintStats(const char * name);
+	void Release();
+
 private:
 	kuShaderHandler		m_Shader;
+	kuModelLoadOptions	m_LoadOptions;
 
+	kuGeometryArena		m_Arena;										// Geometry of all meshes, drawn with one indirect multi-draw
+	kuMeshUniforms		m_Uniforms;
 	vector<kuMesh>		m_ObjectMeshes;
 	vector<kuMaterial>	m_ObjectMaterials;
 	vector<kuTexture>	m_ObjectTexture;
 
+	vector<int>			m_MeshLOD;										// Selected LOD per mesh
+	vector<uint64_t>	m_LODDrawCount;									// Mesh draws per LOD
+	uint64_t			m_NumDraws;
+	uint64_t			m_NumTrianglesDrawn;
+	kuMeshCullStats		m_CullStats;									// Summed over all Cull calls
+	uint64_t			m_NumDrawCommands;
+
+	vector<kuDrawElementsIndirectCommand>	m_DrawCommands[kuVertexLayout_Count];
+
 	void LoadModel(char * filename);
+	void OptimizeMesh(vector<kuVertex> & vertices, vector<GLuint> & indices);
+	vector<kuMeshLOD> BuildLODs(const vector<kuVertex> & vertices, vector<GLuint> & indices);
+	void DrawMeshes(kuShaderHandler & shader, int numViews);
 	void ProcessNode(aiNode * node, const aiScene * scene);
 	kuMesh processMesh(aiMesh* mesh, const aiScene* scene);
 	vector<kuTexture> loadMaterialTextures(aiMaterial* mat, aiTextureType type,
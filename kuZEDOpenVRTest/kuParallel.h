@@ -0,0 +1,44 @@
+#ifndef KU_PARALLEL_H
+#define KU_PARALLEL_H
+
+#pragma once
+
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Number of threads to use for numThreads = 0 (one per core)
+inline int kuGetNumWorkerThreads(int numThreads = 0)
+{
+	if (numThreads > 0)
+	{
+		return numThreads;
+	}
+	int cores = (int)std::thread::hardware_concurrency();
+	return cores > 0 ? cores : 1;
+}
+
+// Runs task(begin, end) over [0, count) split into contiguous ranges, one per thread,
+// with at least minPerThread items per range. The calling thread takes the first range.
+// Meant for load-time work; threads are started per call.
+template <typename Task>
+void kuParallelFor(uint64_t count, uint64_t minPerThread, int numThreads, const Task & task)
+{
+	uint64_t maxThreads = count / (minPerThread ? minPerThread : 1) + 1;
+	uint64_t threads	= (uint64_t)kuGetNumWorkerThreads(numThreads);
+	threads = threads < maxThreads ? threads : maxThreads;
+
+	std::vector<std::thread> workers;
+	for (uint64_t t = 1; t < threads; t++)
+	{
+		workers.push_back(std::thread([&task, count, threads, t] { task(count * t / threads, count * (t + 1) / threads); }));
+	}
+	task(0, count / threads);
+
+	for (size_t t = 0; t < workers.size(); t++)
+	{
+		workers[t].join();
+	}
+}
+
+#endif // !KU_PARALLEL_H
@@ -0,0 +1,354 @@
+#include "kuPoseProvider.h"
+#include "kuTrace.h"
+
+#include <iostream>
+#include <cmath>
+#include <string.h>
+
+static const char * StageNames[kuNumPoseStages] = { "start", "late" };
+
+// Rotation part of an OpenVR pose as a unit quaternion (w, x, y, z)
+static void PoseToQuat(const vr::HmdMatrix34_t & pose, double q[4])
+{
+	const float (*m)[4] = pose.m;
+	double trace = m[0][0] + m[1][1] + m[2][2];
+
+	if (trace > 0.0)
+	{
+		double s = 0.5 / sqrt(trace + 1.0);
+		q[0] = 0.25 / s;
+		q[1] = (m[2][1] - m[1][2]) * s;
+		q[2] = (m[0][2] - m[2][0]) * s;
+		q[3] = (m[1][0] - m[0][1]) * s;
+	}
+	else if (m[0][0] > m[1][1] && m[0][0] > m[2][2])
+	{
+		double s = 2.0 * sqrt(1.0 + m[0][0] - m[1][1] - m[2][2]);
+		q[0] = (m[2][1] - m[1][2]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (m[0][1] + m[1][0]) / s;
+		q[3] = (m[0][2] + m[2][0]) / s;
+	}
+	else if (m[1][1] > m[2][2])
+	{
+		double s = 2.0 * sqrt(1.0 + m[1][1] - m[0][0] - m[2][2]);
+		q[0] = (m[0][2] - m[2][0]) / s;
+		q[1] = (m[0][1] + m[1][0]) / s;
+		q[2] = 0.25 * s;
+		q[3] = (m[1][2] + m[2][1]) / s;
+	}
+	else
+	{
+		double s = 2.0 * sqrt(1.0 + m[2][2] - m[0][0] - m[1][1]);
+		q[0] = (m[1][0] - m[0][1]) / s;
+		q[1] = (m[0][2] + m[2][0]) / s;
+		q[2] = (m[1][2] + m[2][1]) / s;
+		q[3] = 0.25 * s;
+	}
+}
+
+static double QuatDot(const double a[4], const double b[4])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+kuPoseProvider::kuPoseProvider()
+	: m_HMD(nullptr), m_FrameDuration(1.0f / 90.0f), m_VsyncToPhotons(0.0f),
+	  m_FrameIndex(0), m_PhotonTime(0), m_MeasuredTime(0), m_MeasuredCount(0), m_MeasuredHead(0),
+	  m_PendingCount(0), m_PendingTail(0), m_LogFile(nullptr), m_LogStartTime(0), m_NumDropped(0)
+{
+	memset(m_RenderPoses, 0, sizeof(m_RenderPoses));
+	memset(&m_HMDPose, 0, sizeof(m_HMDPose));
+	memset(&m_MeasuredPose, 0, sizeof(m_MeasuredPose));
+
+	for (int stage = 0; stage < kuNumPoseStages; stage++)
+	{
+		m_NumResolved[stage]   = 0;
+		m_TotalPosError[stage] = 0.0;
+		m_MaxPosError[stage]   = 0.0;
+		m_TotalRotError[stage] = 0.0;
+		m_MaxRotError[stage]   = 0.0;
+	}
+}
+
+kuPoseProvider::~kuPoseProvider()
+{
+	CloseLog();
+}
+
+bool kuPoseProvider::Init(kuHMDBackend * hmd)
+{
+	if (!hmd)
+	{
+		std::cout << "Pose provider: no HMD." << std::endl;
+		return false;
+	}
+	m_HMD = hmd;
+
+	float freq = hmd->GetDisplayFrequency();
+	if (freq > 0.0f)
+	{
+		m_FrameDuration = 1.0f / freq;
+	}
+	m_VsyncToPhotons = hmd->GetSecondsFromVsyncToPhotons();
+
+	return true;
+}
+
+bool kuPoseProvider::WaitGetPoses()
+{
+	KU_PROFILE_ZONE("WaitGetPoses");
+
+	if (!m_HMD)
+	{
+		return false;
+	}
+
+	// Blocks in the runtime; its render pose is the fallback in case the own prediction fails
+	m_HMD->WaitGetPoses(m_RenderPoses);
+	m_HMDPose = m_RenderPoses[vr::k_unTrackedDeviceIndex_Hmd];
+	m_FrameIndex++;
+
+	// Photon time of this frame, fixed from here on
+	float sinceVsync = m_HMD->GetTimeSinceLastVsync();
+
+	float toPhotons = m_FrameDuration - sinceVsync + m_VsyncToPhotons;
+	if (toPhotons < 0.0f)
+	{
+		toPhotons = 0.0f;
+	}
+	m_PhotonTime = kuGetTimeNs() + (uint64_t)(toPhotons * 1e9);
+
+	Measure();
+	return Predict(kuPoseStage_Start);
+}
+
+bool kuPoseProvider::LateUpdate()
+{
+	KU_PROFILE_ZONE("late pose update");
+
+	if (!m_HMD)
+	{
+		return false;
+	}
+
+	Measure();
+	return Predict(kuPoseStage_Late);
+}
+
+const vr::TrackedDevicePose_t & kuPoseProvider::GetHMDPose()
+{
+	return m_HMDPose;
+}
+
+const vr::TrackedDevicePose_t & kuPoseProvider::GetMeasuredHMDPose()
+{
+	return m_MeasuredPose;
+}
+
+const vr::TrackedDevicePose_t * kuPoseProvider::GetRenderPoses()
+{
+	return m_RenderPoses;
+}
+
+uint64_t kuPoseProvider::GetMeasuredTime()
+{
+	return m_MeasuredTime;
+}
+
+uint64_t kuPoseProvider::GetPhotonTime()
+{
+	return m_PhotonTime;
+}
+
+bool kuPoseProvider::Predict(kuPoseStage stage)
+{
+	uint64_t now	   = kuGetTimeNs();
+	float	 toPhotons = m_PhotonTime > now ? (float)((m_PhotonTime - now) * 1e-9) : 0.0f;
+
+	vr::TrackedDevicePose_t pose;
+	m_HMD->GetHMDPose(toPhotons, pose);
+	if (!pose.bPoseIsValid)
+	{
+		return false;
+	}
+	m_HMDPose = pose;
+
+	// Keep for the error measurement once the photon time has passed
+	if (m_PendingCount == kuPendingPredictionSize)
+	{
+		m_PendingTail = (m_PendingTail + 1) % kuPendingPredictionSize;
+		m_PendingCount--;
+		m_NumDropped++;
+	}
+
+	Prediction & pred = m_Pending[(m_PendingTail + m_PendingCount) % kuPendingPredictionSize];
+	pred.Frame		= m_FrameIndex;
+	pred.Stage		= stage;
+	pred.QueryTime	= now;
+	pred.TargetTime = m_PhotonTime;
+	pred.Pose		= pose.mDeviceToAbsoluteTracking;
+	m_PendingCount++;
+
+	return true;
+}
+
+void kuPoseProvider::Measure()
+{
+	vr::TrackedDevicePose_t pose;
+	m_HMD->GetHMDPose(0.0f, pose);
+	if (!pose.bPoseIsValid)
+	{
+		return;
+	}
+
+	m_MeasuredPose = pose;
+	m_MeasuredTime = kuGetTimeNs();
+
+	m_Measured[m_MeasuredHead].Time = m_MeasuredTime;
+	m_Measured[m_MeasuredHead].Pose = pose.mDeviceToAbsoluteTracking;
+
+	m_MeasuredHead = (m_MeasuredHead + 1) % kuPoseMeasureHistorySize;
+	if (m_MeasuredCount < kuPoseMeasureHistorySize)
+	{
+		m_MeasuredCount++;
+	}
+
+	ResolvePredictions();
+}
+
+void kuPoseProvider::ResolvePredictions()
+{
+	// Targets only grow, so predictions resolve in order
+	while (m_PendingCount > 0)
+	{
+		const Prediction & pred = m_Pending[m_PendingTail];
+		if (pred.TargetTime > m_MeasuredTime)
+		{
+			break;
+		}
+
+		// Measured samples right before and after the target time
+		int after  = (m_MeasuredHead + kuPoseMeasureHistorySize - 1) % kuPoseMeasureHistorySize;
+		int before = after;
+		for (int i = 1; i < m_MeasuredCount; i++)
+		{
+			int index = (m_MeasuredHead + kuPoseMeasureHistorySize - 1 - i) % kuPoseMeasureHistorySize;
+			before = index;
+			if (m_Measured[index].Time <= pred.TargetTime)
+			{
+				break;
+			}
+			after = index;
+		}
+
+		// Interpolate the measured pose to the target time
+		const PoseSample & a = m_Measured[before];
+		const PoseSample & b = m_Measured[after];
+		double t = 0.0;
+		if (b.Time > a.Time && pred.TargetTime > a.Time)
+		{
+			t = (double)(pred.TargetTime - a.Time) / (double)(b.Time - a.Time);
+			t = t > 1.0 ? 1.0 : t;
+		}
+
+		vr::HmdMatrix34_t measured;
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 4; col++)
+			{
+				measured.m[row][col] = (float)((1.0 - t) * a.Pose.m[row][col] + t * b.Pose.m[row][col]);
+			}
+		}
+
+		WritePrediction(pred, measured);
+
+		m_PendingTail = (m_PendingTail + 1) % kuPendingPredictionSize;
+		m_PendingCount--;
+	}
+}
+
+void kuPoseProvider::WritePrediction(const Prediction & pred, const vr::HmdMatrix34_t & measured)
+{
+	double qPred[4], qMeas[4];
+	PoseToQuat(pred.Pose, qPred);
+	PoseToQuat(measured, qMeas);		// Blended matrix is close enough to orthonormal for this
+
+	double dx = pred.Pose.m[0][3] - measured.m[0][3];
+	double dy = pred.Pose.m[1][3] - measured.m[1][3];
+	double dz = pred.Pose.m[2][3] - measured.m[2][3];
+	double posError = 1000.0 * sqrt(dx * dx + dy * dy + dz * dz);								// mm
+
+	double dot		= fabs(QuatDot(qPred, qMeas)) / sqrt(QuatDot(qPred, qPred) * QuatDot(qMeas, qMeas));
+	double rotError = 2.0 * acos(dot > 1.0 ? 1.0 : dot) * 180.0 / 3.14159265358979;			// degree
+
+	m_NumResolved[pred.Stage]++;
+	m_TotalPosError[pred.Stage] += posError;
+	m_TotalRotError[pred.Stage] += rotError;
+	if (posError > m_MaxPosError[pred.Stage])	m_MaxPosError[pred.Stage] = posError;
+	if (rotError > m_MaxRotError[pred.Stage])	m_MaxRotError[pred.Stage] = rotError;
+
+	if (!m_LogFile)
+	{
+		return;
+	}
+
+	fprintf(m_LogFile, "%llu,%s,%.3f,%.3f,%.3f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.4f\n",
+			(unsigned long long)pred.Frame, StageNames[pred.Stage],
+			(pred.QueryTime - m_LogStartTime) * 1e-6, (pred.TargetTime - m_LogStartTime) * 1e-6,
+			(pred.TargetTime - pred.QueryTime) * 1e-6,
+			pred.Pose.m[0][3], pred.Pose.m[1][3], pred.Pose.m[2][3], qPred[0], qPred[1], qPred[2], qPred[3],
+			measured.m[0][3], measured.m[1][3], measured.m[2][3], qMeas[0], qMeas[1], qMeas[2], qMeas[3],
+			posError, rotError);
+}
+
+bool kuPoseProvider::OpenLog(const char * path)
+{
+	CloseLog();
+
+	m_LogFile = fopen(path, "w");
+	if (!m_LogFile)
+	{
+		std::cout << "Pose provider: cannot open log " << path << std::endl;
+		return false;
+	}
+	m_LogStartTime = kuGetTimeNs();
+
+	// Times in ms since the log was opened, positions in m
+	fprintf(m_LogFile, "frame,stage,query_ms,target_ms,lead_ms,"
+					   "pred_x,pred_y,pred_z,pred_qw,pred_qx,pred_qy,pred_qz,"
+					   "meas_x,meas_y,meas_z,meas_qw,meas_qx,meas_qy,meas_qz,"
+					   "pos_err_mm,rot_err_deg\n");
+	return true;
+}
+
+void kuPoseProvider::CloseLog()
+{
+	if (m_LogFile)
+	{
+		fclose(m_LogFile);
+		m_LogFile = nullptr;
+	}
+}
+
+void kuPoseProvider::PrintStats()
+{
+	for (int stage = 0; stage < kuNumPoseStages; stage++)
+	{
+		uint64_t num = m_NumResolved[stage];
+		if (num == 0)
+		{
+			continue;
+		}
+
+		std::cout << "Pose prediction (" << StageNames[stage] << "): " << num << " poses"
+				  << ", position error avg " << m_TotalPosError[stage] / num << " mm / max " << m_MaxPosError[stage] << " mm"
+				  << ", rotation error avg " << m_TotalRotError[stage] / num << " deg / max " << m_MaxRotError[stage] << " deg"
+				  << std::endl;
+	}
+
+	if (m_NumDropped > 0)
+	{
+		std::cout << "Pose prediction: " << m_NumDropped << " predictions dropped before they could be measured" << std::endl;
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef KU_POSEPROVIDER_H
+#define KU_POSEPROVIDER_H
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <OpenVR.h>
+
+#include "kuClock.h"
+#include "kuHMDBackend.h"
+
+#define kuPoseMeasureHistorySize	32
+#define kuPendingPredictionSize		64
+
+enum kuPoseStage {
+	kuPoseStage_Start = 0,									// Predicted right after WaitGetPoses
+	kuPoseStage_Late,										// Re-predicted by LateUpdate, right before drawing
+	kuNumPoseStages
+};
+
+// HMD poses predicted to the moment the current frame's photons leave the display.
+// The photon time is fixed once per frame in WaitGetPoses (frame duration - time since
+// vsync + vsync to photons); every later query predicts to that same time, so a late
+// update never drifts onto the next frame.
+// Each prediction is kept until its target time has been passed by a measured pose
+// (zero prediction) and is then written to the log next to that measurement.
+class kuPoseProvider
+{
+public:
+	kuPoseProvider();
+	~kuPoseProvider();
+
+	bool		Init(kuHMDBackend * hmd);
+
+	// Blocks in the compositor until the next frame may start, then predicts the HMD pose
+	bool		WaitGetPoses();
+	// Re-predicts the HMD pose with the time left until this frame's photon time
+	bool		LateUpdate();
+
+	// Latest prediction for the current frame, the pose to render and submit with
+	const vr::TrackedDevicePose_t &	GetHMDPose();
+	// Most recent measured pose (no prediction) and its kuGetTimeNs() time
+	const vr::TrackedDevicePose_t &	GetMeasuredHMDPose();
+	// Runtime render poses of all tracked devices from the last WaitGetPoses, k_unMaxTrackedDeviceCount entries
+	const vr::TrackedDevicePose_t *	GetRenderPoses();
+	uint64_t	GetMeasuredTime();
+	uint64_t	GetPhotonTime();
+
+	// CSV with one row per resolved prediction
+	bool		OpenLog(const char * path);
+	void		CloseLog();
+	void		PrintStats();
+
+private:
+	struct PoseSample {
+		uint64_t			Time;
+		vr::HmdMatrix34_t	Pose;
+	};
+
+	struct Prediction {
+		uint64_t			Frame;
+		kuPoseStage			Stage;
+		uint64_t			QueryTime;
+		uint64_t			TargetTime;
+		vr::HmdMatrix34_t	Pose;
+	};
+
+	bool		Predict(kuPoseStage stage);
+	void		Measure();
+	void		ResolvePredictions();
+	void		WritePrediction(const Prediction & pred, const vr::HmdMatrix34_t & measured);
+
+	kuHMDBackend			*	m_HMD;
+	float						m_FrameDuration;
+	float						m_VsyncToPhotons;
+
+	uint64_t					m_FrameIndex;
+	uint64_t					m_PhotonTime;
+	vr::TrackedDevicePose_t		m_RenderPoses[vr::k_unMaxTrackedDeviceCount];
+	vr::TrackedDevicePose_t		m_HMDPose;
+	vr::TrackedDevicePose_t		m_MeasuredPose;
+	uint64_t					m_MeasuredTime;
+
+	PoseSample					m_Measured[kuPoseMeasureHistorySize];
+	int							m_MeasuredCount;
+	int							m_MeasuredHead;
+
+	Prediction					m_Pending[kuPendingPredictionSize];
+	int							m_PendingCount;
+	int							m_PendingTail;
+
+	FILE					*	m_LogFile;
+	uint64_t					m_LogStartTime;
+
+	uint64_t					m_NumResolved[kuNumPoseStages];
+	double						m_TotalPosError[kuNumPoseStages];
+	double						m_MaxPosError[kuNumPoseStages];
+	double						m_TotalRotError[kuNumPoseStages];
+	double						m_MaxRotError[kuNumPoseStages];
+	uint64_t					m_NumDropped;
+};
+
+#endif // !KU_POSEPROVIDER_H
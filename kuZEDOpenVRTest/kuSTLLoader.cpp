@@ -0,0 +1,311 @@
+#include "kuSTLLoader.h"
+
+#include <string.h>
+#include <cmath>
+#include <iostream>
+
+#include "kuMappedFile.h"
+#include "kuParallel.h"
+#include "kuTrace.h"
+
+static const uint64_t	kuSTLBinaryHeaderSize	= 84;			// 80 byte comment + uint32 facet count
+static const uint64_t	kuSTLBinaryFacetSize	= 50;			// normal, 3 vertices, uint16 attribute
+static const uint64_t	kuSTLMinFacetsPerThread	= 16384;
+
+struct kuSTLFacet {
+	float		Normal[3];
+	float		Vertex[3][3];
+};
+
+static void StoreFacet(const kuSTLFacet & facet, kuVertex * vertices)
+{
+	glm::vec3 v0(facet.Vertex[0][0], facet.Vertex[0][1], facet.Vertex[0][2]);
+	glm::vec3 v1(facet.Vertex[1][0], facet.Vertex[1][1], facet.Vertex[1][2]);
+	glm::vec3 v2(facet.Vertex[2][0], facet.Vertex[2][1], facet.Vertex[2][2]);
+	glm::vec3 normal(facet.Normal[0], facet.Normal[1], facet.Normal[2]);
+
+	// Some exporters leave the normal out
+	if (normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f)
+	{
+		glm::vec3 e0 = v1 - v0;
+		glm::vec3 e1 = v2 - v0;
+		normal = glm::vec3(e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x);
+
+		float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		if (length > 0.0f)
+		{
+			normal = normal * (1.0f / length);
+		}
+	}
+
+	vertices[0].Position = v0;
+	vertices[1].Position = v1;
+	vertices[2].Position = v2;
+	for (int i = 0; i < 3; i++)
+	{
+		vertices[i].Normal	 = normal;
+		vertices[i].TexCoord = glm::vec2(0.0f, 0.0f);
+	}
+}
+
+#pragma region // Binary //
+static bool IsBinarySTL(const uint8_t * data, uint64_t size)
+{
+	// ASCII files start with "solid", but so do the headers of some binary exporters; the size decides
+	if (size < kuSTLBinaryHeaderSize)
+	{
+		return false;
+	}
+
+	uint32_t numFacets;
+	memcpy(&numFacets, data + 80, 4);
+	return size == kuSTLBinaryHeaderSize + numFacets * kuSTLBinaryFacetSize || memcmp(data, "solid", 5) != 0;
+}
+
+static bool LoadBinarySTL(const uint8_t * data, uint64_t size, vector<kuVertex> & vertices, int numThreads)
+{
+	uint32_t numFacets;
+	memcpy(&numFacets, data + 80, 4);
+	if (size < kuSTLBinaryHeaderSize + numFacets * kuSTLBinaryFacetSize)
+	{
+		return false;
+	}
+
+	vertices.resize((size_t)numFacets * 3);
+	kuVertex * out = vertices.data();
+	kuParallelFor(numFacets, kuSTLMinFacetsPerThread, numThreads, [data, out](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++)
+		{
+			kuSTLFacet facet;
+			memcpy(&facet, data + kuSTLBinaryHeaderSize + i * kuSTLBinaryFacetSize, sizeof(facet));
+			StoreFacet(facet, out + i * 3);
+		}
+	});
+
+	return true;
+}
+#pragma endregion
+
+#pragma region // ASCII //
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char * SkipSpace(const char * p, const char * end)
+{
+	while (p < end && IsSpace(*p))
+	{
+		p++;
+	}
+	return p;
+}
+
+// Fixed-format float: [sign] digits [. digits] [e [sign] digits], locale independent
+static bool ParseFloat(const char *& p, const char * end, float & value)
+{
+	p = SkipSpace(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p++ == '-';
+	}
+
+	double		 mantissa = 0.0;
+	int			 exponent = 0;
+	const char * start	  = p;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		mantissa = mantissa * 10.0 + (*p++ - '0');
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			mantissa = mantissa * 10.0 + (*p++ - '0');
+			exponent--;
+		}
+	}
+	if (p == start)
+	{
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		bool negativeExp = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExp = *p++ == '-';
+		}
+		int e = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			e = e * 10 + (*p++ - '0');
+		}
+		exponent += negativeExp ? -e : e;
+	}
+
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16 };
+	double scale = exponent >= -16 && exponent <= 16 ? powers[exponent < 0 ? -exponent : exponent] : pow(10.0, exponent < 0 ? -exponent : exponent);
+	mantissa	 = exponent < 0 ? mantissa / scale : mantissa * scale;
+
+	value = (float)(negative ? -mantissa : mantissa);
+	return true;
+}
+
+static bool ExpectWord(const char *& p, const char * end, const char * word)
+{
+	p = SkipSpace(p, end);
+
+	size_t length = strlen(word);
+	if ((size_t)(end - p) < length || memcmp(p, word, length) != 0)
+	{
+		return false;
+	}
+	p += length;
+	return true;
+}
+
+// Start of the first "facet" keyword at or after p
+static const char * FindFacet(const char * p, const char * fileBegin, const char * end)
+{
+	for (; end - p >= 5; p++)
+	{
+		if (memcmp(p, "facet", 5) == 0 && (p == fileBegin || IsSpace(p[-1])))
+		{
+			return p;
+		}
+	}
+	return end;
+}
+
+// Parses every facet starting in [begin, end), the last one may run past end
+static bool ParseASCIIRange(const char * begin, const char * end, const char * fileBegin, const char * fileEnd,
+							vector<kuSTLFacet> & facets)
+{
+	const char * p = FindFacet(begin, fileBegin, fileEnd);
+	while (p < end)
+	{
+		kuSTLFacet facet;
+		if (!ExpectWord(p, fileEnd, "facet") || !ExpectWord(p, fileEnd, "normal") ||
+			!ParseFloat(p, fileEnd, facet.Normal[0]) || !ParseFloat(p, fileEnd, facet.Normal[1]) || !ParseFloat(p, fileEnd, facet.Normal[2]) ||
+			!ExpectWord(p, fileEnd, "outer") || !ExpectWord(p, fileEnd, "loop"))
+		{
+			return false;
+		}
+		for (int v = 0; v < 3; v++)
+		{
+			if (!ExpectWord(p, fileEnd, "vertex") ||
+				!ParseFloat(p, fileEnd, facet.Vertex[v][0]) || !ParseFloat(p, fileEnd, facet.Vertex[v][1]) || !ParseFloat(p, fileEnd, facet.Vertex[v][2]))
+			{
+				return false;
+			}
+		}
+		if (!ExpectWord(p, fileEnd, "endloop") || !ExpectWord(p, fileEnd, "endfacet"))
+		{
+			return false;
+		}
+		facets.push_back(facet);
+
+		p = FindFacet(p, fileBegin, fileEnd);
+	}
+
+	return true;
+}
+
+static bool LoadASCIISTL(const uint8_t * data, uint64_t size, vector<kuVertex> & vertices, int numThreads)
+{
+	// Split by bytes, assuming about 250 bytes per facet; each thread owns the facets starting in its range
+	const char * text	 = (const char *)data;
+	const char * textEnd = text + size;
+	uint64_t	 ranges	 = numThreads < 1 ? 1 : numThreads;
+	if (size / 250 < ranges * kuSTLMinFacetsPerThread)
+	{
+		ranges = size / 250 / kuSTLMinFacetsPerThread + 1;
+	}
+
+	vector<vector<kuSTLFacet>>	facets(ranges);
+	vector<char>				ok(ranges, 0);
+	kuParallelFor(ranges, 1, (int)ranges, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t r = begin; r < end; r++)
+		{
+			facets[r].reserve((size_t)(size / ranges / 250 + 1));
+			ok[r] = ParseASCIIRange(text + size * r / ranges, text + size * (r + 1) / ranges, text, textEnd, facets[r]);
+		}
+	});
+
+	vector<uint64_t> first(ranges + 1, 0);
+	for (uint64_t r = 0; r < ranges; r++)
+	{
+		if (!ok[r])
+		{
+			return false;
+		}
+		first[r + 1] = first[r] + facets[r].size();
+	}
+
+	vertices.resize((size_t)first[ranges] * 3);
+	kuVertex * out = vertices.data();
+	kuParallelFor(ranges, 1, (int)ranges, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t r = begin; r < end; r++)
+		{
+			for (size_t i = 0; i < facets[r].size(); i++)
+			{
+				StoreFacet(facets[r][i], out + (first[r] + i) * 3);
+			}
+		}
+	});
+
+	return true;
+}
+#pragma endregion
+
+bool kuLoadSTL(const char * path, vector<kuVertex> & vertices, vector<GLuint> & indices, int numThreads)
+{
+	KU_PROFILE_ZONE("kuLoadSTL");
+
+	kuMappedFile file;
+	if (!file.Open(path))
+	{
+		std::cout << "STL: cannot open " << path << std::endl;
+		return false;
+	}
+
+	numThreads = kuGetNumWorkerThreads(numThreads);
+
+	const uint8_t * data = file.GetData();
+	uint64_t		size = file.GetSize();
+	file.Prefetch(0, size);
+
+	bool binary = IsBinarySTL(data, size);
+	bool loaded = binary ? LoadBinarySTL(data, size, vertices, numThreads) : LoadASCIISTL(data, size, vertices, numThreads);
+	if (!loaded || vertices.empty())
+	{
+		std::cout << "STL: " << path << " is not a valid " << (binary ? "binary" : "ASCII") << " STL file." << std::endl;
+		vertices.clear();
+		return false;
+	}
+
+	indices.resize(vertices.size());
+	GLuint * out = indices.data();
+	kuParallelFor(indices.size(), kuSTLMinFacetsPerThread, numThreads, [out](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++)
+		{
+			out[i] = (GLuint)i;
+		}
+	});
+
+	return true;
+}
+
+kuMaterial kuGetSTLDefaultMaterial()
+{
+	kuMaterial material;
+	material.Ambient  = glm::vec3(0.05f, 0.05f, 0.05f);
+	material.Diffuse  = glm::vec3(0.6f, 0.6f, 0.6f);
+	material.Specular = glm::vec3(0.6f, 0.6f, 0.6f);
+	return material;
+}
@@ -0,0 +1,22 @@
+#ifndef KU_STLLOADER_H
+#define KU_STLLOADER_H
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "kuMesh.h"
+
+// Reads a binary or ASCII STL file into the arrays kuMesh draws from, the same
+// output Assimp gives with aiProcess_Triangulate | aiProcess_GenNormals: three
+// unshared vertices per facet carrying the facet normal, indices 0..3n-1. Facets
+// with a zero normal get the normal of their triangle.
+// The file is memory mapped and facet ranges are parsed on numThreads threads
+// (0 = one per core) straight into the output arrays.
+bool		kuLoadSTL(const char * path, vector<kuVertex> & vertices, vector<GLuint> & indices, int numThreads = 0);
+
+// Material Assimp assigns to STL meshes
+kuMaterial	kuGetSTLDefaultMaterial();
+
+#endif // !KU_STLLOADER_H
@@ -0,0 +1,595 @@
+#include "kuSessionFile.h"
+
+#include <string.h>
+#include <iostream>
+
+#include "kuLZ4.h"
+#include "kuTrace.h"
+
+static_assert(sizeof(kuSessionHeader) <= kuSessionPageSize, "session header must fit its page");
+static_assert(sizeof(kuSessionChunkHeader) + sizeof(kuSessionCameraFrame) <= kuSessionPageSize, "camera frame info must fit its page");
+
+// Delta references kept decoded, enough for one chain per recorder worker
+static const size_t kuSessionDecodeCacheSize = 8;
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void kuSubtractDelta(uint8_t * dst, const uint8_t * image, const uint8_t * reference, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		dst[i] = (uint8_t)(image[i] - reference[i]);
+	}
+}
+
+void kuAddDelta(uint8_t * image, const uint8_t * reference, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		image[i] = (uint8_t)(image[i] + reference[i]);
+	}
+}
+
+#pragma region // Writer //
+kuSessionWriter::kuSessionWriter()
+{
+	memset(&m_Header, 0, sizeof(m_Header));
+}
+
+kuSessionWriter::~kuSessionWriter()
+{
+	this->Close();
+}
+
+bool kuSessionWriter::Open(const char * path, int width, int height, double frameRate, const kuStereoCalibration & calibration,
+						   uint32_t flags, size_t writeBlockSize)
+{
+	this->Close();
+
+	if (!m_File.Open(path, writeBlockSize))
+	{
+		return false;
+	}
+	m_Path = path;
+
+	memset(&m_Header, 0, sizeof(m_Header));
+	memcpy(m_Header.Magic, "KUSESSN", 8);
+	m_Header.Version	 = kuSessionVersion;
+	m_Header.PageSize	 = kuSessionPageSize;
+	m_Header.Flags		 = flags;
+	m_Header.StartTime	 = kuGetTimeNs();
+	m_Header.FrameRate	 = frameRate;
+	m_Header.Width		 = width;
+	m_Header.Height		 = height;
+	m_Header.Calibration = calibration;
+
+	for (int type = 0; type < kuNumSessionChunkTypes; type++)
+	{
+		m_Index[type].clear();
+	}
+
+	// Header page, rewritten with the totals on Close()
+	m_File.Write(&m_Header, sizeof(m_Header));
+	m_File.WriteZeros(kuSessionPageSize - sizeof(m_Header));
+
+	std::cout << "Session: recording to " << path << std::endl;
+
+	return true;
+}
+
+void kuSessionWriter::Close()
+{
+	if (!m_File.IsOpen())
+	{
+		return;
+	}
+
+	// Index, grouped by chunk type
+	m_Header.IndexOffset = m_File.GetSize();
+
+	kuSessionIndexHeader indexHeader;
+	memset(&indexHeader, 0, sizeof(indexHeader));
+	memcpy(indexHeader.Magic, "KUINDEX", 8);
+	for (int type = 0; type < kuNumSessionChunkTypes; type++)
+	{
+		indexHeader.NumEntries[type] = m_Index[type].size();
+	}
+	m_File.Write(&indexHeader, sizeof(indexHeader));
+	for (int type = 0; type < kuNumSessionChunkTypes; type++)
+	{
+		if (!m_Index[type].empty())
+		{
+			m_File.Write(m_Index[type].data(), m_Index[type].size() * sizeof(kuSessionIndexEntry));
+		}
+	}
+
+	uint64_t size = m_File.GetSize();
+	m_File.Close();
+
+	// Header last, a session without IndexOffset gets re-indexed by the reader
+	FILE * file = fopen(m_Path.c_str(), "r+b");
+	if (file)
+	{
+		fwrite(&m_Header, sizeof(m_Header), 1, file);
+		fclose(file);
+	}
+
+	std::cout << "Session: " << m_Header.NumChunks[kuSessionChunk_Camera] << " camera frames, "
+			  << m_Header.NumChunks[kuSessionChunk_Poses] << " pose sets, "
+			  << (size >> 20) << " MB written to " << m_Path << std::endl;
+}
+
+bool kuSessionWriter::IsOpen()
+{
+	return m_File.IsOpen();
+}
+
+uint64_t kuSessionWriter::GetNumBytesWritten()
+{
+	return m_File.GetSize();
+}
+
+kuDirectFile & kuSessionWriter::GetFile()
+{
+	return m_File;
+}
+
+bool kuSessionWriter::WritePadding(uint64_t alignment)
+{
+	uint64_t offset = m_File.GetSize();
+	uint64_t target = AlignUp(offset, alignment);
+	if (target == offset)
+	{
+		return true;
+	}
+
+	// Chunks are 64 byte aligned, so there is always room for the padding chunk header
+	kuSessionChunkHeader chunk;
+	memset(&chunk, 0, sizeof(chunk));
+	chunk.Type		  = kuSessionChunk_Padding;
+	chunk.PayloadSize = target - offset - sizeof(chunk);
+
+	m_File.Write(&chunk, sizeof(chunk));
+	return m_File.WriteZeros((size_t)chunk.PayloadSize);
+}
+
+bool kuSessionWriter::WriteChunk(kuSessionChunkType type, uint32_t flags, uint64_t timestamp, uint64_t payloadSize,
+								 const void * part0, uint64_t size0, const void * part1, uint64_t size1)
+{
+	kuSessionChunkHeader chunk;
+	memset(&chunk, 0, sizeof(chunk));
+	chunk.Type		  = type;
+	chunk.Flags		  = flags;
+	chunk.PayloadSize = payloadSize;
+	chunk.Timestamp	  = timestamp;
+
+	kuSessionIndexEntry entry;
+	entry.Offset	= m_File.GetSize();
+	entry.Timestamp = timestamp;
+
+	// Payload is part0, zeros up to payloadSize - size1, part1
+	uint64_t size = sizeof(chunk) + payloadSize;
+	m_File.Write(&chunk, sizeof(chunk));
+	m_File.Write(part0, (size_t)size0);
+	m_File.WriteZeros((size_t)(payloadSize - size0 - size1));
+	if (part1)
+	{
+		m_File.Write(part1, (size_t)size1);
+	}
+	if (!m_File.WriteZeros((size_t)(AlignUp(size, kuSessionChunkAlignment) - size)))
+	{
+		return false;
+	}
+
+	m_Index[type].push_back(entry);
+	m_Header.NumChunks[type]++;
+
+	return true;
+}
+
+bool kuSessionWriter::WriteCameraFrame(const kuSessionCameraFrame & info, uint32_t flags, const uint8_t * image)
+{
+	if (!m_File.IsOpen())
+	{
+		return false;
+	}
+
+	if (flags & (kuSessionChunkFlag_LZ4 | kuSessionChunkFlag_Delta))
+	{
+		return WriteChunk(kuSessionChunk_Camera, flags, info.ExposureTimestamp, sizeof(info) + info.DataSize,
+						  &info, sizeof(info), image, info.DataSize);
+	}
+
+	// Uncompressed: image one page into the chunk, so it is page aligned in the file
+	uint64_t infoSize = kuSessionPageSize - sizeof(kuSessionChunkHeader);
+	return WritePadding(kuSessionPageSize) &&
+		   WriteChunk(kuSessionChunk_Camera, flags, info.ExposureTimestamp, infoSize + info.DataSize,
+					  &info, sizeof(info), image, info.DataSize);
+}
+
+bool kuSessionWriter::WritePoses(uint64_t timestamp, uint64_t frameIndex, uint64_t photonTime, const vr::TrackedDevicePose_t * poses)
+{
+	if (!m_File.IsOpen())
+	{
+		return false;
+	}
+
+	kuSessionPoses payload;
+	payload.FrameIndex = frameIndex;
+	payload.PhotonTime = photonTime;
+	memcpy(payload.Poses, poses, sizeof(payload.Poses));
+
+	return WriteChunk(kuSessionChunk_Poses, 0, timestamp, sizeof(payload), &payload, sizeof(payload));
+}
+#pragma endregion
+
+#pragma region // Reader //
+kuSessionReader::kuSessionReader()
+	: m_Header(nullptr), m_DecodeCacheNext(0)
+{
+	for (int type = 0; type < kuNumSessionChunkTypes; type++)
+	{
+		m_Index[type]	   = nullptr;
+		m_NumEntries[type] = 0;
+	}
+}
+
+kuSessionReader::~kuSessionReader()
+{
+	this->Close();
+}
+
+bool kuSessionReader::Open(const char * path)
+{
+	this->Close();
+
+	if (!m_File.Open(path))
+	{
+		return false;
+	}
+
+	m_Header = (const kuSessionHeader *)m_File.GetData();
+	if (m_File.GetSize() < kuSessionPageSize || memcmp(m_Header->Magic, "KUSESSN", 8) != 0 ||
+		m_Header->Version != kuSessionVersion || m_Header->PageSize != kuSessionPageSize)
+	{
+		std::cout << "Session: " << path << " is not a version " << kuSessionVersion << " session." << std::endl;
+		this->Close();
+		return false;
+	}
+
+	const kuSessionIndexHeader * indexHeader = nullptr;
+	if (m_Header->IndexOffset && m_Header->IndexOffset + sizeof(kuSessionIndexHeader) <= m_File.GetSize())
+	{
+		indexHeader = (const kuSessionIndexHeader *)(m_File.GetData() + m_Header->IndexOffset);
+		if (memcmp(indexHeader->Magic, "KUINDEX", 8) != 0)
+		{
+			indexHeader = nullptr;
+		}
+	}
+
+	if (indexHeader)
+	{
+		// Entries are used in place, so the whole index and every chunk it points at must be
+		// inside the file. Counts are checked one by one so that their sum cannot overflow.
+		uint64_t available = (m_File.GetSize() - m_Header->IndexOffset - sizeof(kuSessionIndexHeader)) / sizeof(kuSessionIndexEntry);
+		bool	 valid	   = true;
+		for (int type = 0; type < kuNumSessionChunkTypes && valid; type++)
+		{
+			valid	   = indexHeader->NumEntries[type] <= available;
+			available -= valid ? indexHeader->NumEntries[type] : 0;
+		}
+
+		const kuSessionIndexEntry * entries = (const kuSessionIndexEntry *)(indexHeader + 1);
+		for (int type = 0; type < kuNumSessionChunkTypes && valid; type++)
+		{
+			m_Index[type]	   = entries;
+			m_NumEntries[type] = indexHeader->NumEntries[type];
+			entries			  += indexHeader->NumEntries[type];
+
+			for (uint64_t i = 0; i < m_NumEntries[type] && valid; i++)
+			{
+				valid = this->IsChunkValid(type, m_Index[type][i].Offset);
+			}
+		}
+
+		if (!valid)
+		{
+			std::cout << "Session: " << path << " has an index pointing at missing or damaged chunks." << std::endl;
+			this->Close();
+			return false;
+		}
+	}
+	else if (!RebuildIndex())
+	{
+		this->Close();
+		return false;
+	}
+	else
+	{
+		std::cout << "Session: " << path << " was not closed, rebuilt the index from the chunks." << std::endl;
+	}
+
+	return true;
+}
+
+bool kuSessionReader::RebuildIndex()
+{
+	KU_PROFILE_ZONE("rebuild session index");
+
+	uint64_t offset = kuSessionPageSize;
+	while (offset + sizeof(kuSessionChunkHeader) <= m_File.GetSize())
+	{
+		const kuSessionChunkHeader * chunk = (const kuSessionChunkHeader *)(m_File.GetData() + offset);
+		if (chunk->Type >= kuNumSessionChunkTypes || !this->IsChunkValid(chunk->Type, offset))
+		{
+			break;													// Torn last chunk
+		}
+		uint64_t end = offset + sizeof(kuSessionChunkHeader) + chunk->PayloadSize;
+
+		if (chunk->Type != kuSessionChunk_Padding)
+		{
+			kuSessionIndexEntry entry;
+			entry.Offset	= offset;
+			entry.Timestamp = chunk->Timestamp;
+			m_RebuiltIndex[chunk->Type].push_back(entry);
+		}
+
+		offset = AlignUp(end, kuSessionChunkAlignment);
+	}
+
+	for (int type = 0; type < kuNumSessionChunkTypes; type++)
+	{
+		m_Index[type]	   = m_RebuiltIndex[type].data();
+		m_NumEntries[type] = m_RebuiltIndex[type].size();
+	}
+
+	return true;
+}
+
+bool kuSessionReader::IsChunkValid(uint32_t type, uint64_t offset)
+{
+	uint64_t fileSize = m_File.GetSize();
+	if (offset < kuSessionPageSize || offset > fileSize || fileSize - offset < sizeof(kuSessionChunkHeader))
+	{
+		return false;
+	}
+
+	const kuSessionChunkHeader * chunk		 = (const kuSessionChunkHeader *)(m_File.GetData() + offset);
+	uint64_t					 payloadSize = fileSize - offset - sizeof(kuSessionChunkHeader);
+	if (chunk->Type != type || chunk->PayloadSize > payloadSize)
+	{
+		return false;
+	}
+
+	if (type == kuSessionChunk_Poses)
+	{
+		return chunk->PayloadSize >= sizeof(kuSessionPoses);
+	}
+	if (type == kuSessionChunk_Camera)
+	{
+		if (chunk->PayloadSize < sizeof(kuSessionCameraFrame))
+		{
+			return false;
+		}
+
+		// Uncompressed images are read from the page after the chunk header, compressed ones follow the frame info
+		const kuSessionCameraFrame * info	   = (const kuSessionCameraFrame *)(chunk + 1);
+		uint64_t					 imageSize = (uint64_t)m_Header->Width * 2 * 4 * m_Header->Height;
+		if (chunk->Flags == 0)
+		{
+			return fileSize - offset >= kuSessionPageSize && fileSize - offset - kuSessionPageSize >= imageSize;
+		}
+		if (info->DataSize > chunk->PayloadSize - sizeof(kuSessionCameraFrame))
+		{
+			return false;
+		}
+		// Images that are not LZ4 compressed are copied whole
+		return (chunk->Flags & kuSessionChunkFlag_LZ4) || info->DataSize == imageSize;
+	}
+
+	return true;
+}
+
+void kuSessionReader::Close()
+{
+	m_File.Close();
+	m_Header = nullptr;
+
+	for (int type = 0; type < kuNumSessionChunkTypes; type++)
+	{
+		m_Index[type]	   = nullptr;
+		m_NumEntries[type] = 0;
+		m_RebuiltIndex[type].clear();
+	}
+	m_DecodeCache.clear();
+	m_DecodeCacheNext = 0;
+}
+
+bool kuSessionReader::IsOpen()
+{
+	return m_Header != nullptr;
+}
+
+const kuSessionHeader & kuSessionReader::GetHeader()
+{
+	return *m_Header;
+}
+
+uint64_t kuSessionReader::GetNumChunks(kuSessionChunkType type)
+{
+	return m_NumEntries[type];
+}
+
+const kuSessionChunkHeader * kuSessionReader::GetChunk(kuSessionChunkType type, uint64_t index)
+{
+	if (index >= m_NumEntries[type])
+	{
+		return nullptr;
+	}
+	return (const kuSessionChunkHeader *)(m_File.GetData() + m_Index[type][index].Offset);
+}
+
+uint64_t kuSessionReader::FindChunk(kuSessionChunkType type, uint64_t timestamp)
+{
+	const kuSessionIndexEntry * entries = m_Index[type];
+
+	uint64_t lo = 0, hi = m_NumEntries[type];
+	while (hi - lo > 1)
+	{
+		uint64_t mid = (lo + hi) / 2;
+		if (entries[mid].Timestamp <= timestamp)	lo = mid;
+		else										hi = mid;
+	}
+	return lo;
+}
+
+void kuSessionReader::PrefetchChunk(kuSessionChunkType type, uint64_t index)
+{
+	const kuSessionChunkHeader * chunk = GetChunk(type, index);
+	if (chunk)
+	{
+		m_File.Prefetch(m_Index[type][index].Offset, sizeof(kuSessionChunkHeader) + chunk->PayloadSize);
+	}
+}
+
+const kuSessionCameraFrame * kuSessionReader::GetCameraFrame(uint64_t index, const uint8_t ** pixels, uint32_t * flags)
+{
+	const kuSessionChunkHeader * chunk = GetChunk(kuSessionChunk_Camera, index);
+	if (!chunk)
+	{
+		return nullptr;
+	}
+
+	if (pixels)
+	{
+		*pixels = chunk->Flags ? nullptr : (const uint8_t *)chunk + kuSessionPageSize;
+	}
+	if (flags)
+	{
+		*flags = chunk->Flags;
+	}
+	return (const kuSessionCameraFrame *)(chunk + 1);
+}
+
+bool kuSessionReader::IsCameraCompressed()
+{
+	// Not decided by a frame, an incompressible key frame is stored raw in a compressed session
+	return m_Header && (m_Header->Flags & kuSessionFlag_CameraCompressed) != 0;
+}
+
+const uint8_t * kuSessionReader::FindDecoded(uint64_t index)
+{
+	for (size_t i = 0; i < m_DecodeCache.size(); i++)
+	{
+		if (m_DecodeCache[i].Index == index)
+		{
+			return m_DecodeCache[i].Image.data();
+		}
+	}
+	return nullptr;
+}
+
+bool kuSessionReader::DecodePayload(uint64_t index, uint8_t * dst)
+{
+	uint32_t					 flags;
+	const kuSessionCameraFrame * info	   = GetCameraFrame(index, nullptr, &flags);
+	const uint8_t			   * data	   = (const uint8_t *)(info + 1);
+	size_t						 imageSize = (size_t)m_Header->Width * 2 * 4 * m_Header->Height;
+
+	if (!(flags & kuSessionChunkFlag_LZ4))
+	{
+		if (flags && info->DataSize != imageSize)
+		{
+			std::cout << "Session: camera frame " << index << " is corrupt." << std::endl;
+			return false;
+		}
+		memcpy(dst, flags ? data : (const uint8_t *)GetChunk(kuSessionChunk_Camera, index) + kuSessionPageSize, imageSize);
+		return true;
+	}
+	if (!kuLZ4Decompress(data, (size_t)info->DataSize, dst, imageSize))
+	{
+		std::cout << "Session: camera frame " << index << " is corrupt." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool kuSessionReader::DecodeCameraFrame(uint64_t index, uint8_t * dst)
+{
+	KU_PROFILE_ZONE("decode camera frame");
+
+	if (index >= m_NumEntries[kuSessionChunk_Camera])
+	{
+		return false;
+	}
+
+	// Walk the delta references back to a frame that is decoded already or stored whole
+	std::vector<uint64_t> chain(1, index);
+	const uint8_t		* base = nullptr;
+	for (;;)
+	{
+		uint32_t					 flags;
+		const kuSessionCameraFrame * info = GetCameraFrame(chain.back(), nullptr, &flags);
+		if (!(flags & kuSessionChunkFlag_Delta))
+		{
+			break;
+		}
+		if (info->ReferenceFrame >= chain.back())
+		{
+			return false;
+		}
+		if ((base = FindDecoded(info->ReferenceFrame)) != nullptr)
+		{
+			break;
+		}
+		chain.push_back(info->ReferenceFrame);
+	}
+
+	// Then forward again: every delta is added onto the frame before it in the chain
+	size_t imageSize = (size_t)m_Header->Width * 2 * 4 * m_Header->Height;
+	m_DecodeScratch.resize(imageSize);
+	for (size_t i = chain.size(); i-- > 0;)
+	{
+		if (i == chain.size() - 1)
+		{
+			if (!DecodePayload(chain[i], dst))
+			{
+				return false;
+			}
+			if (base)
+			{
+				kuAddDelta(dst, base, imageSize);
+			}
+		}
+		else
+		{
+			if (!DecodePayload(chain[i], m_DecodeScratch.data()))
+			{
+				return false;
+			}
+			kuAddDelta(dst, m_DecodeScratch.data(), imageSize);
+		}
+
+		// Kept round robin as reference for the frames that follow
+		if (m_DecodeCache.size() < kuSessionDecodeCacheSize)
+		{
+			m_DecodeCache.push_back(DecodedFrame());
+		}
+		DecodedFrame & cached = m_DecodeCache[m_DecodeCacheNext];
+		cached.Index = chain[i];
+		cached.Image.assign(dst, dst + imageSize);
+		m_DecodeCacheNext = (m_DecodeCacheNext + 1) % kuSessionDecodeCacheSize;
+	}
+
+	return true;
+}
+
+const kuSessionPoses * kuSessionReader::GetPoses(uint64_t index)
+{
+	const kuSessionChunkHeader * chunk = GetChunk(kuSessionChunk_Poses, index);
+	return chunk ? (const kuSessionPoses *)(chunk + 1) : nullptr;
+}
+#pragma endregion
@@ -0,0 +1,185 @@
+#ifndef KU_SESSIONFILE_H
+#define KU_SESSIONFILE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <OpenVR.h>
+
+#include "kuStereoSource.h"
+#include "kuMappedFile.h"
+#include "kuDirectFile.h"
+
+// Session file: everything needed to replay a run of the application.
+//
+//   page 0          kuSessionHeader
+//   chunks          kuSessionChunkHeader + payload, 64 byte aligned, in recording order
+//   index           kuSessionIndexHeader + kuSessionIndexEntry per chunk, grouped by type
+//
+// Camera chunks hold the side-by-side 8UC4 image. Uncompressed ones start on a page
+// boundary with the frame info filling the first page and the image on the next, so
+// they can be used straight from a memory mapping. Compressed ones follow their frame
+// info directly. The index is written on close; a session that was not closed is
+// re-indexed by walking the chunk headers.
+enum kuSessionChunkType
+{
+	kuSessionChunk_Padding = 0,								// Filler up to the next camera chunk
+	kuSessionChunk_Camera,									// kuSessionCameraFrame + image
+	kuSessionChunk_Poses,									// kuSessionPoses
+	kuNumSessionChunkTypes
+};
+
+// Session flags
+enum kuSessionFlags
+{
+	kuSessionFlag_CameraCompressed = 1 << 0,					// Camera chunks may be compressed, set for the whole recording
+};
+
+// Camera chunk flags
+enum kuSessionChunkFlags
+{
+	kuSessionChunkFlag_LZ4	 = 1 << 0,							// Image is kuLZ4 compressed
+	kuSessionChunkFlag_Delta = 1 << 1,							// Image is the byte-wise difference to ReferenceFrame
+};
+
+static const uint32_t	kuSessionVersion		= 3;
+static const uint32_t	kuSessionPageSize		= 4096;
+static const uint32_t	kuSessionChunkAlignment	= 64;
+
+struct kuSessionHeader {
+	char				Magic[8];							// "KUSESSN"
+	uint32_t			Version;
+	uint32_t			PageSize;
+	uint32_t			Flags;								// kuSessionFlags
+	uint32_t			Reserved;
+	uint64_t			IndexOffset;						// 0 while recording
+	uint64_t			NumChunks[kuNumSessionChunkTypes];
+	uint64_t			StartTime;							// kuGetTimeNs() when recording started
+	double				FrameRate;							// Nominal camera rate
+	int32_t				Width;								// Camera image size per eye
+	int32_t				Height;
+	kuStereoCalibration	Calibration;
+};
+
+struct kuSessionChunkHeader {
+	uint32_t			Type;								// kuSessionChunkType
+	uint32_t			Flags;
+	uint64_t			PayloadSize;						// Bytes following this header
+	uint64_t			Timestamp;							// kuGetTimeNs() clock
+	uint64_t			Reserved;
+};
+
+struct kuSessionCameraFrame {
+	uint64_t			SequenceNumber;
+	uint64_t			CaptureTimestamp;
+	uint64_t			ExposureTimestamp;
+	uint64_t			HostTimestamp;
+	uint64_t			DataSize;							// Stored image bytes
+	uint64_t			ReferenceFrame;						// Delta frames: camera chunk number the image is relative to
+};
+
+struct kuSessionPoses {
+	uint64_t				FrameIndex;						// HMD frame
+	uint64_t				PhotonTime;						// Time the render poses are predicted to
+	vr::TrackedDevicePose_t	Poses[vr::k_unMaxTrackedDeviceCount];
+};
+
+struct kuSessionIndexHeader {
+	char				Magic[8];							// "KUINDEX"
+	uint64_t			NumEntries[kuNumSessionChunkTypes];	// Padding chunks are not indexed
+};
+
+struct kuSessionIndexEntry {
+	uint64_t			Offset;								// Of the chunk header
+	uint64_t			Timestamp;
+};
+
+// Byte-wise frame difference for kuSessionChunkFlag_Delta, dst = image - reference and its inverse
+void	kuSubtractDelta(uint8_t * dst, const uint8_t * image, const uint8_t * reference, size_t size);
+void	kuAddDelta(uint8_t * image, const uint8_t * reference, size_t size);
+
+// Appends chunks to a session file through unbuffered block writes. Single threaded,
+// kuSessionRecorder feeds it from its writer thread.
+class kuSessionWriter
+{
+public:
+	kuSessionWriter();
+	~kuSessionWriter();
+
+	bool			Open(const char * path, int width, int height, double frameRate, const kuStereoCalibration & calibration,
+						 uint32_t flags = 0, size_t writeBlockSize = 8 << 20);
+	void			Close();
+	bool			IsOpen();
+
+	// image is the side-by-side frame as described by flags, info.DataSize bytes
+	bool			WriteCameraFrame(const kuSessionCameraFrame & info, uint32_t flags, const uint8_t * image);
+	bool			WritePoses(uint64_t timestamp, uint64_t frameIndex, uint64_t photonTime, const vr::TrackedDevicePose_t * poses);
+
+	uint64_t		GetNumBytesWritten();
+	kuDirectFile &	GetFile();
+
+private:
+	kuDirectFile						m_File;
+	std::string							m_Path;
+	kuSessionHeader						m_Header;
+	std::vector<kuSessionIndexEntry>	m_Index[kuNumSessionChunkTypes];
+
+	bool			WriteChunk(kuSessionChunkType type, uint32_t flags, uint64_t timestamp, uint64_t payloadSize,
+							   const void * part0, uint64_t size0, const void * part1 = nullptr, uint64_t size1 = 0);
+	bool			WritePadding(uint64_t alignment);
+};
+
+// Memory-mapped, read-only view of a session. Chunks are addressed by type and
+// number through the index, O(1), and returned as pointers into the mapping.
+// Compressed camera frames need DecodeCameraFrame(), which keeps the last few decoded
+// frames as delta references and is therefore not thread safe.
+class kuSessionReader
+{
+public:
+	kuSessionReader();
+	~kuSessionReader();
+
+	bool							Open(const char * path);
+	void							Close();
+	bool							IsOpen();
+
+	const kuSessionHeader		&	GetHeader();
+	uint64_t						GetNumChunks(kuSessionChunkType type);
+	const kuSessionChunkHeader	*	GetChunk(kuSessionChunkType type, uint64_t index);
+	// Last chunk of the type at or before timestamp (0 if none is)
+	uint64_t						FindChunk(kuSessionChunkType type, uint64_t timestamp);
+	void							PrefetchChunk(kuSessionChunkType type, uint64_t index);
+
+	// pixels is only set for uncompressed frames
+	const kuSessionCameraFrame	*	GetCameraFrame(uint64_t index, const uint8_t ** pixels = nullptr, uint32_t * flags = nullptr);
+	const kuSessionPoses		*	GetPoses(uint64_t index);
+	// kuSessionFlag_CameraCompressed, individual frames may still be stored raw
+	bool							IsCameraCompressed();
+	// Side-by-side image of any camera frame into dst (2 * Width * 4 * Height bytes)
+	bool							DecodeCameraFrame(uint64_t index, uint8_t * dst);
+
+private:
+	struct DecodedFrame {
+		uint64_t				Index;
+		std::vector<uint8_t>	Image;
+	};
+
+	kuMappedFile						m_File;
+	const kuSessionHeader			*	m_Header;
+	const kuSessionIndexEntry		*	m_Index[kuNumSessionChunkTypes];
+	uint64_t							m_NumEntries[kuNumSessionChunkTypes];
+	std::vector<kuSessionIndexEntry>	m_RebuiltIndex[kuNumSessionChunkTypes];
+	std::vector<DecodedFrame>			m_DecodeCache;
+	size_t								m_DecodeCacheNext;
+	std::vector<uint8_t>				m_DecodeScratch;
+
+	bool			RebuildIndex();
+	// Chunk header, payload and (camera chunks) image lie inside the file, raw images are full size
+	bool			IsChunkValid(uint32_t type, uint64_t offset);
+	const uint8_t *	FindDecoded(uint64_t index);
+	bool			DecodePayload(uint64_t index, uint8_t * dst);
+};
+
+#endif // !KU_SESSIONFILE_H
@@ -0,0 +1,376 @@
+#include "kuSessionRecorder.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "kuLZ4.h"
+#include "kuTrace.h"
+
+kuSessionRecorder::kuSessionRecorder(const kuSessionRecorderConfig & config)
+	: m_Config(config), m_Width(0), m_Height(0), m_ImageSize(0), m_fStopping(false), m_fOpen(false),
+	  m_NextSequence(0), m_NextWrite(0), m_NumFrames(0), m_NumDroppedFrames(0), m_NumPoses(0), m_NumDroppedPoses(0),
+	  m_RawBytes(0), m_StoredBytes(0), m_TotalEncodeTime(0.0), m_MaxSubmitTime(0.0), m_StartTime(0), m_StopTime(0)
+{
+	m_Config.NumSlots		  = std::max(m_Config.NumSlots, 1);
+	m_Config.NumWorkers		  = std::max(m_Config.NumWorkers, 0);
+	m_Config.KeyframeInterval = std::max(m_Config.KeyframeInterval, 1);
+}
+
+kuSessionRecorder::~kuSessionRecorder()
+{
+	this->Close();
+}
+
+bool kuSessionRecorder::Open(const char * path, int width, int height, double frameRate, const kuStereoCalibration & calibration)
+{
+	this->Close();
+
+	uint32_t flags = m_Config.NumWorkers ? kuSessionFlag_CameraCompressed : 0;
+	if (!m_Writer.Open(path, width, height, frameRate, calibration, flags, m_Config.WriteBlockSize))
+	{
+		return false;
+	}
+
+	m_Width		= width;
+	m_Height	= height;
+	m_ImageSize = (size_t)width * 2 * 4 * height;
+
+	// Everything is allocated here, submitting and encoding never allocate
+	m_Slots.resize(m_Config.NumSlots);
+	for (size_t i = 0; i < m_Slots.size(); i++)
+	{
+		m_Slots[i].State = Slot_Free;
+		m_Slots[i].Image.resize(m_ImageSize);
+		m_Slots[i].Encoded.resize(m_Config.NumWorkers ? kuLZ4CompressBound(m_ImageSize) : 0);
+	}
+	m_PoseQueue.clear();
+	m_PoseQueue.reserve(m_Config.MaxQueuedPoses);
+	m_PoseWriteQueue.clear();
+	m_PoseWriteQueue.reserve(m_Config.MaxQueuedPoses);
+
+	m_fStopping		   = false;
+	m_NextSequence	   = 0;
+	m_NextWrite		   = 0;
+	m_NumFrames		   = 0;
+	m_NumDroppedFrames = 0;
+	m_NumPoses		   = 0;
+	m_NumDroppedPoses  = 0;
+	m_RawBytes		   = 0;
+	m_StoredBytes	   = 0;
+	m_TotalEncodeTime  = 0.0;
+	m_MaxSubmitTime	   = 0.0;
+	m_StartTime		   = kuGetTimeNs();
+
+	m_Workers.clear();
+	m_Workers.resize(m_Config.NumWorkers);
+	for (int i = 0; i < m_Config.NumWorkers; i++)
+	{
+		Worker & worker = m_Workers[i];
+		worker.Reference.resize(m_Config.Delta ? m_ImageSize : 0);
+		worker.Delta.resize(m_Config.Delta ? m_ImageSize : 0);
+		worker.NextSequence	 = i;
+		worker.LastSequence	 = 0;
+		worker.SinceKeyframe = 0;
+	}
+
+	m_fOpen = true;
+	for (int i = 0; i < m_Config.NumWorkers; i++)
+	{
+		m_Workers[i].Thread = std::thread(&kuSessionRecorder::WorkerLoop, this, i);
+	}
+	m_WriterThread = std::thread(&kuSessionRecorder::WriterLoop, this);
+
+	return true;
+}
+
+void kuSessionRecorder::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_fOpen)
+		{
+			return;
+		}
+		m_fStopping = true;
+	}
+	m_WorkAvailable.notify_all();
+	m_WriteAvailable.notify_all();
+
+	for (size_t i = 0; i < m_Workers.size(); i++)
+	{
+		m_Workers[i].Thread.join();
+	}
+	m_WriterThread.join();
+
+	m_Writer.Close();
+	m_StopTime = kuGetTimeNs();
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_fOpen = false;
+}
+
+bool kuSessionRecorder::IsOpen()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_fOpen && !m_fStopping;
+}
+
+kuSessionRecorder::Slot * kuSessionRecorder::FindSlot(uint64_t sequence, SlotState state)
+{
+	for (size_t i = 0; i < m_Slots.size(); i++)
+	{
+		if (m_Slots[i].State == state && (state == Slot_Free || m_Slots[i].Sequence == sequence))
+		{
+			return &m_Slots[i];
+		}
+	}
+	return nullptr;
+}
+
+bool kuSessionRecorder::SubmitCameraFrame(const kuStereoFrame & frame)
+{
+	KU_PROFILE_ZONE("submit camera frame");
+
+	uint64_t start = kuGetTimeNs();
+	Slot   * slot;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_fOpen || m_fStopping)
+		{
+			return false;
+		}
+
+		slot = FindSlot(0, Slot_Free);
+		if (!slot)
+		{
+			m_NumDroppedFrames++;
+			return false;
+		}
+		slot->State	   = Slot_Filling;
+		slot->Sequence = m_NextSequence++;
+	}
+
+	// Copied outside the lock, always stored side by side
+	uint8_t * pixels   = slot->Image.data();
+	size_t	  rowBytes = (size_t)m_Width * 4;
+	for (int row = 0; row < m_Height; row++)
+	{
+		uint8_t * dst = pixels + row * 2 * rowBytes;
+		if (frame.SideBySide)
+		{
+			memcpy(dst, frame.Image[0].ptr(row), 2 * rowBytes);
+		}
+		else
+		{
+			memcpy(dst, frame.Image[0].ptr(row), rowBytes);
+			memcpy(dst + rowBytes, frame.Image[1].ptr(row), rowBytes);
+		}
+	}
+
+	memset(&slot->Info, 0, sizeof(slot->Info));
+	slot->Info.SequenceNumber	 = slot->Sequence + 1;
+	slot->Info.CaptureTimestamp	 = frame.CaptureTimestamp;
+	slot->Info.ExposureTimestamp = frame.ExposureTimestamp;
+	slot->Info.HostTimestamp	 = frame.HostTimestamp;
+	slot->Info.DataSize			 = m_ImageSize;
+	slot->Flags					 = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		slot->State		= Slot_Queued;
+		m_MaxSubmitTime = std::max(m_MaxSubmitTime, (kuGetTimeNs() - start) * 1e-6);
+	}
+	if (m_Config.NumWorkers)
+	{
+		m_WorkAvailable.notify_all();
+	}
+	else
+	{
+		m_WriteAvailable.notify_one();
+	}
+
+	m_NumFrames++;
+	return true;
+}
+
+bool kuSessionRecorder::SubmitPoses(uint64_t frameIndex, uint64_t photonTime, const vr::TrackedDevicePose_t * poses)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_fOpen || m_fStopping)
+		{
+			return false;
+		}
+		if ((int)m_PoseQueue.size() >= m_Config.MaxQueuedPoses)
+		{
+			m_NumDroppedPoses++;
+			return false;
+		}
+
+		m_PoseQueue.resize(m_PoseQueue.size() + 1);
+		QueuedPoses & queued = m_PoseQueue.back();
+		queued.Time				  = kuGetTimeNs();
+		queued.Poses.FrameIndex	  = frameIndex;
+		queued.Poses.PhotonTime	  = photonTime;
+		memcpy(queued.Poses.Poses, poses, sizeof(queued.Poses.Poses));
+	}
+	m_WriteAvailable.notify_one();
+
+	m_NumPoses++;
+	return true;
+}
+
+void kuSessionRecorder::Encode(Worker & worker, Slot & slot)
+{
+	// Key frames restart the delta chain so a seek never has to decode more than KeyframeInterval frames
+	bool			isKeyframe = !m_Config.Delta || worker.SinceKeyframe == 0;
+	const uint8_t * src		   = slot.Image.data();
+	uint32_t		flags	   = 0;
+	if (!isKeyframe)
+	{
+		kuSubtractDelta(worker.Delta.data(), slot.Image.data(), worker.Reference.data(), m_ImageSize);
+		src						 = worker.Delta.data();
+		flags					|= kuSessionChunkFlag_Delta;
+		slot.Info.ReferenceFrame = worker.LastSequence;
+	}
+
+	size_t size = kuLZ4Compress(src, m_ImageSize, slot.Encoded.data(), slot.Encoded.size());
+	if (size && size < m_ImageSize)
+	{
+		flags |= kuSessionChunkFlag_LZ4;
+	}
+	else
+	{
+		// Incompressible, stored as is
+		if (src != slot.Image.data())
+		{
+			memcpy(slot.Encoded.data(), src, m_ImageSize);
+		}
+		size = m_ImageSize;
+	}
+	slot.Info.DataSize = size;
+	slot.Flags		   = flags;
+
+	// This frame is the reference for the worker's next one. The slot gets the old reference
+	// buffer back unless the writer still needs the uncompressed image.
+	if (m_Config.Delta)
+	{
+		if (flags)
+		{
+			std::swap(worker.Reference, slot.Image);
+		}
+		else
+		{
+			memcpy(worker.Reference.data(), slot.Image.data(), m_ImageSize);
+		}
+		worker.LastSequence	 = slot.Sequence;
+		worker.SinceKeyframe = (worker.SinceKeyframe + 1) % m_Config.KeyframeInterval;
+	}
+}
+
+void kuSessionRecorder::WorkerLoop(int index)
+{
+	KU_PROFILE_THREAD_NAME("recorder worker");
+
+	Worker & worker = m_Workers[index];
+	for (;;)
+	{
+		Slot * slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WorkAvailable.wait(lock, [&] {
+				slot = FindSlot(worker.NextSequence, Slot_Queued);
+				return slot || (m_fStopping && worker.NextSequence >= m_NextSequence);
+			});
+			if (!slot)
+			{
+				break;
+			}
+			slot->State = Slot_Encoding;
+		}
+
+		uint64_t start = kuGetTimeNs();
+		{
+			KU_PROFILE_ZONE("encode camera frame");
+			Encode(worker, *slot);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			slot->State		   = Slot_Encoded;
+			m_TotalEncodeTime += (kuGetTimeNs() - start) * 1e-6;
+		}
+		m_WriteAvailable.notify_one();
+
+		worker.NextSequence += m_Config.NumWorkers;
+	}
+}
+
+void kuSessionRecorder::WriterLoop()
+{
+	KU_PROFILE_THREAD_NAME("recorder writer");
+
+	SlotState readyState = m_Config.NumWorkers ? Slot_Encoded : Slot_Queued;
+	for (;;)
+	{
+		Slot * slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WriteAvailable.wait(lock, [&] {
+				slot = FindSlot(m_NextWrite, readyState);
+				return slot || !m_PoseQueue.empty() || (m_fStopping && m_NextWrite >= m_NextSequence);
+			});
+			if (!slot && m_PoseQueue.empty())
+			{
+				break;
+			}
+			m_PoseWriteQueue.swap(m_PoseQueue);
+		}
+
+		KU_PROFILE_ZONE("write session chunks");
+
+		for (size_t i = 0; i < m_PoseWriteQueue.size(); i++)
+		{
+			const QueuedPoses & queued = m_PoseWriteQueue[i];
+			m_Writer.WritePoses(queued.Time, queued.Poses.FrameIndex, queued.Poses.PhotonTime, queued.Poses.Poses);
+		}
+		m_PoseWriteQueue.clear();
+
+		// Camera chunks go out in submission order, so chunk number == sequence
+		if (slot)
+		{
+			m_Writer.WriteCameraFrame(slot->Info, slot->Flags, slot->Flags ? slot->Encoded.data() : slot->Image.data());
+			m_RawBytes	  += m_ImageSize;
+			m_StoredBytes += slot->Info.DataSize;
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			slot->State = Slot_Free;
+			m_NextWrite++;
+		}
+	}
+}
+
+void kuSessionRecorder::PrintStats()
+{
+	if (m_StartTime == 0)
+	{
+		return;
+	}
+
+	double duration = ((m_StopTime ? m_StopTime : kuGetTimeNs()) - m_StartTime) * 1e-9;
+	double writeTime = m_Writer.GetFile().GetWriteTime();
+
+	std::cout << "Session recorder: " << m_NumFrames << " frames (" << m_NumDroppedFrames << " dropped), "
+			  << m_NumPoses << " pose sets (" << m_NumDroppedPoses << " dropped) in " << duration << " s" << std::endl;
+	if (m_RawBytes)
+	{
+		std::cout << "  camera " << (m_RawBytes >> 20) << " MB -> " << (m_StoredBytes >> 20) << " MB ("
+				  << (double)m_RawBytes / m_StoredBytes << ":1), encode avg "
+				  << (m_Config.NumWorkers ? m_TotalEncodeTime / m_NumFrames : 0.0) << " ms/frame on " << m_Config.NumWorkers
+				  << " workers, submit max " << m_MaxSubmitTime << " ms" << std::endl;
+	}
+	std::cout << "  disk " << (m_Writer.GetNumBytesWritten() >> 20) << " MB in " << m_Writer.GetFile().GetNumBlocksWritten()
+			  << " blocks, " << (writeTime > 0.0 ? m_Writer.GetNumBytesWritten() / writeTime / (1 << 20) : 0.0) << " MB/s while writing ("
+			  << (m_Writer.GetFile().IsUnbuffered() ? "unbuffered" : "buffered") << ")" << std::endl;
+}
@@ -0,0 +1,113 @@
+#ifndef KU_SESSIONRECORDER_H
+#define KU_SESSIONRECORDER_H
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "kuSessionFile.h"
+
+struct kuSessionRecorderConfig {
+	int			NumSlots;											// Camera frames in flight, more are dropped
+	int			NumWorkers;											// Compression threads, 0 stores frames uncompressed
+	bool		Delta;												// Compress the difference to the worker's previous frame
+	int			KeyframeInterval;									// Delta: every Nth frame of a worker is stored whole
+	int			MaxQueuedPoses;										// Pose sets waiting for the writer, more are dropped
+	size_t		WriteBlockSize;										// Bytes per unbuffered write
+
+	kuSessionRecorderConfig() : NumSlots(8), NumWorkers(3), Delta(true), KeyframeInterval(30), MaxQueuedPoses(1024),
+								WriteBlockSize(8 << 20) {}
+};
+
+// Records a session without ever blocking the threads that feed it.
+// SubmitCameraFrame() copies the frame into a free slot, SubmitPoses() queues the pose
+// set; when no slot or queue entry is free the data is dropped and counted instead.
+// Worker threads compress the slots with kuLZ4, worker w takes frames w, w + N, w + 2N..
+// so each one can delta-encode against its own previous frame. A writer thread puts the
+// chunks out in submission order through kuSessionWriter.
+class kuSessionRecorder
+{
+public:
+	kuSessionRecorder(const kuSessionRecorderConfig & config = kuSessionRecorderConfig());
+	~kuSessionRecorder();
+
+	bool		Open(const char * path, int width, int height, double frameRate, const kuStereoCalibration & calibration);
+	// Writes out everything still queued, then the index
+	void		Close();
+	bool		IsOpen();
+
+	// Return false if the data was dropped
+	bool		SubmitCameraFrame(const kuStereoFrame & frame);
+	bool		SubmitPoses(uint64_t frameIndex, uint64_t photonTime, const vr::TrackedDevicePose_t * poses);
+
+	void		PrintStats();
+
+private:
+	enum SlotState { Slot_Free, Slot_Filling, Slot_Queued, Slot_Encoding, Slot_Encoded };
+
+	struct Slot {
+		SlotState				State;
+		uint64_t				Sequence;							// Accepted frame number, equals the camera chunk number
+		kuSessionCameraFrame	Info;
+		uint32_t				Flags;
+		std::vector<uint8_t>	Image;								// Side by side
+		std::vector<uint8_t>	Encoded;
+	};
+
+	struct QueuedPoses {
+		uint64_t				Time;
+		kuSessionPoses			Poses;
+	};
+
+	struct Worker {
+		std::thread				Thread;
+		std::vector<uint8_t>	Reference;							// Previous frame of this worker
+		std::vector<uint8_t>	Delta;
+		uint64_t				NextSequence;
+		uint64_t				LastSequence;
+		int						SinceKeyframe;
+	};
+
+	kuSessionRecorderConfig		m_Config;
+	kuSessionWriter				m_Writer;
+	int							m_Width;
+	int							m_Height;
+	size_t						m_ImageSize;
+
+	std::mutex					m_Mutex;
+	std::condition_variable		m_WorkAvailable;
+	std::condition_variable		m_WriteAvailable;
+	bool						m_fStopping;
+	bool						m_fOpen;
+
+	std::vector<Slot>			m_Slots;
+	std::vector<Worker>			m_Workers;
+	std::vector<QueuedPoses>	m_PoseQueue;
+	std::vector<QueuedPoses>	m_PoseWriteQueue;					// Swapped with m_PoseQueue by the writer
+	std::thread					m_WriterThread;
+	uint64_t					m_NextSequence;						// Next accepted frame
+	uint64_t					m_NextWrite;						// Next frame for the writer
+
+	std::atomic<uint64_t>		m_NumFrames;
+	std::atomic<uint64_t>		m_NumDroppedFrames;
+	std::atomic<uint64_t>		m_NumPoses;
+	std::atomic<uint64_t>		m_NumDroppedPoses;
+	uint64_t					m_RawBytes;
+	uint64_t					m_StoredBytes;
+	double						m_TotalEncodeTime;					// ms, summed over workers
+	double						m_MaxSubmitTime;					// ms
+	uint64_t					m_StartTime;
+	uint64_t					m_StopTime;
+
+	Slot	*	FindSlot(uint64_t sequence, SlotState state);
+	void		WorkerLoop(int index);
+	void		WriterLoop();
+	void		Encode(Worker & worker, Slot & slot);
+};
+
+#endif // !KU_SESSIONRECORDER_H
@@ -1,12 +1,18 @@
 #include "kuShaderHandler.h"
 
+#include <string.h>
+
+#include "kuTrace.h"
+
 
 
 kuShaderHandler::kuShaderHandler()
+	: m_ShaderProgramID(0), m_fShaderCreated(false), m_NumSets(0), m_NumSkipped(0)
 {
 }
 
 kuShaderHandler::kuShaderHandler(const char * VSPathName, const char * FSPathName)
+	: m_ShaderProgramID(0), m_fShaderCreated(false), m_NumSets(0), m_NumSkipped(0)
 {
 	this->Load(VSPathName, FSPathName);
 }
@@ -18,6 +24,8 @@ kuShaderHandler::~kuShaderHandler()
 
 bool kuShaderHandler::Load(const char * VSPathName, const char * FSPathName)
 {
+	KU_PROFILE_ZONE("kuShaderHandler::Load");
+
 	//#pragma region
 	GLuint vertexShader, fragmentShader;
 	GLint  success;
@@ -47,6 +55,7 @@ bool kuShaderHandler::Load(const char * VSPathName, const char * FSPathName)
 		glDeleteShader(fragmentShader);
 
 		m_fShaderCreated = true;
+		this->ReflectUniforms();
 	}
 
 	return m_fShaderCreated;
@@ -70,6 +79,199 @@ GLuint kuShaderHandler::GetShaderProgramID()
 	return this->m_ShaderProgramID;
 }
 
+void kuShaderHandler::Set(kuUniform<bool> uniform, bool value)
+{
+	GLint v = value ? 1 : 0;
+	if (this->UpdateValue(uniform.Index, &v, sizeof(v)))
+	{
+		glProgramUniform1i(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, v);
+	}
+}
+
+void kuShaderHandler::Set(kuUniform<int> uniform, int value)
+{
+	if (this->UpdateValue(uniform.Index, &value, sizeof(value)))
+	{
+		glProgramUniform1i(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, value);
+	}
+}
+
+void kuShaderHandler::Set(kuUniform<float> uniform, float value)
+{
+	if (this->UpdateValue(uniform.Index, &value, sizeof(value)))
+	{
+		glProgramUniform1f(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, value);
+	}
+}
+
+void kuShaderHandler::Set(kuUniform<glm::vec3> uniform, const glm::vec3 & value)
+{
+	GLfloat v[3] = { value.x, value.y, value.z };
+	if (this->UpdateValue(uniform.Index, v, sizeof(v)))
+	{
+		glProgramUniform3fv(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, 1, v);
+	}
+}
+
+void kuShaderHandler::Set(kuUniform<glm::vec4> uniform, const glm::vec4 & value)
+{
+	GLfloat v[4] = { value.x, value.y, value.z, value.w };
+	if (this->UpdateValue(uniform.Index, v, sizeof(v)))
+	{
+		glProgramUniform4fv(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, 1, v);
+	}
+}
+
+void kuShaderHandler::Set(kuUniform<glm::mat3> uniform, const glm::mat3 & value)
+{
+	GLfloat v[9];
+	for (int c = 0; c < 3; c++)
+	{
+		for (int r = 0; r < 3; r++)
+		{
+			v[3 * c + r] = value[c][r];
+		}
+	}
+	if (this->UpdateValue(uniform.Index, v, sizeof(v)))
+	{
+		glProgramUniformMatrix3fv(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, 1, GL_FALSE, v);
+	}
+}
+
+void kuShaderHandler::Set(kuUniform<glm::mat4> uniform, const glm::mat4 & value)
+{
+	GLfloat v[16];
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			v[4 * c + r] = value[c][r];
+		}
+	}
+	this->Set(uniform, v);
+}
+
+void kuShaderHandler::Set(kuUniform<glm::mat4> uniform, const GLfloat * value)
+{
+	if (this->UpdateValue(uniform.Index, value, 16 * sizeof(GLfloat)))
+	{
+		glProgramUniformMatrix4fv(m_ShaderProgramID, m_Uniforms[uniform.Index].Location, 1, GL_FALSE, value);
+	}
+}
+
+void kuShaderHandler::PrintStats(const char * name)
+{
+	if (m_NumSets == 0)
+	{
+		return;
+	}
+
+	std::cout << name << ": " << m_Uniforms.size() << " active uniforms, " << m_NumSets << " sets, "
+			  << 100.0 * m_NumSkipped / m_NumSets << " % skipped as redundant" << std::endl;
+}
+
+// Table of every active uniform, samplers and struct members ("material.ambient") included
+void kuShaderHandler::ReflectUniforms()
+{
+	m_Uniforms.clear();
+	m_UniformIndex.clear();
+
+	GLint numUniforms = 0, maxNameLength = 0;
+	glGetProgramiv(m_ShaderProgramID, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(m_ShaderProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<GLchar> name(maxNameLength + 1);
+	for (GLint i = 0; i < numUniforms; i++)
+	{
+		Uniform uniform;
+		GLsizei length = 0;
+		glGetActiveUniform(m_ShaderProgramID, (GLuint)i, (GLsizei)name.size(), &length, &uniform.Size, &uniform.Type, name.data());
+		uniform.Location	= glGetUniformLocation(m_ShaderProgramID, name.data());
+		uniform.fValueKnown = false;
+		if (uniform.Location < 0)
+		{
+			continue;													// Block member, set through its buffer
+		}
+
+		std::string key(name.data(), length);
+		m_UniformIndex[key] = (int)m_Uniforms.size();
+		if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+		{
+			m_UniformIndex[key.substr(0, key.size() - 3)] = (int)m_Uniforms.size();
+		}
+		m_Uniforms.push_back(uniform);
+	}
+}
+
+bool kuShaderHandler::BindUniformBlock(const char * name, GLuint binding, size_t size)
+{
+	if (!m_fShaderCreated)
+	{
+		return false;
+	}
+
+	GLuint blockIndex = glGetUniformBlockIndex(m_ShaderProgramID, name);
+	if (blockIndex == GL_INVALID_INDEX)
+	{
+		std::cout << "Shader: uniform block " << name << " not found" << std::endl;
+		return false;
+	}
+
+	// Drivers differ in whether they pad the reported size to a vec4, the C++ structs always are
+	GLint dataSize = 0;
+	glGetActiveUniformBlockiv(m_ShaderProgramID, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+	if (((size_t)dataSize + 15) / 16 * 16 != size)
+	{
+		std::cout << "Shader: uniform block " << name << " is " << dataSize << " B, expected " << size << " B" << std::endl;
+		return false;
+	}
+
+	glUniformBlockBinding(m_ShaderProgramID, blockIndex, binding);
+
+	return true;
+}
+
+int kuShaderHandler::FindUniform(const char * name, GLenum type)
+{
+	std::unordered_map<std::string, int>::const_iterator it = m_UniformIndex.find(name);
+	if (it == m_UniformIndex.end())
+	{
+		return -1;
+	}
+
+	// Samplers are set as int
+	GLenum actual = m_Uniforms[it->second].Type;
+	bool   isSampler = actual == GL_SAMPLER_1D || actual == GL_SAMPLER_2D || actual == GL_SAMPLER_3D || actual == GL_SAMPLER_CUBE ||
+					   actual == GL_SAMPLER_2D_RECT || actual == GL_SAMPLER_2D_ARRAY;
+	if (actual != type && !(type == GL_INT && isSampler))
+	{
+		std::cout << "Shader: uniform " << name << " is not of the requested type" << std::endl;
+		return -1;
+	}
+
+	return it->second;
+}
+
+bool kuShaderHandler::UpdateValue(int index, const void * value, size_t size)
+{
+	if (index < 0)
+	{
+		return false;
+	}
+
+	m_NumSets++;
+	Uniform & uniform = m_Uniforms[index];
+	if (uniform.fValueKnown && memcmp(uniform.Value, value, size) == 0)
+	{
+		m_NumSkipped++;
+		return false;
+	}
+
+	memcpy(uniform.Value, value, size);
+	uniform.fValueKnown = true;
+	return true;
+}
+
 bool kuShaderHandler::CreateShader(GLuint & shaderID, ShaderType shaderType, const char * shaderPathName)
 {
 	std::string		shaderCode;
@@ -6,7 +6,23 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
 #include <GLEW/glew.h>
+#include <GLM/glm.hpp>
+
+// Typed handle of an active uniform, an index into the program's uniform table. Resolve
+// once with kuShaderHandler::GetUniform, set with kuShaderHandler::Set. Invalid handles
+// (uniform optimised out or of another type) make Set a no-op.
+template <class T>
+struct kuUniform {
+	int		Index;
+
+	kuUniform() : Index(-1) {}
+	explicit kuUniform(int index) : Index(index) {}
+	bool	IsValid() const { return Index >= 0; }
+};
 
 class kuShaderHandler
 {
@@ -22,13 +38,61 @@ public:
 	bool	Use();
 	GLuint	GetShaderProgramID();
 
+	// Looks the name up in the table built at link time. Array uniforms answer to both
+	// "name" and "name[0]". Samplers are int uniforms.
+	template <class T>
+	kuUniform<T>	GetUniform(const char * name);
+
+	// Set through glProgramUniform*, so the program need not be in use. Calls repeating
+	// the value the uniform already has are skipped.
+	void	Set(kuUniform<bool> uniform, bool value);
+	void	Set(kuUniform<int> uniform, int value);
+	void	Set(kuUniform<float> uniform, float value);
+	void	Set(kuUniform<glm::vec3> uniform, const glm::vec3 & value);
+	void	Set(kuUniform<glm::vec4> uniform, const glm::vec4 & value);
+	void	Set(kuUniform<glm::mat3> uniform, const glm::mat3 & value);
+	void	Set(kuUniform<glm::mat4> uniform, const glm::mat4 & value);
+	void	Set(kuUniform<glm::mat4> uniform, const GLfloat * value);	// Column-major, e.g. Matrix4::get()
+
+	// Points the named uniform block at a binding point, checking that its std140 size
+	// matches the C++ struct filling it. False if the block is missing or mismatched.
+	bool	BindUniformBlock(const char * name, GLuint binding, size_t size);
+
+	void	PrintStats(const char * name);
+
 private:
+	// Active uniform from program introspection, with the value last set through this handler
+	struct Uniform {
+		GLint		Location;
+		GLenum		Type;
+		GLint		Size;
+		bool		fValueKnown;
+		GLfloat		Value[16];											// Raw bytes of the last value, int/bool included
+	};
 
 	GLuint	m_ShaderProgramID;
 	bool	m_fShaderCreated;
 
+	std::vector<Uniform>					m_Uniforms;
+	std::unordered_map<std::string, int>	m_UniformIndex;
+
+	uint64_t	m_NumSets;
+	uint64_t	m_NumSkipped;
+
+	void	ReflectUniforms();
+	int		FindUniform(const char * name, GLenum type);
+	bool	UpdateValue(int index, const void * value, size_t size);
+
 	bool	CreateShader(GLuint &shaderID, ShaderType shaderType, const char * shaderPath);
 	bool	CompileShader(GLuint shaderID, const GLchar * shaderCode);
 };
 
+template <> inline kuUniform<bool>		kuShaderHandler::GetUniform<bool>(const char * name)		{ return kuUniform<bool>(FindUniform(name, GL_BOOL)); }
+template <> inline kuUniform<int>		kuShaderHandler::GetUniform<int>(const char * name)			{ return kuUniform<int>(FindUniform(name, GL_INT)); }
+template <> inline kuUniform<float>		kuShaderHandler::GetUniform<float>(const char * name)		{ return kuUniform<float>(FindUniform(name, GL_FLOAT)); }
+template <> inline kuUniform<glm::vec3>	kuShaderHandler::GetUniform<glm::vec3>(const char * name)	{ return kuUniform<glm::vec3>(FindUniform(name, GL_FLOAT_VEC3)); }
+template <> inline kuUniform<glm::vec4>	kuShaderHandler::GetUniform<glm::vec4>(const char * name)	{ return kuUniform<glm::vec4>(FindUniform(name, GL_FLOAT_VEC4)); }
+template <> inline kuUniform<glm::mat3>	kuShaderHandler::GetUniform<glm::mat3>(const char * name)	{ return kuUniform<glm::mat3>(FindUniform(name, GL_FLOAT_MAT3)); }
+template <> inline kuUniform<glm::mat4>	kuShaderHandler::GetUniform<glm::mat4>(const char * name)	{ return kuUniform<glm::mat4>(FindUniform(name, GL_FLOAT_MAT4)); }
+
 #endif
\ No newline at end of file
@@ -0,0 +1,378 @@
+#include "kuStereoSource.h"
+
+#include <string.h>
+#include <cmath>
+#include <thread>
+#include <iostream>
+
+#include "kuSessionFile.h"
+#include "kuSessionRecorder.h"
+#include "kuTrace.h"
+
+static void SleepUntil(uint64_t timeNs)
+{
+	uint64_t now = kuGetTimeNs();
+	if (now < timeNs)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds(timeNs - now));
+	}
+}
+
+#pragma region // Synthetic //
+kuSyntheticStereoSource::kuSyntheticStereoSource(int width, int height, double fps, bool sideBySide)
+	: m_Width(width), m_Height(height), m_FPS(fps), m_fSideBySide(sideBySide), m_NextFrameTime(0), m_FrameCount(0)
+{
+	m_FrameIntervalNs = (uint64_t)(1e9 / fps);
+
+	// 90 degree horizontal field of view, 120 mm baseline like the ZED
+	memset(&m_Calibration, 0, sizeof(m_Calibration));
+	for (int eye = 0; eye < 2; eye++)
+	{
+		m_Calibration.Eye[eye].fx = 0.5f * width;
+		m_Calibration.Eye[eye].fy = 0.5f * width;
+		m_Calibration.Eye[eye].cx = 0.5f * (width - 1);
+		m_Calibration.Eye[eye].cy = 0.5f * (height - 1);
+	}
+	m_Calibration.Baseline = 120.0f;
+	m_Calibration.Width	   = width;
+	m_Calibration.Height   = height;
+}
+
+kuSyntheticStereoSource::~kuSyntheticStereoSource()
+{
+}
+
+bool kuSyntheticStereoSource::Open()
+{
+	m_NextFrameTime = 0;
+	m_FrameCount	= 0;
+
+	return true;
+}
+
+const char * kuSyntheticStereoSource::GetName()
+{
+	return "synthetic";
+}
+
+bool kuSyntheticStereoSource::Grab(kuStereoFrame & frame)
+{
+	// Pace like a real camera
+	uint64_t now = kuGetTimeNs();
+	if (m_NextFrameTime == 0)
+	{
+		m_NextFrameTime = now;
+	}
+	SleepUntil(m_NextFrameTime);
+	m_NextFrameTime += m_FrameIntervalNs;
+	KU_TIMELINE_CAM_STAMP(kuCamStamp_GrabEnd);
+
+	// Flat colour cycling with the frame count plus a vertical bar sweeping across,
+	// offset between eyes so a wrong eye assignment is easy to spot.
+	int barWidth = m_Width / 16;
+	for (int eye = 0; eye < 2; eye++)
+	{
+		cv::Mat eyeImage = m_fSideBySide ? frame.Image[0](cv::Rect(eye * m_Width, 0, m_Width, m_Height)) : frame.Image[eye];
+
+		uchar shade = (uchar)(m_FrameCount * 2 + eye * 64);
+		eyeImage.setTo(cv::Scalar(shade, 96, 255 - shade, 255));
+
+		int barX = (int)((m_FrameCount * 8 + eye * barWidth) % (m_Width - barWidth));
+		eyeImage(cv::Rect(barX, 0, barWidth, m_Height)).setTo(cv::Scalar(255, 255, 255, 255));
+	}
+
+	frame.CaptureTimestamp	= kuGetTimeNs();
+	frame.ExposureTimestamp = frame.CaptureTimestamp;
+	m_FrameCount++;
+
+	return true;
+}
+
+int kuSyntheticStereoSource::GetWidth()
+{
+	return m_Width;
+}
+
+int kuSyntheticStereoSource::GetHeight()
+{
+	return m_Height;
+}
+
+double kuSyntheticStereoSource::GetFrameRate()
+{
+	return m_FPS;
+}
+
+const kuStereoCalibration & kuSyntheticStereoSource::GetCalibration()
+{
+	return m_Calibration;
+}
+
+bool kuSyntheticStereoSource::IsSideBySide()
+{
+	return m_fSideBySide;
+}
+#pragma endregion
+
+#pragma region // Playback //
+kuPlaybackStereoSource::kuPlaybackStereoSource(const char * path, bool realTime, bool sideBySide)
+	: m_Path(path), m_Session(new kuSessionReader), m_NumFrames(0), m_fRealTime(realTime), m_fSideBySide(sideBySide),
+	  m_FrameIndex(0), m_StartTime(0), m_LoopDuration(0)
+{
+}
+
+kuPlaybackStereoSource::~kuPlaybackStereoSource()
+{
+	this->Close();
+	delete m_Session;
+}
+
+bool kuPlaybackStereoSource::Open()
+{
+	if (!m_Session->Open(m_Path.c_str()))
+	{
+		return false;
+	}
+
+	m_NumFrames = m_Session->GetNumChunks(kuSessionChunk_Camera);
+	if (m_NumFrames == 0)
+	{
+		std::cout << "Playback: " << m_Path << " has no camera frames." << std::endl;
+		this->Close();
+		return false;
+	}
+
+	// Also false for NaN, and keeps the frame interval below in range of uint64_t
+	const kuSessionHeader & header = m_Session->GetHeader();
+	if (!(header.FrameRate >= 1e-3))
+	{
+		std::cout << "Playback: " << m_Path << " has an invalid frame rate (" << header.FrameRate << ")." << std::endl;
+		this->Close();
+		return false;
+	}
+
+	// Loop length includes one frame interval so the first frame of the next pass is not shown early
+	m_LoopDuration = m_Session->GetCameraFrame(m_NumFrames - 1)->CaptureTimestamp - m_Session->GetCameraFrame(0)->CaptureTimestamp +
+					 (uint64_t)(1e9 / header.FrameRate);
+
+	m_FrameIndex = 0;
+	m_StartTime	 = 0;
+	m_Session->PrefetchChunk(kuSessionChunk_Camera, 0);
+
+	std::cout << "Playback: " << m_NumFrames << " frames " << header.Width << " x " << header.Height
+			  << " @ " << header.FrameRate << " Hz from " << m_Path << std::endl;
+
+	return true;
+}
+
+void kuPlaybackStereoSource::Close()
+{
+	m_Session->Close();
+	m_NumFrames = 0;
+}
+
+const char * kuPlaybackStereoSource::GetName()
+{
+	return "playback";
+}
+
+bool kuPlaybackStereoSource::Grab(kuStereoFrame & frame)
+{
+	uint64_t					 index = m_FrameIndex % m_NumFrames;
+	uint64_t					 loop  = m_FrameIndex / m_NumFrames;
+	const uint8_t			   * pixels;
+	const kuSessionCameraFrame * info  = m_Session->GetCameraFrame(index, &pixels);
+	const kuSessionCameraFrame * first = m_Session->GetCameraFrame(0);
+
+	if (m_StartTime == 0)
+	{
+		m_StartTime = kuGetTimeNs();
+	}
+
+	// Recorded frame spacing, shifted to the playback start
+	uint64_t presentTime = m_StartTime + loop * m_LoopDuration + (info->CaptureTimestamp - first->CaptureTimestamp);
+	if (m_fRealTime)
+	{
+		SleepUntil(presentTime);
+	}
+	KU_TIMELINE_CAM_STAMP(kuCamStamp_GrabEnd);
+
+	uchar * data   = (uchar *)pixels;
+	int		width  = m_Session->GetHeader().Width;
+	int		height = m_Session->GetHeader().Height;
+	size_t	step   = (size_t)width * 2 * 4;
+	if (!this->ProvidesImages())
+	{
+		// Compressed, decoded straight into a continuous side-by-side image, split per eye otherwise
+		if (m_fSideBySide && frame.Image[0].isContinuous())
+		{
+			m_Session->DecodeCameraFrame(index, frame.Image[0].data);
+		}
+		else
+		{
+			m_Decoded.resize(step * height);
+			m_Session->DecodeCameraFrame(index, m_Decoded.data());
+			cv::Mat decoded(height, 2 * width, CV_8UC4, m_Decoded.data(), step);
+			if (m_fSideBySide)
+			{
+				decoded.copyTo(frame.Image[0]);
+			}
+			else
+			{
+				decoded.colRange(0, width).copyTo(frame.Image[0]);
+				decoded.colRange(width, 2 * width).copyTo(frame.Image[1]);
+			}
+		}
+	}
+	else
+	{
+		if (!data)
+		{
+			// A compressed frame in a session recorded uncompressed. Decoded into an image owned by
+			// this frame, the slot may still hold a view into the read-only mapping.
+			frame.Image[0].release();
+			frame.Image[1].release();
+			frame.Image[0].create(height, 2 * width, CV_8UC4);
+			m_Session->DecodeCameraFrame(index, frame.Image[0].data);
+			if (!m_fSideBySide)
+			{
+				frame.Image[1] = frame.Image[0].colRange(width, 2 * width);
+				frame.Image[0] = frame.Image[0].colRange(0, width);
+			}
+		}
+		else if (m_fSideBySide)
+		{
+			// Views into the mapping, the side-by-side image serves per-eye consumers through its stride
+			frame.Image[0] = cv::Mat(height, 2 * width, CV_8UC4, data, step);
+			frame.Image[1].release();
+		}
+		else
+		{
+			frame.Image[0] = cv::Mat(height, width, CV_8UC4, data, step);
+			frame.Image[1] = cv::Mat(height, width, CV_8UC4, data + (size_t)width * 4, step);
+		}
+	}
+
+	frame.CaptureTimestamp	= info->CaptureTimestamp;
+	frame.ExposureTimestamp = m_fRealTime ? presentTime : kuGetTimeNs();
+
+	// Let the OS read the next frame ahead while this one is consumed
+	m_FrameIndex++;
+	m_Session->PrefetchChunk(kuSessionChunk_Camera, m_FrameIndex % m_NumFrames);
+
+	return true;
+}
+
+int kuPlaybackStereoSource::GetWidth()
+{
+	return m_Session->IsOpen() ? m_Session->GetHeader().Width : 0;
+}
+
+int kuPlaybackStereoSource::GetHeight()
+{
+	return m_Session->IsOpen() ? m_Session->GetHeader().Height : 0;
+}
+
+double kuPlaybackStereoSource::GetFrameRate()
+{
+	return m_Session->IsOpen() ? m_Session->GetHeader().FrameRate : 0.0;
+}
+
+const kuStereoCalibration & kuPlaybackStereoSource::GetCalibration()
+{
+	return m_Session->GetHeader().Calibration;
+}
+
+bool kuPlaybackStereoSource::IsSideBySide()
+{
+	return m_fSideBySide;
+}
+
+bool kuPlaybackStereoSource::ProvidesImages()
+{
+	return !m_Session->IsOpen() || !m_Session->IsCameraCompressed();
+}
+
+uint64_t kuPlaybackStereoSource::GetNumFrames()
+{
+	return m_NumFrames;
+}
+#pragma endregion
+
+#pragma region // Recording //
+kuRecordingStereoSource::kuRecordingStereoSource(kuStereoSource * source, kuSessionRecorder * recorder, const char * path)
+	: m_Source(source), m_Recorder(recorder), m_Path(path)
+{
+}
+
+kuRecordingStereoSource::~kuRecordingStereoSource()
+{
+	this->Close();
+	delete m_Source;
+}
+
+bool kuRecordingStereoSource::Open()
+{
+	if (!m_Source->Open())
+	{
+		return false;
+	}
+
+	return m_Recorder->Open(m_Path.c_str(), m_Source->GetWidth(), m_Source->GetHeight(), m_Source->GetFrameRate(),
+							m_Source->GetCalibration());
+}
+
+void kuRecordingStereoSource::Close()
+{
+	m_Recorder->Close();
+	m_Source->Close();
+}
+
+const char * kuRecordingStereoSource::GetName()
+{
+	return m_Source->GetName();
+}
+
+bool kuRecordingStereoSource::Grab(kuStereoFrame & frame)
+{
+	if (!m_Source->Grab(frame))
+	{
+		return false;
+	}
+
+	// Host time is only set by the capture thread after Grab()
+	frame.HostTimestamp = kuGetTimeNs();
+	m_Recorder->SubmitCameraFrame(frame);
+
+	return true;
+}
+int kuRecordingStereoSource::GetWidth()
+{
+	return m_Source->GetWidth();
+}
+
+int kuRecordingStereoSource::GetHeight()
+{
+	return m_Source->GetHeight();
+}
+
+double kuRecordingStereoSource::GetFrameRate()
+{
+	return m_Source->GetFrameRate();
+}
+
+const kuStereoCalibration & kuRecordingStereoSource::GetCalibration()
+{
+	return m_Source->GetCalibration();
+}
+
+bool kuRecordingStereoSource::IsSideBySide()
+{
+	return m_Source->IsSideBySide();
+}
+
+bool kuRecordingStereoSource::ProvidesImages()
+{
+	return m_Source->ProvidesImages();
+}
+#pragma endregion
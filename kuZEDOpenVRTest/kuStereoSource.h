@@ -0,0 +1,159 @@
+#ifndef KU_STEREOSOURCE_H
+#define KU_STEREOSOURCE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "kuClock.h"
+#include "kuFrameTimeline.h"
+
+class kuSessionReader;
+class kuSessionRecorder;
+
+struct kuStereoFrame {
+	cv::Mat			Image[2];				// 8UC4 left/right images, channel order as delivered by the source
+	bool			SideBySide;				// Both eyes packed in Image[0] (left | right), Image[1] unused
+	uint64_t		SequenceNumber;			// Starts from 1, 0 means the slot was never filled
+	uint64_t		CaptureTimestamp;		// Source timestamp (ns), camera clock for ZED
+	uint64_t		ExposureTimestamp;		// CaptureTimestamp in the kuGetTimeNs() clock
+	uint64_t		HostTimestamp;			// kuGetTimeNs() when the frame was completed
+
+	kuStereoFrame() : SideBySide(false), SequenceNumber(0), CaptureTimestamp(0), ExposureTimestamp(0), HostTimestamp(0) {}
+};
+
+// Pinhole intrinsics of both (rectified) cameras, plain data so it can be stored in recordings
+struct kuStereoCalibration {
+	struct Camera {
+		float	fx, fy;						// Focal length (pixel)
+		float	cx, cy;						// Principal point (pixel)
+		float	Distortion[5];				// k1, k2, p1, p2, k3, all zero for rectified images
+	}			Eye[2];
+	float		Baseline;					// Distance between the optical centres (mm)
+	int32_t		Width;						// Per-eye image size the intrinsics refer to
+	int32_t		Height;
+};
+
+// Anything that can produce stereo pairs for kuCaptureThread. Kept free of camera SDK
+// headers, SDK-backed sources live in their own files (kuZEDStereoSource.h).
+// Open() before the first Grab(). Grab() blocks until the next frame is ready and fills
+// the given frame. Images are preallocated to GetWidth() x GetHeight() 8UC4 by the caller
+// and may be written in place. Side-by-side sources get a single (2 * GetWidth()) x
+// GetHeight() image instead. Sources returning true from ProvidesImages() replace the
+// images with read-only views of their own memory, valid until the source is closed.
+class kuStereoSource
+{
+public:
+	virtual ~kuStereoSource() {}
+
+	virtual bool							Open() = 0;
+	virtual void							Close() {}
+	virtual const char					*	GetName() = 0;
+
+	virtual bool							Grab(kuStereoFrame & frame) = 0;
+	virtual int								GetWidth() = 0;
+	virtual int								GetHeight() = 0;
+	virtual double							GetFrameRate() = 0;
+	virtual const kuStereoCalibration	&	GetCalibration() = 0;
+	virtual bool							IsSideBySide() { return false; }
+	virtual bool							ProvidesImages() { return false; }
+};
+
+// Camera-less source producing a moving test pattern at any resolution and rate,
+// for load tests. Calibration is an ideal pinhole with a ZED-like field of view.
+class kuSyntheticStereoSource : public kuStereoSource
+{
+public:
+	kuSyntheticStereoSource(int width, int height, double fps, bool sideBySide = false);
+	~kuSyntheticStereoSource();
+
+	bool							Open();
+	const char					*	GetName();
+
+	bool							Grab(kuStereoFrame & frame);
+	int								GetWidth();
+	int								GetHeight();
+	double							GetFrameRate();
+	const kuStereoCalibration	&	GetCalibration();
+	bool							IsSideBySide();
+
+private:
+	kuStereoCalibration	m_Calibration;
+	int					m_Width;
+	int					m_Height;
+	double				m_FPS;
+	bool				m_fSideBySide;
+	uint64_t			m_FrameIntervalNs;
+	uint64_t			m_NextFrameTime;
+	uint64_t			m_FrameCount;
+};
+
+// Plays the camera frames of a recorded session back zero-copy: frames are views into
+// the mapped file. Compressed sessions are decoded into the caller's images instead.
+// Paced by the recorded timestamps, or as fast as the consumer grabs with realTime off.
+// Loops at the end of the session.
+class kuPlaybackStereoSource : public kuStereoSource
+{
+public:
+	kuPlaybackStereoSource(const char * path, bool realTime = true, bool sideBySide = false);
+	~kuPlaybackStereoSource();
+
+	bool							Open();
+	void							Close();
+	const char					*	GetName();
+
+	bool							Grab(kuStereoFrame & frame);
+	int								GetWidth();
+	int								GetHeight();
+	double							GetFrameRate();
+	const kuStereoCalibration	&	GetCalibration();
+	bool							IsSideBySide();
+	bool							ProvidesImages();
+
+	uint64_t						GetNumFrames();
+
+private:
+	std::string					m_Path;
+	kuSessionReader			*	m_Session;
+	uint64_t					m_NumFrames;
+	bool						m_fRealTime;
+	bool						m_fSideBySide;
+
+	uint64_t					m_FrameIndex;						// Frames played, keeps counting over loops
+	uint64_t					m_StartTime;
+	uint64_t					m_LoopDuration;						// ns, one pass through the session
+	std::vector<uint8_t>		m_Decoded;							// Side-by-side scratch for per-eye images
+};
+
+// Passes another source through and hands every grabbed frame to a session recorder.
+// Opens the recording with the source's format and calibration, closes it with the
+// source. Never blocks on the disk, frames the recorder cannot take are dropped.
+// Takes ownership of the wrapped source.
+class kuRecordingStereoSource : public kuStereoSource
+{
+public:
+	kuRecordingStereoSource(kuStereoSource * source, kuSessionRecorder * recorder, const char * path);
+	~kuRecordingStereoSource();
+
+	bool							Open();
+	void							Close();
+	const char					*	GetName();
+
+	bool							Grab(kuStereoFrame & frame);
+	int								GetWidth();
+	int								GetHeight();
+	double							GetFrameRate();
+	const kuStereoCalibration	&	GetCalibration();
+	bool							IsSideBySide();
+	bool							ProvidesImages();
+
+private:
+	kuStereoSource		*	m_Source;
+	kuSessionRecorder	*	m_Recorder;
+	std::string				m_Path;
+};
+
+#endif // !KU_STEREOSOURCE_H
@@ -0,0 +1,238 @@
+#include "kuStreamingTexture.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "kuClock.h"
+
+kuStreamingTexture::kuStreamingTexture()
+	: m_TextureID(0), m_Width(0), m_Height(0), m_Pitch(0), m_PixelFormat(GL_RGB), m_BufferSize(0),
+	  m_NumBuffers(0), m_CurrBuffer(0), m_fPersistent(false), m_fCreated(false)
+{
+	for (int i = 0; i < kuMaxStreamingBuffers; i++)
+	{
+		m_PBO[i]	   = 0;
+		m_Fence[i]	   = 0;
+		m_MappedPtr[i] = nullptr;
+	}
+	this->ResetStats();
+}
+
+kuStreamingTexture::~kuStreamingTexture()
+{
+}
+
+bool kuStreamingTexture::Create(int width, int height, GLenum internalFormat, GLenum pixelFormat, int bytesPerPixel, int numBuffers)
+{
+	if (m_fCreated)
+	{
+		this->Release();
+	}
+
+	m_Width		  = width;
+	m_Height	  = height;
+	m_Pitch		  = (width * bytesPerPixel + 3) & ~3;				// Matches the default GL_UNPACK_ALIGNMENT of 4
+	m_PixelFormat = pixelFormat;
+	m_BufferSize  = (GLsizeiptr)m_Pitch * height;
+	m_NumBuffers  = std::min(std::max(numBuffers, 1), kuMaxStreamingBuffers);
+	m_CurrBuffer  = 0;
+	m_fPersistent = GLEW_ARB_buffer_storage ? true : false;
+
+	glGenTextures(1, &m_TextureID);
+	glBindTexture(GL_TEXTURE_2D, m_TextureID);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Storage is allocated exactly once, uploads only ever replace the contents
+	if (GLEW_ARB_texture_storage)
+	{
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenBuffers(m_NumBuffers, m_PBO);
+	for (int i = 0; i < m_NumBuffers; i++)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO[i]);
+		if (m_fPersistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_BufferSize, nullptr, flags);
+			m_MappedPtr[i] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_BufferSize, flags);
+		}
+		else
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, m_BufferSize, nullptr, GL_STREAM_DRAW);
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_fCreated = true;
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+void kuStreamingTexture::Release()
+{
+	if (!m_fCreated)
+	{
+		return;
+	}
+
+	for (int i = 0; i < m_NumBuffers; i++)
+	{
+		if (m_Fence[i])
+		{
+			glDeleteSync(m_Fence[i]);
+			m_Fence[i] = 0;
+		}
+		if (m_MappedPtr[i])
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO[i]);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			m_MappedPtr[i] = nullptr;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glDeleteBuffers(m_NumBuffers, m_PBO);
+	glDeleteTextures(1, &m_TextureID);
+	m_TextureID = 0;
+
+	m_fCreated = false;
+}
+
+void * kuStreamingTexture::BeginUpload()
+{
+	m_BeginTime = kuGetTimeNs();
+
+	if (m_fPersistent)
+	{
+		// Only blocks if the GPU has not finished copying out of this slot yet,
+		// which with 3 slots means the GPU is more than 2 frames behind.
+		if (m_Fence[m_CurrBuffer])
+		{
+			GLenum waitRes = glClientWaitSync(m_Fence[m_CurrBuffer], 0, 0);
+			if (waitRes == GL_TIMEOUT_EXPIRED)
+			{
+				m_NumFenceStalls++;
+				glClientWaitSync(m_Fence[m_CurrBuffer], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			}
+			glDeleteSync(m_Fence[m_CurrBuffer]);
+			m_Fence[m_CurrBuffer] = 0;
+		}
+	}
+	else
+	{
+		// Orphan the old storage so mapping never waits on a pending copy
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO[m_CurrBuffer]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_BufferSize, nullptr, GL_STREAM_DRAW);
+		m_MappedPtr[m_CurrBuffer] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_BufferSize,
+													 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	double waitTime = (kuGetTimeNs() - m_BeginTime) * 1e-6;
+	m_TotalWaitTime += waitTime;
+	m_MaxWaitTime	 = std::max(m_MaxWaitTime, waitTime);
+
+	return m_MappedPtr[m_CurrBuffer];
+}
+
+void kuStreamingTexture::EndUpload()
+{
+	uint64_t submitBegin = kuGetTimeNs();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO[m_CurrBuffer]);
+	if (!m_fPersistent)
+	{
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		m_MappedPtr[m_CurrBuffer] = nullptr;
+	}
+
+	// Source is the bound PBO, the copy is queued and the call returns immediately
+	glBindTexture(GL_TEXTURE_2D, m_TextureID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Width, m_Height, m_PixelFormat, GL_UNSIGNED_BYTE, (GLvoid *)0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (m_fPersistent)
+	{
+		m_Fence[m_CurrBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	m_CurrBuffer = (m_CurrBuffer + 1) % m_NumBuffers;
+
+	uint64_t endTime	= kuGetTimeNs();
+	double	 submitTime = (endTime - submitBegin) * 1e-6;
+	m_TotalSubmitTime  += submitTime;
+	m_MaxSubmitTime		= std::max(m_MaxSubmitTime, submitTime);
+	m_NumUploads++;
+}
+
+void kuStreamingTexture::Upload(const void * pixels, size_t srcPitch)
+{
+	unsigned char		* dst	   = (unsigned char *)this->BeginUpload();
+	const unsigned char * src	   = (const unsigned char *)pixels;
+	size_t				  rowBytes = std::min((size_t)m_Pitch, srcPitch);
+
+	for (int row = 0; row < m_Height; row++)
+	{
+		memcpy(dst + row * m_Pitch, src + row * srcPitch, rowBytes);
+	}
+
+	this->EndUpload();
+}
+
+GLuint kuStreamingTexture::GetTextureID()
+{
+	return m_TextureID;
+}
+
+int kuStreamingTexture::GetWidth()
+{
+	return m_Width;
+}
+
+int kuStreamingTexture::GetHeight()
+{
+	return m_Height;
+}
+
+int kuStreamingTexture::GetPitch()
+{
+	return m_Pitch;
+}
+
+void kuStreamingTexture::PrintStats(const char * name)
+{
+	if (m_NumUploads == 0)
+	{
+		return;
+	}
+
+	std::cout << name << ": " << m_NumUploads << " uploads ("
+			  << (m_fPersistent ? "persistent" : "orphaned") << " PBO x" << m_NumBuffers << ")"
+			  << ", wait avg " << m_TotalWaitTime / m_NumUploads << " ms / max " << m_MaxWaitTime << " ms"
+			  << ", submit avg " << m_TotalSubmitTime / m_NumUploads << " ms / max " << m_MaxSubmitTime << " ms"
+			  << ", fence stalls " << m_NumFenceStalls << std::endl;
+}
+
+void kuStreamingTexture::ResetStats()
+{
+	m_NumUploads	  = 0;
+	m_NumFenceStalls  = 0;
+	m_TotalWaitTime	  = 0.0;
+	m_MaxWaitTime	  = 0.0;
+	m_TotalSubmitTime = 0.0;
+	m_MaxSubmitTime	  = 0.0;
+	m_BeginTime		  = 0;
+}
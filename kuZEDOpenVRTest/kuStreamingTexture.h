@@ -0,0 +1,65 @@
+#ifndef KU_STREAMINGTEXTURE_H
+#define KU_STREAMINGTEXTURE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <GLEW/glew.h>
+
+#define kuMaxStreamingBuffers	4
+
+// Texture with immutable storage allocated once, refreshed every frame through a ring
+// of pixel buffer objects. With ARB_buffer_storage the PBOs stay persistently mapped and
+// each slot is guarded by a fence, so the CPU writes the next frame while the GPU is
+// still copying the previous one. Without it the PBOs are orphaned and mapped per upload.
+class kuStreamingTexture
+{
+public:
+	kuStreamingTexture();
+	~kuStreamingTexture();
+
+	bool	Create(int width, int height, GLenum internalFormat, GLenum pixelFormat, int bytesPerPixel, int numBuffers = 3);
+	void	Release();
+
+	// Returns writable memory for the next frame, GetPitch() bytes per row.
+	// Write the frame straight into it, then call EndUpload().
+	void *	BeginUpload();
+	void	EndUpload();
+	// BeginUpload() + row copy + EndUpload() for frames that already sit in CPU memory
+	void	Upload(const void * pixels, size_t srcPitch);
+
+	GLuint	GetTextureID();
+	int		GetWidth();
+	int		GetHeight();
+	int		GetPitch();
+
+	void	PrintStats(const char * name);
+	void	ResetStats();
+
+private:
+	GLuint		m_TextureID;
+	GLuint		m_PBO[kuMaxStreamingBuffers];
+	GLsync		m_Fence[kuMaxStreamingBuffers];
+	void	*	m_MappedPtr[kuMaxStreamingBuffers];
+
+	int			m_Width;
+	int			m_Height;
+	int			m_Pitch;
+	GLenum		m_PixelFormat;
+	GLsizeiptr	m_BufferSize;
+	int			m_NumBuffers;
+	int			m_CurrBuffer;
+	bool		m_fPersistent;
+	bool		m_fCreated;
+
+	// Upload timing (CPU side, ms)
+	uint64_t	m_NumUploads;
+	uint64_t	m_NumFenceStalls;
+	double		m_TotalWaitTime;
+	double		m_MaxWaitTime;
+	double		m_TotalSubmitTime;
+	double		m_MaxSubmitTime;
+	uint64_t	m_BeginTime;
+};
+
+#endif // !KU_STREAMINGTEXTURE_H
@@ -0,0 +1,126 @@
+#include "kuTrace.h"
+
+#if KU_PROFILING
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <iostream>
+
+struct kuTraceZone {
+	const char	*	Name;
+	uint64_t		Begin;
+	uint64_t		End;
+};
+
+struct kuTraceThreadBuffer {
+	int						ThreadID;
+	std::string				Name;
+	kuTraceZone			*	Zones;
+	std::atomic<uint32_t>	NumZones;							// Published with release, so the writer may run concurrently
+	uint32_t				NumDropped;
+};
+
+// Buffers live until the process exits, so a trace can still be written after a thread ended
+static std::mutex							TraceMutex;
+static std::vector<kuTraceThreadBuffer *>	TraceBuffers;
+static const uint64_t						TraceStartTime = kuGetTimeNs();
+
+static thread_local kuTraceThreadBuffer	*	ThreadBuffer = nullptr;
+
+static kuTraceThreadBuffer * GetThreadBuffer()
+{
+	if (!ThreadBuffer)
+	{
+		kuTraceThreadBuffer * buffer = new kuTraceThreadBuffer;
+		buffer->Zones	   = new kuTraceZone[kuTraceMaxEventsPerThread];
+		buffer->NumZones   = 0;
+		buffer->NumDropped = 0;
+
+		std::lock_guard<std::mutex> lock(TraceMutex);
+		buffer->ThreadID = (int)TraceBuffers.size() + 1;
+		buffer->Name	 = buffer->ThreadID == 1 ? "main" : "thread " + std::to_string(buffer->ThreadID);
+		TraceBuffers.push_back(buffer);
+
+		ThreadBuffer = buffer;
+	}
+	return ThreadBuffer;
+}
+
+void kuTraceSetThreadName(const char * name)
+{
+	kuTraceThreadBuffer * buffer = GetThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(TraceMutex);
+	buffer->Name = name;
+}
+
+void kuTraceAddZone(const char * name, uint64_t beginNs, uint64_t endNs)
+{
+	kuTraceThreadBuffer * buffer = GetThreadBuffer();
+
+	uint32_t index = buffer->NumZones.load(std::memory_order_relaxed);
+	if (index == kuTraceMaxEventsPerThread)
+	{
+		buffer->NumDropped++;
+		return;
+	}
+
+	buffer->Zones[index].Name  = name;
+	buffer->Zones[index].Begin = beginNs;
+	buffer->Zones[index].End   = endNs;
+	buffer->NumZones.store(index + 1, std::memory_order_release);
+}
+
+bool kuTraceWrite(const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if (!file)
+	{
+		std::cout << "Trace: cannot open " << path << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(TraceMutex);
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"kuZEDOpenVRTest\"}}");
+
+	uint64_t numZones	= 0;
+	uint64_t numDropped = 0;
+	for (size_t t = 0; t < TraceBuffers.size(); t++)
+	{
+		const kuTraceThreadBuffer * buffer = TraceBuffers[t];
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				buffer->ThreadID, buffer->Name.c_str());
+
+		// Complete ("X") events, timestamps in microseconds since startup
+		uint32_t count = buffer->NumZones.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const kuTraceZone & zone = buffer->Zones[i];
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+					zone.Name, (int64_t)(zone.Begin - TraceStartTime) * 1e-3, (zone.End - zone.Begin) * 1e-3, buffer->ThreadID);
+		}
+
+		numZones   += count;
+		numDropped += buffer->NumDropped;
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	std::cout << "Trace: " << numZones << " zones from " << TraceBuffers.size() << " threads written to " << path;
+	if (numDropped)
+	{
+		std::cout << " (" << numDropped << " dropped, buffer full)";
+	}
+	std::cout << std::endl;
+
+	return true;
+}
+
+#endif // KU_PROFILING
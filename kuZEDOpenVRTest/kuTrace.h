@@ -0,0 +1,52 @@
+#ifndef KU_TRACE_H
+#define KU_TRACE_H
+
+#pragma once
+
+#ifndef KU_PROFILING
+#define KU_PROFILING	1									// 0: every KU_PROFILE_* macro compiles to nothing
+#endif
+
+#include <stdint.h>
+
+#include "kuClock.h"
+
+// Scoped CPU profiling zones written out as Chrome trace-event JSON
+// (chrome://tracing, ui.perfetto.dev). Every thread appends completed zones to
+// its own buffer, so recording takes no lock; the buffer of a thread is created on
+// its first zone and stops recording when full. Zone names must be string literals.
+#if KU_PROFILING
+
+#define kuTraceMaxEventsPerThread	(1 << 18)
+
+void	kuTraceSetThreadName(const char * name);
+void	kuTraceAddZone(const char * name, uint64_t beginNs, uint64_t endNs);
+bool	kuTraceWrite(const char * path);
+
+class kuProfileZone
+{
+public:
+	kuProfileZone(const char * name) : m_Name(name), m_Begin(kuGetTimeNs()) {}
+	~kuProfileZone() { kuTraceAddZone(m_Name, m_Begin, kuGetTimeNs()); }
+
+private:
+	const char	*	m_Name;
+	uint64_t		m_Begin;
+};
+
+#define KU_PROFILE_CONCAT_(a, b)		a##b
+#define KU_PROFILE_CONCAT(a, b)			KU_PROFILE_CONCAT_(a, b)
+
+#define KU_PROFILE_ZONE(name)			kuProfileZone KU_PROFILE_CONCAT(kuZone_, __LINE__)(name)
+#define KU_PROFILE_THREAD_NAME(name)	kuTraceSetThreadName(name)
+#define KU_PROFILE_WRITE(path)			kuTraceWrite(path)
+
+#else
+
+#define KU_PROFILE_ZONE(name)			((void)0)
+#define KU_PROFILE_THREAD_NAME(name)	((void)0)
+#define KU_PROFILE_WRITE(path)			((void)0)
+
+#endif // KU_PROFILING
+
+#endif // !KU_TRACE_H
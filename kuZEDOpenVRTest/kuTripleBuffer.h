@@ -0,0 +1,52 @@
+#ifndef KU_TRIPLEBUFFER_H
+#define KU_TRIPLEBUFFER_H
+
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer / single consumer triple buffer.
+// The writer always owns one slot (back), the reader always owns one slot (front)
+// and the third slot (middle) is exchanged atomically between them, so neither
+// side ever waits for the other. The reader only ever sees the newest published slot.
+template <typename T>
+class kuTripleBuffer
+{
+public:
+	kuTripleBuffer() : m_BackIndex(0), m_MiddleState(1), m_FrontIndex(2) {}
+
+	// Direct slot access, only valid before the producer thread is started.
+	T &		GetSlot(int index)	{ return m_Slots[index]; }
+	int		GetNumSlots()		{ return 3; }
+
+	// Writer side
+	T &		GetWriteBuffer()	{ return m_Slots[m_BackIndex]; }
+	void	Publish()
+	{
+		m_BackIndex = m_MiddleState.exchange(m_BackIndex | NewDataBit, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	// Reader side. Returns true if a newer slot than the current front has been taken.
+	bool	Update()
+	{
+		if ((m_MiddleState.load(std::memory_order_acquire) & NewDataBit) == 0)
+		{
+			return false;
+		}
+		m_FrontIndex = m_MiddleState.exchange(m_FrontIndex, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	T &		GetReadBuffer()		{ return m_Slots[m_FrontIndex]; }
+
+private:
+	enum { IndexMask = 3, NewDataBit = 4 };
+
+	T					m_Slots[3];
+
+	// Keep writer, shared and reader state on separate cache lines
+	alignas(64) int					m_BackIndex;
+	alignas(64) std::atomic<int>	m_MiddleState;
+	alignas(64) int					m_FrontIndex;
+};
+
+#endif // !KU_TRIPLEBUFFER_H
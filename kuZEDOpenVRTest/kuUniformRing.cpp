@@ -0,0 +1,188 @@
+#include "kuUniformRing.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+kuObjectUniforms kuMakeObjectUniforms(const glm::mat4 & modelMat, const glm::vec4 & color)
+{
+	kuObjectUniforms object;
+	object.ModelMat = modelMat;
+	object.Color	= color;
+
+	// Once per object here instead of once per vertex in the shader
+	glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(modelMat)));
+	for (int i = 0; i < 3; i++)
+	{
+		object.NormalMat[i] = glm::vec4(normalMat[i], 0.0f);
+	}
+
+	return object;
+}
+
+kuUniformRing::kuUniformRing()
+	: m_Buffer(0), m_MappedPtr(nullptr), m_FrameSize(0), m_Alignment(256), m_NumFrames(0), m_CurrFrame(0), m_FrameOffset(0),
+	  m_fPersistent(false), m_fCreated(false), m_FrameCount(0), m_NumPushes(0), m_NumBytes(0), m_NumBinds(0), m_NumOverflows(0),
+	  m_NumFenceStalls(0)
+{
+	for (int i = 0; i < kuMaxUniformRingFrames; i++)
+	{
+		m_Fence[i] = 0;
+	}
+}
+
+kuUniformRing::~kuUniformRing()
+{
+}
+
+bool kuUniformRing::Create(size_t bytesPerFrame, int numFrames)
+{
+	if (m_fCreated)
+	{
+		this->Release();
+	}
+
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_Alignment = std::max(alignment, 1);
+
+	// Segments start aligned, so every range bound inside one does too
+	m_FrameSize	  = (bytesPerFrame + m_Alignment - 1) / m_Alignment * m_Alignment;
+	m_NumFrames	  = std::min(std::max(numFrames, 1), kuMaxUniformRingFrames);
+	m_CurrFrame	  = 0;
+	m_FrameOffset = 0;
+	m_fPersistent = GLEW_ARB_buffer_storage ? true : false;
+
+	GLsizeiptr bufferSize = (GLsizeiptr)(m_FrameSize * m_NumFrames);
+	glGenBuffers(1, &m_Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+	if (m_fPersistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, bufferSize, nullptr, flags);
+		m_MappedPtr = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, bufferSize, flags);
+	}
+	else
+	{
+		glBufferData(GL_UNIFORM_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	m_fCreated = true;
+
+	return glGetError() == GL_NO_ERROR;
+}
+
+void kuUniformRing::Release()
+{
+	if (!m_fCreated)
+	{
+		return;
+	}
+
+	for (int i = 0; i < m_NumFrames; i++)
+	{
+		if (m_Fence[i])
+		{
+			glDeleteSync(m_Fence[i]);
+			m_Fence[i] = 0;
+		}
+	}
+	if (m_MappedPtr)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		m_MappedPtr = nullptr;
+	}
+	glDeleteBuffers(1, &m_Buffer);
+	m_Buffer = 0;
+
+	m_fCreated = false;
+}
+
+void kuUniformRing::BeginFrame()
+{
+	m_CurrFrame	  = (m_CurrFrame + 1) % m_NumFrames;
+	m_FrameOffset = 0;
+
+	// Only blocks if the GPU is still drawing the frame that last used this segment,
+	// with 3 segments that means more than 2 frames behind
+	if (m_Fence[m_CurrFrame])
+	{
+		GLenum waitRes = glClientWaitSync(m_Fence[m_CurrFrame], 0, 0);
+		if (waitRes == GL_TIMEOUT_EXPIRED)
+		{
+			m_NumFenceStalls++;
+			glClientWaitSync(m_Fence[m_CurrFrame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+		glDeleteSync(m_Fence[m_CurrFrame]);
+		m_Fence[m_CurrFrame] = 0;
+	}
+}
+
+void kuUniformRing::EndFrame()
+{
+	if (m_fPersistent)
+	{
+		m_Fence[m_CurrFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	m_FrameCount++;
+}
+
+kuUniformRange kuUniformRing::Push(const void * data, size_t size)
+{
+	kuUniformRange range;
+	range.Offset = 0;
+	range.Size	 = 0;
+
+	if (!m_fCreated || m_FrameOffset + size > m_FrameSize)
+	{
+		m_NumOverflows++;
+		return range;
+	}
+
+	range.Offset = (GLintptr)(m_CurrFrame * m_FrameSize + m_FrameOffset);
+	range.Size	 = (GLsizeiptr)size;
+
+	if (m_fPersistent)
+	{
+		memcpy(m_MappedPtr + range.Offset, data, size);
+	}
+	else
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, range.Offset, range.Size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	m_FrameOffset += (size + m_Alignment - 1) / m_Alignment * m_Alignment;
+	m_NumPushes++;
+	m_NumBytes += size;
+
+	return range;
+}
+
+void kuUniformRing::Bind(GLuint binding, const kuUniformRange & range)
+{
+	if (range.Size == 0)
+	{
+		return;
+	}
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_Buffer, range.Offset, range.Size);
+	m_NumBinds++;
+}
+
+void kuUniformRing::PrintStats(const char * name)
+{
+	if (m_FrameCount == 0)
+	{
+		return;
+	}
+
+	std::cout << name << ": " << m_FrameCount << " frames (" << (m_fPersistent ? "persistent" : "sub data") << " ring x" << m_NumFrames
+			  << ", " << m_FrameSize / 1024 << " KB each), " << (double)m_NumPushes / m_FrameCount << " blocks / "
+			  << (double)m_NumBytes / m_FrameCount << " B / " << (double)m_NumBinds / m_FrameCount << " binds per frame"
+			  << ", overflows " << m_NumOverflows << ", fence stalls " << m_NumFenceStalls << std::endl;
+}
@@ -0,0 +1,90 @@
+#ifndef KU_UNIFORMRING_H
+#define KU_UNIFORMRING_H
+
+#pragma once
+
+#include <stdint.h>
+#include <GLEW/glew.h>
+#include <GLM/glm.hpp>
+
+#define kuMaxUniformRingFrames	4
+
+// Uniform block binding points, shared by every program declaring the blocks
+enum kuUniformBlockBinding {
+	kuUniformBlock_Frame = 0,
+	kuUniformBlock_Eye,
+	kuUniformBlock_Object,
+};
+
+// std140 layouts of the FrameData, EyeData and ObjectData blocks in ModelVertexShader.vert
+// and ModelFragmentShader.frag. vec3s are padded to vec4, a mat3 is three vec4 columns.
+struct kuFrameUniforms {
+	glm::vec4	CamPos;													// Head position (world), xyz used
+};
+
+struct kuEyeUniforms {
+	glm::mat4	ViewProjMat[2];											// World to clip space per view, both the same eye for one-view passes
+	GLint		NumViews;												// 2: single-pass stereo into a double-wide target
+	GLint		Padding[3];
+};
+
+struct kuObjectUniforms {
+	glm::mat4	ModelMat;
+	glm::vec4	NormalMat[3];											// transpose(inverse(mat3(ModelMat))), xyz used
+	glm::vec4	Color;
+};
+
+kuObjectUniforms	kuMakeObjectUniforms(const glm::mat4 & modelMat, const glm::vec4 & color);
+
+// Where a block landed in the ring
+struct kuUniformRange {
+	GLintptr	Offset;
+	GLsizeiptr	Size;													// 0 when the frame's segment was full
+};
+
+// One uniform buffer split into numFrames segments, one per frame in flight. Each frame
+// pushes all its blocks into its segment once and binds them by range per eye and draw.
+// With ARB_buffer_storage the buffer stays persistently mapped and each segment is
+// guarded by a fence, so pushes are plain memcpys; without it they are glBufferSubData.
+class kuUniformRing
+{
+public:
+	kuUniformRing();
+	~kuUniformRing();
+
+	bool			Create(size_t bytesPerFrame = 64 * 1024, int numFrames = 3);
+	void			Release();
+
+	// Waits until the GPU is done with the next segment, then starts filling it
+	void			BeginFrame();
+	// After the last draw reading this frame's blocks
+	void			EndFrame();
+
+	kuUniformRange	Push(const void * data, size_t size);
+	template <class T>
+	kuUniformRange	Push(const T & block) { return this->Push(&block, sizeof(T)); }
+	void			Bind(GLuint binding, const kuUniformRange & range);
+
+	void			PrintStats(const char * name);
+
+private:
+	GLuint			m_Buffer;
+	GLsync			m_Fence[kuMaxUniformRingFrames];
+	unsigned char *	m_MappedPtr;
+	size_t			m_FrameSize;
+	size_t			m_Alignment;										// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	int				m_NumFrames;
+	int				m_CurrFrame;
+	size_t			m_FrameOffset;										// Used bytes of the current segment
+	bool			m_fPersistent;
+	bool			m_fCreated;
+
+	uint64_t		m_FrameCount;
+	uint64_t		m_NumPushes;
+	uint64_t		m_NumBytes;
+	uint64_t		m_NumBinds;
+	uint64_t		m_NumOverflows;
+	uint64_t		m_NumFenceStalls;
+};
+
+#endif // !KU_UNIFORMRING_H
@@ -5,10 +5,21 @@
 #include <GLM/gtc/type_ptr.hpp>
 #include <OpenVR.h>
 #include <opencv2/opencv.hpp>
-#include <sl_zed/Camera.hpp>
 
 #include "kuShaderHandler.h"
 #include "kuModelObject.h"
+#include "kuCaptureThread.h"
+#include "kuZEDStereoSource.h"
+#include "kuStreamingTexture.h"
+#include "kuColorConvert.h"
+#include "kuCameraTimewarp.h"
+#include "kuPoseProvider.h"
+#include "kuFrameTimeline.h"
+#include "kuGPUProfiler.h"
+#include "kuTrace.h"
+#include "kuHMDBackend.h"
+#include "kuSessionRecorder.h"
+#include "kuUniformRing.h"
 #include "Matrices.h"
 
 #define numEyes			2
@@ -18,34 +29,58 @@
 
 #define ZEDImgWidth		1280
 #define ZEDImgHeight	720
+#define ZEDImgFPS		60
+
+#define CameraSource		0									// 0: ZED (KU_USE_ZED_SDK), 1: synthetic test pattern (kuSyntheticStereoSource), 2: play back the camera of SessionPlaybackFile
+#define SessionPlaybackFile	"Session.kusession"
+#define SessionPlaybackRealTime	1								// Playback: 1 at the recorded frame rate, 0 as fast as the capture thread grabs
+#define SessionRecordFile	""									// Record camera frames, calibration and tracked device poses to this session file, "" for off
+#define BGConvertOnGPU		1									// 1: upload raw BGRA and swizzle/flip in the BG shaders, 0: fused SIMD convert + flip on the CPU
+#define RunColorConvertBenchmark	0								// 1: benchmark the CPU convert kernels against OpenCV at startup
+#define StereoSideBySide	1									// 1: one VIEW_SIDE_BY_SIDE retrieve/upload/content pass for both eyes, 0: one per eye
+#define UseNullHMD			0									// 1: run without SteamVR, kuNullHMDBackend driven by a scripted head trajectory
+#define NullHMDTrajectory	""									// Recorded trajectory (CSV or session file) for the null HMD, "" for the scripted one
+#define NullHMDCaptureEvery	0									// Null HMD: read back the submitted eye textures every N frames (0 = off)
+#define NullHMDCaptureDir	"."
+#define CameraTimewarp		1									// 1: re-draw the last camera frame every HMD frame, rotated to the current head pose
+#define RecordPosePrediction	1								// 1: log predicted vs measured HMD poses to PosePredictionLog
+#define PosePredictionLog	"PosePrediction.csv"
+#define FrameTimelineReport	"FrameTimeline.csv"						// Stage latency percentiles, written at exit (KU_FRAME_TIMELINE in kuFrameTimeline.h)
+#define ProfileTraceFile	"kuTrace.json"							// Chrome trace of the profiling zones, written at exit (KU_PROFILING in kuTrace.h)
+#define ModelWeldEpsilon	1e-5f								// STL models: merge vertices closer than this (model units), < 0 to keep every triangle separate
+#define ModelSmoothNormals	1									// STL models: 1 area-weighted vertex normals after welding, 0 keeps the first facet normal at each vertex
+#define ModelOptimizeIndices	1								// 1: reorder model triangles for the post-transform cache and overdraw at load (cached)
+#define ModelLODCount		4									// Levels of detail per model mesh including the full one, each about half the previous, 1 = off
+#define ModelLODMaxError	0.05f								// Max simplification error per level, relative to the mesh's bounding radius
+#define ModelLODPixelError	1.0f								// Projected simplification error a LOD may show on the HMD (pixel)
+#define ModelLODHysteresis	0.25f								// Switch to a coarser LOD only below (1 - this) * ModelLODPixelError
+#define ModelPackVertices	1									// 1: 12/16 byte quantised vertices on the GPU where precise enough (chosen per mesh), 0: always 32 byte floats
+#define ModelMeshletCulling	1									// 1: skip model meshlets outside both eye frusta or facing away from both eyes
+#define UniformRingFrames	3									// Frames of frame/eye/object uniform blocks in flight
+#define SinglePassStereo	1									// 1: draw the models once for both eyes, instanced into a double-wide target, 0: one model pass per eye
+#define DrawFaceModel		0									// 1: draw the face model over the bone model, 0: bone model only (face is loaded but not updated)
 
 #define	nearClip		0.1
 #define farClip			5000.0
 
-vr::IVRSystem	*	kuOpenVRInit(uint32_t &hmdWidth, uint32_t &hmdHeight);
 GLFWwindow		*	kuOpenGLInit(int width, int height, const std::string& title, GLFWkeyfun cbfun);
-sl::ERROR_CODE		kuZEDInit(sl::Camera &zedCam, sl::InitParameters initParams, sl::RuntimeParameters rtParams, sl::Mat &imgZEDLeft, sl::Mat &imgZEDRight, cv::Mat &imgCVLeft, cv::Mat &imgCVRight);
 
 #pragma region // Camera parameters related functions
-void				SetIntrinsicParams(sl::Camera &zedCam, cv::Mat &intrinsicParamsLeft, cv::Mat &intrinsicParamsRight, cv::Mat  &distParamsLeft, cv::Mat &distParamsRight, GLfloat intrinsicMatGL[2][16]);
-void				SetIntrinsicMatCV(sl::CameraParameters camCalibParams, cv::Mat &intrinsicParams, cv::Mat &distPrams);
+void				SetIntrinsicParams(const kuStereoCalibration &calib, cv::Mat &intrinsicParamsLeft, cv::Mat &intrinsicParamsRight, cv::Mat  &distParamsLeft, cv::Mat &distParamsRight, GLfloat intrinsicMatGL[2][16]);
+void				SetIntrinsicMatCV(const kuStereoCalibration::Camera &camCalibParams, cv::Mat &intrinsicParams, cv::Mat &distPrams);
 void				IntrinsicCVtoGL(cv::Mat IntParam, GLfloat GLProjection[16]);
 void				ExtrinsicCVtoGL(cv::Mat RotMat, cv::Mat TransVec, GLfloat GLModelView[16]);
 #pragma endregion
 
-void				DrawBGImage(cv::Mat BGImg, kuShaderHandler BGShader);
-GLuint				CreateTexturebyImage(cv::Mat Img);
-
-std::string			getHMDString(vr::IVRSystem * pHmd, vr::TrackedDeviceIndex_t unDevice, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError * peError = nullptr);
-cv::Mat				MatSL2CV(sl::Mat& input);
+void				DrawBGImage(GLuint BGTextureID, GLuint BGVertexArrayID, kuShaderHandler & BGShader);
 
 void				key_callback(GLFWwindow * window, int key, int scancode, int action, int mode);
 
 void				SetQuadVertexArrayGL(GLuint vertexArrayID, GLuint vertexBufferID, GLuint elementBufferID, const GLfloat * vertexArrayPts);
 
-Matrix4				GetHMDMatrixPoseEye(vr::IVRSystem * hmd, vr::Hmd_Eye nEye);
+Matrix4				GetHMDMatrixPoseEye(kuHMDBackend * hmd, vr::Hmd_Eye nEye);
 Matrix4				ConvertSteamVRMatrixToMatrix4(const vr::HmdMatrix34_t &matPose);
-Matrix4				GetHMDMatrixProjectionEye(vr::IVRSystem * hmd, vr::Hmd_Eye nEye);
+Matrix4				GetHMDMatrixProjectionEye(kuHMDBackend * hmd, vr::Hmd_Eye nEye);
 
 #pragma region // Camera parameters OpenGL //
 GLfloat						IntrinsicProjMatGL[2][16];
@@ -63,17 +98,53 @@ void main()
 {
 	uint32_t frameBufferWidth, frameBufferHeight;
 
-	vr::IVRSystem	*	hmd	   = kuOpenVRInit(frameBufferWidth, frameBufferHeight);
+#if RunColorConvertBenchmark
+	kuRunColorConvertBenchmark();
+#endif
+
+	// HMD runtime: SteamVR, or an in-process stand-in so the loop also runs without a headset
+#if UseNullHMD
+	kuScriptedTrajectory	scriptedTrajectory;
+	kuRecordedTrajectory	recordedTrajectory;
+	bool					useRecorded = NullHMDTrajectory[0] && recordedTrajectory.Load(NullHMDTrajectory);
+	kuNullHMDBackend	*	nullHMD		= new kuNullHMDBackend(useRecorded ? (kuHeadTrajectory *)&recordedTrajectory : &scriptedTrajectory);
+	nullHMD->SetCapture(NullHMDCaptureEvery, NullHMDCaptureDir);
+	kuHMDBackend		*	hmd			= nullHMD;
+#else
+	kuHMDBackend		*	hmd			= new kuOpenVRBackend();
+#endif
+	if (!hmd->Init())
+	{
+		delete hmd;
+		return;
+	}
+	hmd->GetRenderTargetSize(frameBufferWidth, frameBufferHeight);
+
 	const int windowHeight	   = 720;
 	const int windowWidth	   = (frameBufferWidth * windowHeight) / frameBufferHeight;
 	GLFWwindow		*	window = kuOpenGLInit(windowWidth, windowHeight, "kuOpenGLVRTest", key_callback);
 	Tex2DShaderHandler.Load("BGImgVertexShader.vert", "BGImgFragmentShader.frag");
 	ModelShaderHandler.Load("ModelVertexShader.vert", "ModelFragmentShader.frag");
+	ModelShaderHandler.BindUniformBlock("FrameData", kuUniformBlock_Frame, sizeof(kuFrameUniforms));
+	ModelShaderHandler.BindUniformBlock("EyeData", kuUniformBlock_Eye, sizeof(kuEyeUniforms));
+	ModelShaderHandler.BindUniformBlock("ObjectData", kuUniformBlock_Object, sizeof(kuObjectUniforms));
+
+	// Frame, eye and object blocks of every shader, written once per frame
+	kuUniformRing		UniformRing;
+	UniformRing.Create(64 * 1024, UniformRingFrames);
+
+	kuModelLoadOptions	ModelLoadOptions;
+	ModelLoadOptions.WeldEpsilon	 = ModelWeldEpsilon;
+	ModelLoadOptions.SmoothNormals	 = ModelSmoothNormals;
+	ModelLoadOptions.OptimizeIndices = ModelOptimizeIndices;
+	ModelLoadOptions.NumLODs		 = ModelLODCount;
+	ModelLoadOptions.LODMaxError	 = ModelLODMaxError;
+	ModelLoadOptions.PackVertices	 = ModelPackVertices;
 
 	//std::cout << "Load face model......" << std::endl;
-	kuModelObject		FaceModel("kuFace_7d5wf_SG_Center.stl");
+	kuModelObject		FaceModel("kuFace_7d5wf_SG_Center.stl", ModelLoadOptions);
 	//std::cout << "Load bone model......" << std::endl;
-	kuModelObject		BoneModel("kuBone_7d5wf_SG_Center.stl");
+	kuModelObject		BoneModel("kuBone_7d5wf_SG_Center.stl", ModelLoadOptions);
 
 	GLuint	FrameBufferID[2];
 	GLuint	SceneTextureID[2];
@@ -95,6 +166,27 @@ void main()
 	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+	// Single-pass stereo: both eyes side by side in one target, submitted with per-eye bounds
+	GLuint	StereoFrameBufferID  = 0;
+	GLuint	StereoSceneTextureID = 0;
+	if (SinglePassStereo)
+	{
+		glGenFramebuffers(1, &StereoFrameBufferID);
+		glGenTextures(1, &StereoSceneTextureID);
+
+		glBindTexture(GL_TEXTURE_2D, StereoSceneTextureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2 * frameBufferWidth, frameBufferHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, StereoFrameBufferID);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, StereoSceneTextureID, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	const vr::VRTextureBounds_t StereoEyeBounds[2] = { { 0.0f, 0.0f, 0.5f, 1.0f }, { 0.5f, 0.0f, 1.0f, 1.0f } };
+
 	HMDProjectionMat[Left]  = GetHMDMatrixProjectionEye(hmd, vr::Eye_Left);
 	HMDProjectionMat[Right] = GetHMDMatrixProjectionEye(hmd, vr::Eye_Right);
 	EyePoseMat[Left]        = GetHMDMatrixPoseEye(hmd, vr::Eye_Left);
@@ -108,45 +200,91 @@ void main()
 	cv::Mat						TranslationVec[2];
 	#pragma endregion
 
-	sl::Camera					ZEDCam;														// ZED camera object
-	sl::InitParameters			initParams;
-	sl::CalibrationParameters	calibParams;
-	sl::RuntimeParameters		rtParams;
-
-	// Camera frames
-	cv::Mat						camFrameCVRGBA[2];
-	cv::Mat						camFrameCVBGR[2];
-	sl::Mat						camFrameZED[2];
-
-	sl::ERROR_CODE res = kuZEDInit(ZEDCam,
-								   initParams, rtParams,									// Camera parameters for setting
-								   camFrameZED[0], camFrameZED[1],							// Image pointers
-								   camFrameCVRGBA[0], camFrameCVRGBA[1]);					// Image pointers
-	if (res == sl::ERROR_CODE::SUCCESS)
+	// Camera capture runs on its own thread, the render loop only picks up finished frames
+	kuCaptureThread				CaptureThread;
+	kuStereoSource			*	camSource = nullptr;
+
+#if CameraSource == 1
+	camSource = new kuSyntheticStereoSource(ZEDImgWidth, ZEDImgHeight, ZEDImgFPS, StereoSideBySide);
+#elif CameraSource == 2
+	camSource = new kuPlaybackStereoSource(SessionPlaybackFile, SessionPlaybackRealTime, StereoSideBySide);
+#elif KU_USE_ZED_SDK
+	camSource = new kuZEDStereoSource(ZEDImgWidth, ZEDImgHeight, ZEDImgFPS, StereoSideBySide);
+#else
+	#error CameraSource 0 needs the ZED SDK (KU_USE_ZED_SDK in kuZEDStereoSource.h)
+#endif
+
+	// Recording: the camera path writes frames, the render loop poses
+	kuSessionRecorder			SessionRecorder;
+	if (strlen(SessionRecordFile) > 0)
+	{
+		camSource = new kuRecordingStereoSource(camSource, &SessionRecorder, SessionRecordFile);
+	}
+
+	// Without a camera the render loop is skipped, main still ends through the shutdown below
+	bool						camReady = camSource->Open();
+	if (!camReady)
 	{
-		std::cout << "ZED initialized." << std::endl;
+		std::cout << "Camera: " << camSource->GetName() << " failed to open." << std::endl;
 	}
-	SetIntrinsicParams(ZEDCam, IntrinsicMat[0], IntrinsicMat[1], DistParam[0], DistParam[1], IntrinsicProjMatGL);
+	else
+	{
+		std::cout << "Camera: " << camSource->GetName() << " initialized." << std::endl;
+
+		// Image size is fixed at compile time for the textures and projections below
+		if (camSource->GetWidth() != ZEDImgWidth || camSource->GetHeight() != ZEDImgHeight)
+		{
+			std::cout << "Camera: " << camSource->GetName() << " delivers " << camSource->GetWidth() << " x " << camSource->GetHeight()
+					  << ", expected " << ZEDImgWidth << " x " << ZEDImgHeight << std::endl;
+			camReady = false;
+		}
+	}
+
+	kuCameraTimewarp			CamTimewarp;
+	if (camReady)
+	{
+		SetIntrinsicParams(camSource->GetCalibration(), IntrinsicMat[0], IntrinsicMat[1], DistParam[0], DistParam[1], IntrinsicProjMatGL);
+		for (int eye = 0; eye < numEyes; eye++)
+		{
+			CamTimewarp.SetIntrinsics(eye, IntrinsicMat[eye].at<float>(0, 0), IntrinsicMat[eye].at<float>(1, 1),
+										   IntrinsicMat[eye].at<float>(0, 2), IntrinsicMat[eye].at<float>(1, 2),
+										   ZEDImgWidth, ZEDImgHeight);
+		}
+
+		CaptureThread.Start(camSource);
+	}
+
+	// HMD poses predicted to the display time of each frame
+	kuPoseProvider				PoseProvider;
+	PoseProvider.Init(hmd);
+#if RecordPosePrediction
+	PoseProvider.OpenLog(PosePredictionLog);
+#endif
 
 	double deltaT, lastFrameT = 0.0f;
+	uint64_t hmdFrameCount = 0;
+
+	// Camera views: one per eye, or a single double-wide one holding both eyes side by side
+	const int numCamViews  = StereoSideBySide ? 1 : numEyes;
+	const int camViewWidth = StereoSideBySide ? 2 * ZEDImgWidth : ZEDImgWidth;
 
 	GLuint contentFrameBuffer[2];
 	GLuint contentTexture[2];
 
-	glGenFramebuffers(numEyes, contentFrameBuffer);
-	glGenTextures(numEyes, contentTexture);
+	glGenFramebuffers(numCamViews, contentFrameBuffer);
+	glGenTextures(numCamViews, contentTexture);
 
-	for (int eye = 0; eye < numEyes; eye++)
+	for (int view = 0; view < numCamViews; view++)
 	{	
-		glBindTexture(GL_TEXTURE_2D, contentTexture[eye]);
+		glBindTexture(GL_TEXTURE_2D, contentTexture[view]);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, ZEDImgWidth, ZEDImgHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, camViewWidth, ZEDImgHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
 		
-		glBindFramebuffer(GL_FRAMEBUFFER, contentFrameBuffer[eye]);
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, contentTexture[eye], 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, contentFrameBuffer[view]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, contentTexture[view], 0);
 	}
 
 	#pragma region // Set texture quad //
@@ -175,22 +313,47 @@ void main()
 	SetQuadVertexArrayGL(quadVertexArrayID[1], quadVertexBufferID[1], quadElementBufferID[1], rightQuadVertices);
 	#pragma endregion
 
-	GLuint		CamPosLoc;
-	GLuint		ProjMatLoc, ViewMatLoc, ModelMatLoc, SceneMatrixLocation;
-	GLuint		ObjColorLoc;
+	#pragma region // Background image streaming //
+	static const GLfloat BGVertices[] = {
+		 1.0f,  1.0f, 1.0f, 0.0f,
+		 1.0f, -1.0f, 1.0f, 1.0f,
+		-1.0f, -1.0f, 0.0f, 1.0f,
+		-1.0f,  1.0f, 0.0f, 0.0f
+	};
+
+	GLuint BGVertexArrayID, BGVertexBufferID, BGElementBufferID;
+	glGenVertexArrays(1, &BGVertexArrayID);
+	glGenBuffers(1, &BGVertexBufferID);
+	glGenBuffers(1, &BGElementBufferID);
+	SetQuadVertexArrayGL(BGVertexArrayID, BGVertexBufferID, BGElementBufferID, BGVertices);
+
+	// Camera images are streamed into persistent textures instead of creating one per frame
+	kuStreamingTexture BGTexture[2];
+	for (int view = 0; view < numCamViews; view++)
+	{
+		if (BGConvertOnGPU)
+		{
+			BGTexture[view].Create(camViewWidth, ZEDImgHeight, GL_RGBA8, GL_RGBA, 4);
+		}
+		else
+		{
+			BGTexture[view].Create(camViewWidth, ZEDImgHeight, GL_RGB8, GL_RGB, 3);
+		}
+	}
+
+	kuUniform<bool>			BGSwapRBLoc	 = Tex2DShaderHandler.GetUniform<bool>("SwapRB");
+	kuUniform<bool>			BGFlipYLoc	 = Tex2DShaderHandler.GetUniform<bool>("FlipY");
+	kuUniform<glm::vec4>	BGTexRectLoc = Tex2DShaderHandler.GetUniform<glm::vec4>("TexRect");
+	kuUniform<glm::mat3>	BGReprojLoc	 = Tex2DShaderHandler.GetUniform<glm::mat3>("ReprojMat");
+
+	const glm::mat3 IdentityMat3(1.0f);
+	#pragma endregion
 
 	GLuint		ImgModelMatLoc, ImgViewMatLoc, ImgProjMatLoc, ImgSceneMatrixLocation, TransCT2ModelLoc;
 	
 	glm::mat4	ProjMat, ModelMat, ViewMat;
 	glm::mat4	TransCT2Model;
 
-	SceneMatrixLocation = glGetUniformLocation(ModelShaderHandler.GetShaderProgramID(), "matrix");
-	ProjMatLoc			= glGetUniformLocation(ModelShaderHandler.GetShaderProgramID(), "ProjMat");
-	ViewMatLoc			= glGetUniformLocation(ModelShaderHandler.GetShaderProgramID(), "ViewMat");
-	ModelMatLoc			= glGetUniformLocation(ModelShaderHandler.GetShaderProgramID(), "ModelMat");
-	CamPosLoc			= glGetUniformLocation(ModelShaderHandler.GetShaderProgramID(), "CamPos");
-	ObjColorLoc			= glGetUniformLocation(ModelShaderHandler.GetShaderProgramID(), "ObjColor");
-
 	GLfloat FaceColorVec[4] = { 0.745f, 0.447f, 0.235f, 0.5f };
 	GLfloat BoneColorVec[4] = {   1.0f,   1.0f,	  1.0f, 1.0f };
 
@@ -204,153 +367,355 @@ void main()
 						   glm::vec3(1.0f, 0.0f, 0.0f)); // mat, degree, axis. (use radians)
 	//ModelMat = glm::translate(ModelMat, glm::vec3(0.0f, 0.0f, 100.0f));
 
-	while (!glfwWindowShouldClose(window))
+	// GPU time of every render pass, printed at exit next to the CPU time of the pass
+	kuGPUProfiler	GPUProfiler;
+	GPUProfiler.Init();
+	const int		GPUPassFrame   = GPUProfiler.AddPass("frame");
+	const int		GPUPassContent = GPUProfiler.AddPass("content (camera image)");
+	const int		GPUPassCompose = GPUProfiler.AddPass("compose (background quad)");
+	const int		GPUPassModel   = GPUProfiler.AddPass("model draw");
+	const int		GPUPassMirror  = GPUProfiler.AddPass("mirror blit");
+
+	while (camReady && !glfwWindowShouldClose(window))
 	{
+		KU_PROFILE_ZONE("frame");
+
 		double currFrameT = glfwGetTime();
 		deltaT = currFrameT - lastFrameT;
 		lastFrameT = currFrameT;
 		//std::cout << "FPS: " << 1/deltaT << std::endl;
 
-		vr::TrackedDevicePose_t trackedDevicePose[vr::k_unMaxTrackedDeviceCount];
-		vr::VRCompositor()->WaitGetPoses(trackedDevicePose, vr::k_unMaxTrackedDeviceCount, nullptr, 0);			// Can be replaced by GetDeviceToAbsoluteTrackingPose(?)
+		KU_TIMELINE_HMD_BEGIN(++hmdFrameCount);
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_WaitBegin);
+
+		// Waits for the compositor, then predicts the HMD pose to this frame's photon time
+		PoseProvider.WaitGetPoses();
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_WaitEnd);
+		if (SessionRecorder.IsOpen())
+		{
+			SessionRecorder.SubmitPoses(hmdFrameCount, PoseProvider.GetPhotonTime(), PoseProvider.GetRenderPoses());
+		}
+		KU_TIMELINE_HMD_STAMP_AT(kuHMDStamp_Photon, PoseProvider.GetPhotonTime());
+
+		GPUProfiler.BeginFrame();
+		GPUProfiler.BeginPass(GPUPassFrame);
+		CamTimewarp.AddHMDPose(PoseProvider.GetMeasuredTime(), PoseProvider.GetMeasuredHMDPose().mDeviceToAbsoluteTracking);
 
-		Matrix4 HMDPoseMat = ConvertSteamVRMatrixToMatrix4(trackedDevicePose[0].mDeviceToAbsoluteTracking);
+		// Acquire newest camera frame, never waits for the capture thread.
+		// The content textures keep the last frame when nothing new has arrived.
+		bool					isNewCamFrame = false;
+		const kuStereoFrame	*	camFrame	  = CaptureThread.AcquireLatestFrame(&isNewCamFrame);
+		if (camFrame)
+		{
+			KU_TIMELINE_HMD_STAMP_AT(kuHMDStamp_CamExposure, camFrame->ExposureTimestamp);
+			KU_TIMELINE_HMD_STAMP_AT(kuHMDStamp_CamPublished, camFrame->HostTimestamp);
+		}
+
+		#pragma region // Render content to texture //
+		if (isNewCamFrame)
+		{
+			KU_PROFILE_ZONE("camera upload");
+
+			// Anchor the warp at exposure, sources without an exposure clock only have the publish time
+			CamTimewarp.SetCaptureTime(camFrame->ExposureTimestamp ? camFrame->ExposureTimestamp : camFrame->HostTimestamp);
+			KU_TIMELINE_HMD_STAMP(kuHMDStamp_UploadBegin);
+
+			for (int view = 0; view < numCamViews; view++)
+			{
+				if (BGConvertOnGPU)
+				{
+					// Raw frame goes up as-is, BGImg shaders do the swizzle and flip
+					BGTexture[view].Upload(camFrame->Image[view].data, camFrame->Image[view].step);
+				}
+				else
+				{
+					// Convert + flip in one pass, written straight into the mapped upload buffer
+					kuConvertRGBAToBGRFlip(camFrame->Image[view].data, camFrame->Image[view].step,
+										   (uint8_t *)BGTexture[view].BeginUpload(), BGTexture[view].GetPitch(),
+										   camViewWidth, ZEDImgHeight);
+					BGTexture[view].EndUpload();
+				}
+			}
+			KU_TIMELINE_HMD_STAMP(kuHMDStamp_UploadEnd);
+		}
+
+		// Late pose update: the camera work above can take several ms, so re-predict to the same
+		// photon time right before drawing. Background reprojection, model and Submit share this pose.
+		PoseProvider.LateUpdate();
+		CamTimewarp.AddHMDPose(PoseProvider.GetMeasuredTime(), PoseProvider.GetMeasuredHMDPose().mDeviceToAbsoluteTracking);
+		KU_TIMELINE_HMD_STAMP_AT(kuHMDStamp_PoseSample, PoseProvider.GetMeasuredTime());
+
+		const vr::HmdMatrix34_t & renderPose = PoseProvider.GetHMDPose().mDeviceToAbsoluteTracking;
+
+		Matrix4 HMDPoseMat = ConvertSteamVRMatrixToMatrix4(renderPose);
 		CameraPos = glm::vec3(HMDPoseMat.m[12], HMDPoseMat.m[13], HMDPoseMat.m[14]);
 		HMDPoseMat.invert();
 
 		MVPMat[Left]  = HMDProjectionMat[Left] * EyePoseMat[Left]  * HMDPoseMat;
 		MVPMat[Right] = HMDProjectionMat[Right] * EyePoseMat[Right] * HMDPoseMat;
 
-		// Acquire camera frame
-		ZEDCam.grab(rtParams);
-		ZEDCam.retrieveImage(camFrameZED[0], sl::VIEW_LEFT, sl::MEM_CPU);
-		ZEDCam.retrieveImage(camFrameZED[1], sl::VIEW_RIGHT, sl::MEM_CPU);
+		// One LOD per frame for both eyes, picked from the head position, so the eyes never see different geometry
+		float LODPixelScale = 0.5f * frameBufferHeight * HMDProjectionMat[Left].get()[5];
+		BoneModel.SelectLOD(ModelMat, CameraPos, LODPixelScale, ModelLODPixelError, ModelLODHysteresis);
+		if (DrawFaceModel)
+		{
+			FaceModel.SelectLOD(ModelMat, CameraPos, LODPixelScale, ModelLODPixelError, ModelLODHysteresis);
+		}
 
-		#pragma region // Render content to texture //
-		for (int eye = 0; eye < numEyes; eye++)
+		// World to clip space per eye, shared by the meshlet culling and the EyeData blocks
+		glm::mat4 EyeViewProjMat[2] = { ProjMat * glm::make_mat4(MVPMat[Left].get()), ProjMat * glm::make_mat4(MVPMat[Right].get()) };
+		if (ModelMeshletCulling)
 		{
-			glBindFramebuffer(GL_FRAMEBUFFER, contentFrameBuffer[eye]);
-			glViewport(0, 0, ZEDImgWidth, ZEDImgHeight);
+			BoneModel.Cull(ModelMat, EyeViewProjMat, 2);
+			if (DrawFaceModel)
+			{
+				FaceModel.Cull(ModelMat, EyeViewProjMat, 2);
+			}
+		}
 
-			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// All uniform blocks of the frame in one go, the passes below only bind ranges of them
+		UniformRing.BeginFrame();
+		kuFrameUniforms FrameUniforms;
+		FrameUniforms.CamPos = glm::vec4(CameraPos, 1.0f);
+		kuUniformRange	FrameRange = UniformRing.Push(FrameUniforms);
 
-			#pragma region // Render camera frame to texture frame buffer //
-			cv::cvtColor(camFrameCVRGBA[eye], camFrameCVBGR[eye], CV_RGBA2BGR);
-			cv::flip(camFrameCVBGR[eye], camFrameCVBGR[eye], 0);
-			//cv::imshow("Test", camFrameCVBGR[0]);
-			DrawBGImage(camFrameCVBGR[eye], Tex2DShaderHandler);
-			#pragma endregion
+		// Both views in one block for single-pass stereo, else one block per eye
+		kuUniformRange	EyeRange[2];
+		for (int eye = 0; eye < (SinglePassStereo ? 1 : numEyes); eye++)
+		{
+			kuEyeUniforms EyeUniforms;
+			EyeUniforms.ViewProjMat[Left]  = SinglePassStereo ? EyeViewProjMat[Left] : EyeViewProjMat[eye];
+			EyeUniforms.ViewProjMat[Right] = SinglePassStereo ? EyeViewProjMat[Right] : EyeViewProjMat[eye];
+			EyeUniforms.NumViews		   = SinglePassStereo ? numEyes : 1;
+			EyeRange[eye] = UniformRing.Push(EyeUniforms);
+		}
+
+		kuUniformRange	BoneRange = UniformRing.Push(kuMakeObjectUniforms(ModelMat, glm::make_vec4(BoneColorVec)));
+		kuUniformRange	FaceRange = { 0, 0 };
+		if (DrawFaceModel)
+		{
+			FaceRange = UniformRing.Push(kuMakeObjectUniforms(ModelMat, glm::make_vec4(FaceColorVec)));
+		}
+		UniformRing.Bind(kuUniformBlock_Frame, FrameRange);
+
+		// Without timewarp the content textures simply keep the last frame until a new one arrives.
+		// With it the last frame is re-drawn every HMD frame, rotated to the current head pose.
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_ContentBegin);
+		if (isNewCamFrame || (CameraTimewarp && camFrame))
+		{
+			KU_PROFILE_ZONE("content pass");
+
+			GPUProfiler.BeginPass(GPUPassContent);
+			Tex2DShaderHandler.Use();
+			Tex2DShaderHandler.Set(BGSwapRBLoc, BGConvertOnGPU);
+			Tex2DShaderHandler.Set(BGFlipYLoc, BGConvertOnGPU);
+
+			for (int eye = 0; eye < numEyes; eye++)
+			{
+				int view = StereoSideBySide ? 0 : eye;
+
+				if (eye == 0 || !StereoSideBySide)
+				{
+					glBindFramebuffer(GL_FRAMEBUFFER, contentFrameBuffer[view]);
+					glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				}
+
+				#pragma region // Render camera frame to texture frame buffer //
+				if (StereoSideBySide)
+				{
+					glViewport(eye * ZEDImgWidth, 0, ZEDImgWidth, ZEDImgHeight);
+					Tex2DShaderHandler.Set(BGTexRectLoc, glm::vec4(0.5f * eye, 0.0f, 0.5f, 1.0f));
+				}
+				else
+				{
+					glViewport(0, 0, ZEDImgWidth, ZEDImgHeight);
+					Tex2DShaderHandler.Set(BGTexRectLoc, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+				}
+
+				glm::mat3 reprojMat = CameraTimewarp ? CamTimewarp.GetReprojection(eye, renderPose) : IdentityMat3;
+				Tex2DShaderHandler.Set(BGReprojLoc, reprojMat);
+
+				DrawBGImage(BGTexture[view].GetTextureID(), BGVertexArrayID, Tex2DShaderHandler);
+				#pragma endregion
+			}
+			GPUProfiler.EndPass(GPUPassContent);
 		}
 		#pragma endregion
 
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_ContentEnd);
+
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_DrawBegin);
 #pragma region // Apply textures to OpenVR frame buffers
 		for (int eye = 0; eye < numEyes; ++eye)
 		{
-			glBindFramebuffer(GL_FRAMEBUFFER, FrameBufferID[eye]);
-			glViewport(0, 0, frameBufferWidth, frameBufferHeight);
+			KU_PROFILE_ZONE("eye pass");
 
-			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			GPUProfiler.BeginPass(GPUPassCompose);
+			glBindFramebuffer(GL_FRAMEBUFFER, SinglePassStereo ? StereoFrameBufferID : FrameBufferID[eye]);
+			glViewport(SinglePassStereo ? eye * frameBufferWidth : 0, 0, frameBufferWidth, frameBufferHeight);
 
-			Tex2DShaderHandler.Use();
+			// The double-wide target is cleared once for both halves
+			if (!SinglePassStereo || eye == Left)
+			{
+				glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			}
 
-			glBindTexture(GL_TEXTURE_2D, contentTexture[eye]);
+			Tex2DShaderHandler.Use();
+			Tex2DShaderHandler.Set(BGSwapRBLoc, false);
+			Tex2DShaderHandler.Set(BGFlipYLoc, false);
+			Tex2DShaderHandler.Set(BGReprojLoc, IdentityMat3);
+
+			// Side-by-side: each eye samples its half of the shared content texture
+			if (StereoSideBySide)
+			{
+				Tex2DShaderHandler.Set(BGTexRectLoc, glm::vec4(0.5f * eye, 0.0f, 0.5f, 1.0f));
+				glBindTexture(GL_TEXTURE_2D, contentTexture[0]);
+			}
+			else
+			{
+				Tex2DShaderHandler.Set(BGTexRectLoc, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+				glBindTexture(GL_TEXTURE_2D, contentTexture[eye]);
+			}
 			glBindVertexArray(quadVertexArrayID[eye]);
 			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 			glBindVertexArray(0);
 			glBindTexture(GL_TEXTURE_2D, 0);
+			GPUProfiler.EndPass(GPUPassCompose);
+
+			// Single-pass stereo draws the models once, after both halves have their background
+			if (SinglePassStereo && eye != numEyes - 1)
+			{
+				continue;
+			}
+			int ModelViews = SinglePassStereo ? numEyes : 1;
+			if (SinglePassStereo)
+			{
+				glViewport(0, 0, 2 * frameBufferWidth, frameBufferHeight);
+				glEnable(GL_CLIP_DISTANCE0);
+			}
 
 			glEnable(GL_DEPTH_TEST);
 			//glDepthMask(GL_TRUE);
 
 #pragma region // Render virtual model to texture frame buffer //
+			GPUProfiler.BeginPass(GPUPassModel);
 			glEnable(GL_BLEND);
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 			ModelShaderHandler.Use();
-			glUniformMatrix4fv(SceneMatrixLocation, 1, GL_FALSE, MVPMat[eye].get());
-			glUniformMatrix4fv(ProjMatLoc, 1, GL_FALSE, glm::value_ptr(ProjMat));
-			glUniformMatrix4fv(ViewMatLoc, 1, GL_FALSE, glm::value_ptr(ViewMat));
-			glUniformMatrix4fv(ModelMatLoc, 1, GL_FALSE, glm::value_ptr(ModelMat));
-			glUniform3fv(CamPosLoc, 1, glm::value_ptr(CameraPos));
+			UniformRing.Bind(kuUniformBlock_Eye, EyeRange[SinglePassStereo ? 0 : eye]);
 
 			// Inner object first.
-			glUniform4fv(ObjColorLoc, 1, BoneColorVec);
+			UniformRing.Bind(kuUniformBlock_Object, BoneRange);
 			BoneModel.Draw(ModelShaderHandler, glm::vec3(0.3f, 0.3f, 0.3f),
 											   glm::vec3(0.5f, 0.5f, 0.5f),
-											   glm::vec3(0.3f, 0.3f, 0.3f));
+											   glm::vec3(0.3f, 0.3f, 0.3f), ModelViews);
 			//BoneModel.Draw(ModelShaderHandler);
 			
 			// Draw outside object latter
-			/*glUniform4fv(ObjColorLoc, 1, FaceColorVec);
-			FaceModel.Draw(ModelShaderHandler, glm::vec3(0.3f, 0.3f, 0.3f),
-											   glm::vec3(0.5f, 0.5f, 0.5f),
-											   glm::vec3(0.3f, 0.3f, 0.3f));*/
+			if (DrawFaceModel)
+			{
+				UniformRing.Bind(kuUniformBlock_Object, FaceRange);
+				FaceModel.Draw(ModelShaderHandler, glm::vec3(0.3f, 0.3f, 0.3f),
+												   glm::vec3(0.5f, 0.5f, 0.5f),
+												   glm::vec3(0.3f, 0.3f, 0.3f), ModelViews);
+			}
 			//FaceModel.Draw(ModelShaderHandler);
 
 			glDisable(GL_DEPTH_TEST);
+			glDisable(GL_CLIP_DISTANCE0);
 
 			glUseProgram(0);
+			GPUProfiler.EndPass(GPUPassModel);
 #pragma endregion
 		}
 #pragma endregion
+		UniformRing.EndFrame();
 
-		vr::Texture_t LTexture = { reinterpret_cast<void*>(intptr_t(SceneTextureID[Left])), vr::TextureType_OpenGL, vr::ColorSpace_Gamma };
-		vr::VRCompositor()->Submit(vr::EVREye(Left), &LTexture);
-		vr::Texture_t RTesture = { reinterpret_cast<void*>(intptr_t(SceneTextureID[Right])), vr::TextureType_OpenGL, vr::ColorSpace_Gamma };
-		vr::VRCompositor()->Submit(vr::EVREye(Right), &RTesture);
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_DrawEnd);
 
-		vr::VRCompositor()->PostPresentHandoff();
+		// Submit with the pose actually rendered with, so the compositor reprojects from the late pose
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_SubmitBegin);
+		{
+			KU_PROFILE_ZONE("submit");
+
+			if (SinglePassStereo)
+			{
+				hmd->Submit(vr::Eye_Left, StereoSceneTextureID, &StereoEyeBounds[Left], renderPose);
+				hmd->Submit(vr::Eye_Right, StereoSceneTextureID, &StereoEyeBounds[Right], renderPose);
+			}
+			else
+			{
+				hmd->Submit(vr::Eye_Left, SceneTextureID[Left], nullptr, renderPose);
+				hmd->Submit(vr::Eye_Right, SceneTextureID[Right], nullptr, renderPose);
+			}
+			hmd->PostPresentHandoff();
+		}
+		KU_TIMELINE_HMD_STAMP(kuHMDStamp_SubmitEnd);
+		KU_TIMELINE_HMD_END();
 
 		// Mirror to GLFW window
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GL_NONE);
-		glViewport(0, 0, 640, 720);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glBlitFramebuffer(0, 0, frameBufferWidth, frameBufferHeight, 0, 0, 640, 720, GL_COLOR_BUFFER_BIT, GL_LINEAR);
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, GL_NONE);
+		{
+			KU_PROFILE_ZONE("mirror");
+
+			GPUProfiler.BeginPass(GPUPassMirror);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GL_NONE);
+			glViewport(0, 0, 640, 720);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			// Right eye, the last one rendered, also from the right half of the stereo target
+			GLint mirrorSrcX = SinglePassStereo ? frameBufferWidth : 0;
+			glBlitFramebuffer(mirrorSrcX, 0, mirrorSrcX + frameBufferWidth, frameBufferHeight, 0, 0, 640, 720, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, GL_NONE);
+			GPUProfiler.EndPass(GPUPassMirror);
+		}
+
+		GPUProfiler.EndPass(GPUPassFrame);
+		GPUProfiler.EndFrame();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
+	CaptureThread.Stop();
+	camSource->Close();
+	delete camSource;
+
+	BGTexture[Left].PrintStats(StereoSideBySide ? "Stereo BG upload" : "Left BG upload");
+	BGTexture[Right].PrintStats("Right BG upload");
+	PoseProvider.PrintStats();
+	SessionRecorder.PrintStats();
+	BoneModel.PrintStats("Bone model");
+	FaceModel.PrintStats("Face model");
+	ModelShaderHandler.PrintStats("Model shader");
+	Tex2DShaderHandler.PrintStats("BG shader");
+	UniformRing.PrintStats("Uniform ring");
+	PoseProvider.CloseLog();
+	KU_TIMELINE_REPORT(FrameTimelineReport);
+	GPUProfiler.PrintStats();
+	GPUProfiler.Release();
+	KU_PROFILE_WRITE(ProfileTraceFile);
+
+	hmd->Shutdown();
+	delete hmd;
+	for (int view = 0; view < numCamViews; view++)
+	{
+		BGTexture[view].Release();
+	}
+	BoneModel.Release();
+	FaceModel.Release();
+	UniformRing.Release();
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
 
 
-vr::IVRSystem * kuOpenVRInit(uint32_t & hmdWidth, uint32_t & hmdHeight)
-{
-	vr::EVRInitError	eError = vr::VRInitError_None;
-	vr::IVRSystem	*	hmd	   = vr::VR_Init(&eError, vr::VRApplication_Scene);
-
-	if (eError != vr::VRInitError_None) {
-		fprintf(stderr, "OpenVR Initialization Error: %s\n", vr::VR_GetVRInitErrorAsEnglishDescription(eError));
-		return nullptr;
-	}
-
-	const std::string& driver = getHMDString(hmd, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_TrackingSystemName_String);		// Graphic card name
-	const std::string& model  = getHMDString(hmd, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_ModelNumber_String);				// HMD device name
-	const std::string& serial = getHMDString(hmd, vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SerialNumber_String);			// HMD device serial
-	const float freq = hmd->GetFloatTrackedDeviceProperty(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_DisplayFrequency_Float);	// HMD FPS
-																													//get the proper resolution of the hmd
-	hmd->GetRecommendedRenderTargetSize(&hmdWidth, &hmdHeight);
-
-	fprintf(stderr, "HMD: %s '%s' #%s (%d x %d @ %g Hz)\n", driver.c_str(), model.c_str(), serial.c_str(), hmdWidth, hmdHeight, freq);
-
-	// Initialize the compositor
-	vr::IVRCompositor * compositor = vr::VRCompositor();
-	if (!compositor) {
-		fprintf(stderr, "OpenVR Compositor initialization failed. See log file for details\n");
-		vr::VR_Shutdown();
-		assert("VR failed" && false);
-	}
-
-	return hmd;
-}
-
 GLFWwindow* kuOpenGLInit(int width, int height, const std::string& title, GLFWkeyfun cbfun)
 {
+	KU_PROFILE_ZONE("kuOpenGLInit");
+
 	if (!glfwInit()) {
 		fprintf(stderr, "ERROR: could not start GLFW\n");
 		::exit(1);
@@ -358,7 +723,7 @@ GLFWwindow* kuOpenGLInit(int width, int height, const std::string& title, GLFWke
 
 	// Without these, shaders actually won't initialize properly
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);						// 4.3 for the model's indirect multi-draw and storage buffer
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
@@ -411,46 +776,6 @@ GLFWwindow* kuOpenGLInit(int width, int height, const std::string& title, GLFWke
 	return window;
 }
 
-sl::ERROR_CODE kuZEDInit(sl::Camera & zedCam, sl::InitParameters initParams, sl::RuntimeParameters rtParams, sl::Mat & imgZEDLeft, sl::Mat & imgZEDRight, cv::Mat & imgCVLeft, cv::Mat & imgCVRight)
-{
-	// Initialize ZED camera initial parameters
-	initParams.camera_resolution = sl::RESOLUTION_HD720;
-	initParams.depth_mode = sl::DEPTH_MODE_QUALITY;
-	initParams.coordinate_units = sl::UNIT_MILLIMETER;
-	initParams.camera_fps = 60;
-
-	// Set ZED camera runtime parameters
-	rtParams.sensing_mode = sl::SENSING_MODE_FILL;
-
-	// Allocate memory space for ZED image
-	imgZEDLeft.alloc(ZEDImgWidth, ZEDImgHeight, sl::MAT_TYPE_8U_C4, sl::MEM_CPU);
-	imgZEDRight.alloc(ZEDImgWidth, ZEDImgHeight, sl::MAT_TYPE_8U_C4, sl::MEM_CPU);
-
-	// Set image pointer to OpenCV image
-	imgCVLeft = MatSL2CV(imgZEDLeft);
-	imgCVRight = MatSL2CV(imgZEDRight);
-
-	sl::ERROR_CODE eCode = zedCam.open(initParams);
-
-	return eCode;
-}
-
-std::string getHMDString(vr::IVRSystem * pHmd, vr::TrackedDeviceIndex_t unDevice, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError * peError)
-{
-	uint32_t unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty(unDevice, prop, nullptr, 0, peError);
-	if (unRequiredBufferLen == 0)
-	{
-		return "";
-	}
-
-	char* pchBuffer = new char[unRequiredBufferLen];
-	unRequiredBufferLen = pHmd->GetStringTrackedDeviceProperty(unDevice, prop, pchBuffer, unRequiredBufferLen, peError);
-	std::string sResult = pchBuffer;
-	delete[] pchBuffer;
-
-	return sResult;
-}
-
 void key_callback(GLFWwindow * window, int key, int scancode, int action, int mode)
 {
 	/*if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -499,46 +824,23 @@ void SetQuadVertexArrayGL(GLuint vertexArrayID, GLuint vertexBufferID, GLuint el
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-cv::Mat MatSL2CV(sl::Mat& input)
+void SetIntrinsicParams(const kuStereoCalibration &calib, cv::Mat &intrinsicParamsLeft, cv::Mat &intrinsicParamsRight, cv::Mat  &distParamsLeft, cv::Mat &distParamsRight, GLfloat intrinsicMatGL[2][16])
 {
-	// Mapping between MAT_TYPE and CV_TYPE
-	int cv_type = -1;
-	switch (input.getDataType()) {
-	case sl::MAT_TYPE_32F_C1: cv_type = CV_32FC1; break;
-	case sl::MAT_TYPE_32F_C2: cv_type = CV_32FC2; break;
-	case sl::MAT_TYPE_32F_C3: cv_type = CV_32FC3; break;
-	case sl::MAT_TYPE_32F_C4: cv_type = CV_32FC4; break;
-	case sl::MAT_TYPE_8U_C1: cv_type = CV_8UC1; break;
-	case sl::MAT_TYPE_8U_C2: cv_type = CV_8UC2; break;
-	case sl::MAT_TYPE_8U_C3: cv_type = CV_8UC3; break;
-	case sl::MAT_TYPE_8U_C4: cv_type = CV_8UC4; break;
-	default: break;
-	}
-
-	// Since cv::Mat data requires a uchar* pointer, we get the uchar1 pointer from sl::Mat (getPtr<T>())
-	// cv::Mat and sl::Mat will share a single memory structure
-	return cv::Mat((int)input.getHeight(), (int)input.getWidth(), cv_type, input.getPtr<sl::uchar1>(sl::MEM_CPU));
-}
-
-void SetIntrinsicParams(sl::Camera &zedCam, cv::Mat &intrinsicParamsLeft, cv::Mat &intrinsicParamsRight, cv::Mat  &distParamsLeft, cv::Mat &distParamsRight, GLfloat intrinsicMatGL[2][16])
-{
-	sl::CalibrationParameters calibParam = zedCam.getCameraInformation().calibration_parameters;
-
 	// Left
-	SetIntrinsicMatCV(calibParam.left_cam, intrinsicParamsLeft, distParamsLeft);
+	SetIntrinsicMatCV(calib.Eye[0], intrinsicParamsLeft, distParamsLeft);
 	IntrinsicCVtoGL(intrinsicParamsLeft, intrinsicMatGL[0]);
-	//std::cout << calibParam.left_cam.fx << " " << calibParam.left_cam.fy
-	//		  << calibParam.left_cam.cx << " " << calibParam.left_cam.cy << std::endl;
+	//std::cout << calib.Eye[0].fx << " " << calib.Eye[0].fy
+	//		  << calib.Eye[0].cx << " " << calib.Eye[0].cy << std::endl;
 
 	// Right
-	SetIntrinsicMatCV(calibParam.right_cam, intrinsicParamsRight, distParamsRight);
+	SetIntrinsicMatCV(calib.Eye[1], intrinsicParamsRight, distParamsRight);
 	IntrinsicCVtoGL(intrinsicParamsRight, intrinsicMatGL[1]);
-	//std::cout << calibParam.right_cam.fx << " " << calibParam.right_cam.fy
-	//		  << calibParam.right_cam.cx << " " << calibParam.right_cam.cy << std::endl;
+	//std::cout << calib.Eye[1].fx << " " << calib.Eye[1].fy
+	//		  << calib.Eye[1].cx << " " << calib.Eye[1].cy << std::endl;
 
 }
 
-void SetIntrinsicMatCV(sl::CameraParameters camCalibParams, cv::Mat &intrinsicParams, cv::Mat &distPrams)
+void SetIntrinsicMatCV(const kuStereoCalibration::Camera &camCalibParams, cv::Mat &intrinsicParams, cv::Mat &distPrams)
 {
 	if (intrinsicParams.empty())
 	{
@@ -560,11 +862,11 @@ void SetIntrinsicMatCV(sl::CameraParameters camCalibParams, cv::Mat &intrinsicPa
 	intrinsicParams.at<float>(2, 1) = 0.0f;
 	intrinsicParams.at<float>(2, 2) = 1.0f;
 
-	// Since ZED can directly retrive rectified camera frame, temporary set distortion factor as all zero.
-	distPrams.at<float>(0, 0) = 0.0f;
-	distPrams.at<float>(0, 1) = 0.0f;
-	distPrams.at<float>(0, 2) = 0.0f;
-	distPrams.at<float>(0, 3) = 0.0f;
+	// ZED retrieves rectified frames, so these are all zero unless a source says otherwise
+	distPrams.at<float>(0, 0) = camCalibParams.Distortion[0];
+	distPrams.at<float>(0, 1) = camCalibParams.Distortion[1];
+	distPrams.at<float>(0, 2) = camCalibParams.Distortion[2];
+	distPrams.at<float>(0, 3) = camCalibParams.Distortion[3];
 
 	std::cout << "fx: " << intrinsicParams.at<float>(0, 0)
 		<< ", fy: " << intrinsicParams.at<float>(1, 1)
@@ -638,87 +940,22 @@ void ExtrinsicCVtoGL(cv::Mat RotMat, cv::Mat TransVec, GLfloat GLModelView[16])
 	GLModelView[15] = 1;
 }
 
-void DrawBGImage(cv::Mat BGImg, kuShaderHandler BGShader)
+void DrawBGImage(GLuint BGTextureID, GLuint BGVertexArrayID, kuShaderHandler & BGShader)
 {
-	static const GLfloat BGVertices[] = {
-		1.0f,  1.0f, 1.0f, 0.0f,
-		1.0f, -1.0f, 1.0f, 1.0f,
-		-1.0f, -1.0f, 0.0f, 1.0f,
-		-1.0f,  1.0f, 0.0f, 0.0f
-	};
-
-	GLuint indices[] = { 0, 1, 3,
-		1, 2, 3 };
-
-	GLuint BGVertexArray = 0;
-	glGenVertexArrays(1, &BGVertexArray);
-	GLuint BGVertexBuffer = 0;						// Vertex Buffer Object (VBO)
-	glGenBuffers(1, &BGVertexBuffer);				// Give an ID to vertex buffer
-	GLuint BGElementBuffer = 0;						// Element Buffer Object (EBO)
-	glGenBuffers(1, &BGElementBuffer);
-
-	glBindVertexArray(BGVertexArray);
-
-	glBindBuffer(GL_ARRAY_BUFFER, BGVertexBuffer);  // Bind buffer as array buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(BGVertices), BGVertices, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, BGElementBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// Assign vertex position data
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-	// Assign texture coordinates
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)(2 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
-
 	glDisable(GL_DEPTH_TEST);
 	glDepthMask(GL_FALSE);
 
-	GLuint BGImgTextureID = CreateTexturebyImage(BGImg);
-
 	BGShader.Use();
 
-	glBindTexture(GL_TEXTURE_2D, BGImgTextureID);
+	glBindTexture(GL_TEXTURE_2D, BGTextureID);
 
-	glBindVertexArray(BGVertexArray);
+	glBindVertexArray(BGVertexArrayID);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 	glBindVertexArray(0);
 	glBindTexture(GL_TEXTURE_2D, 0);
-
-	glDeleteTextures(1, &BGImgTextureID);
-
-	glDeleteVertexArrays(1, &BGVertexArray);
-	glDeleteBuffers(1, &BGVertexBuffer);
-	glDeleteBuffers(1, &BGElementBuffer);
-}
-
-GLuint CreateTexturebyImage(cv::Mat Img)
-{
-	GLuint	texture;
-
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	// Set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// Set texture wrapping to GL_REPEAT (usually basic wrapping method)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	// Set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, Img.cols, Img.rows, 0, GL_RGB, GL_UNSIGNED_BYTE, Img.data);
-	//glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	return texture;
 }
 
-Matrix4 GetHMDMatrixPoseEye(vr::IVRSystem * hmd, vr::Hmd_Eye nEye)
+Matrix4 GetHMDMatrixPoseEye(kuHMDBackend * hmd, vr::Hmd_Eye nEye)
 {
 	//if (!hmd)
 	//	return Matrix4();
@@ -755,7 +992,7 @@ Matrix4 ConvertSteamVRMatrixToMatrix4(const vr::HmdMatrix34_t &matPose)
 	return matrixObj;
 }
 
-Matrix4 GetHMDMatrixProjectionEye(vr::IVRSystem * hmd, vr::Hmd_Eye nEye)
+Matrix4 GetHMDMatrixProjectionEye(kuHMDBackend * hmd, vr::Hmd_Eye nEye)
 {
 	if (!hmd)
 		return Matrix4();
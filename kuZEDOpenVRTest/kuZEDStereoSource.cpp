@@ -0,0 +1,138 @@
+#include "kuZEDStereoSource.h"
+
+#if KU_USE_ZED_SDK
+
+#include <string.h>
+#include <cmath>
+#include <iostream>
+
+#include "kuFrameTimeline.h"
+#include "kuTrace.h"
+
+kuZEDStereoSource::kuZEDStereoSource(int width, int height, int fps, bool sideBySide)
+	: m_Width(width), m_Height(height), m_FPS(fps), m_fSideBySide(sideBySide)
+{
+	memset(&m_Calibration, 0, sizeof(m_Calibration));
+}
+
+kuZEDStereoSource::~kuZEDStereoSource()
+{
+	this->Close();
+}
+
+bool kuZEDStereoSource::Open()
+{
+	KU_PROFILE_ZONE("kuZEDStereoSource::Open");
+
+	// Initialize ZED camera initial parameters
+	sl::InitParameters initParams;
+	switch (m_Width)
+	{
+	case 2208:	initParams.camera_resolution = sl::RESOLUTION_HD2K;		break;
+	case 1920:	initParams.camera_resolution = sl::RESOLUTION_HD1080;	break;
+	case 1280:	initParams.camera_resolution = sl::RESOLUTION_HD720;	break;
+	case 672:	initParams.camera_resolution = sl::RESOLUTION_VGA;		break;
+	default:
+		std::cout << "ZED: no camera resolution with width " << m_Width << std::endl;
+		return false;
+	}
+	initParams.depth_mode		= sl::DEPTH_MODE_QUALITY;
+	initParams.coordinate_units = sl::UNIT_MILLIMETER;
+	initParams.camera_fps		= m_FPS;
+
+	// Set ZED camera runtime parameters
+	m_RuntimeParams.sensing_mode = sl::SENSING_MODE_FILL;
+
+	// Image memory is owned by the capture thread, Grab() retrieves into it
+	if (m_Camera.open(initParams) != sl::SUCCESS)
+	{
+		std::cout << "ZED: cannot open camera." << std::endl;
+		return false;
+	}
+
+	// Rectified images, so the distortion coefficients stay zero
+	sl::CalibrationParameters calibParams = m_Camera.getCameraInformation().calibration_parameters;
+	const sl::CameraParameters * camParams[2] = { &calibParams.left_cam, &calibParams.right_cam };
+	for (int eye = 0; eye < 2; eye++)
+	{
+		m_Calibration.Eye[eye].fx = camParams[eye]->fx;
+		m_Calibration.Eye[eye].fy = camParams[eye]->fy;
+		m_Calibration.Eye[eye].cx = camParams[eye]->cx;
+		m_Calibration.Eye[eye].cy = camParams[eye]->cy;
+	}
+	m_Calibration.Baseline = fabsf(calibParams.T.x);
+	m_Calibration.Width	   = m_Width;
+	m_Calibration.Height   = m_Height;
+
+	return true;
+}
+
+void kuZEDStereoSource::Close()
+{
+	if (m_Camera.isOpened())
+	{
+		m_Camera.close();
+	}
+}
+
+const char * kuZEDStereoSource::GetName()
+{
+	return "ZED";
+}
+
+bool kuZEDStereoSource::Grab(kuStereoFrame & frame)
+{
+	if (m_Camera.grab(m_RuntimeParams) != sl::SUCCESS)
+	{
+		return false;
+	}
+	KU_TIMELINE_CAM_STAMP(kuCamStamp_GrabEnd);
+
+	// Wrap the frame memory so retrieveImage writes into it without an extra copy
+	if (m_fSideBySide)
+	{
+		sl::Mat imgZEDStereo(2 * m_Width, m_Height, sl::MAT_TYPE_8U_C4, frame.Image[0].data, frame.Image[0].step, sl::MEM_CPU);
+
+		m_Camera.retrieveImage(imgZEDStereo, sl::VIEW_SIDE_BY_SIDE, sl::MEM_CPU);
+	}
+	else
+	{
+		sl::Mat imgZEDLeft(m_Width, m_Height, sl::MAT_TYPE_8U_C4, frame.Image[0].data, frame.Image[0].step, sl::MEM_CPU);
+		sl::Mat imgZEDRight(m_Width, m_Height, sl::MAT_TYPE_8U_C4, frame.Image[1].data, frame.Image[1].step, sl::MEM_CPU);
+
+		m_Camera.retrieveImage(imgZEDLeft, sl::VIEW_LEFT, sl::MEM_CPU);
+		m_Camera.retrieveImage(imgZEDRight, sl::VIEW_RIGHT, sl::MEM_CPU);
+	}
+
+	frame.CaptureTimestamp	= m_Camera.getTimestamp(sl::TIME_REFERENCE_IMAGE);
+	frame.ExposureTimestamp = kuSystemTimeToHostNs(frame.CaptureTimestamp);
+
+	return true;
+}
+
+int kuZEDStereoSource::GetWidth()
+{
+	return m_Width;
+}
+
+int kuZEDStereoSource::GetHeight()
+{
+	return m_Height;
+}
+
+double kuZEDStereoSource::GetFrameRate()
+{
+	return m_FPS;
+}
+
+const kuStereoCalibration & kuZEDStereoSource::GetCalibration()
+{
+	return m_Calibration;
+}
+
+bool kuZEDStereoSource::IsSideBySide()
+{
+	return m_fSideBySide;
+}
+
+#endif // KU_USE_ZED_SDK
@@ -0,0 +1,46 @@
+#ifndef KU_ZEDSTEREOSOURCE_H
+#define KU_ZEDSTEREOSOURCE_H
+
+#pragma once
+
+#ifndef KU_USE_ZED_SDK
+#define KU_USE_ZED_SDK	1										// 0: build without the ZED SDK, kuZEDStereoSource is left out
+#endif
+
+#include "kuStereoSource.h"
+
+#if KU_USE_ZED_SDK
+
+#include <sl_zed/Camera.hpp>
+
+// ZED camera, grab + retrieveImage straight into the frame memory.
+class kuZEDStereoSource : public kuStereoSource
+{
+public:
+	kuZEDStereoSource(int width, int height, int fps, bool sideBySide = false);
+	~kuZEDStereoSource();
+
+	bool							Open();
+	void							Close();
+	const char					*	GetName();
+
+	bool							Grab(kuStereoFrame & frame);
+	int								GetWidth();
+	int								GetHeight();
+	double							GetFrameRate();
+	const kuStereoCalibration	&	GetCalibration();
+	bool							IsSideBySide();
+
+private:
+	sl::Camera				m_Camera;
+	sl::RuntimeParameters	m_RuntimeParams;
+	kuStereoCalibration		m_Calibration;
+	int						m_Width;
+	int						m_Height;
+	int						m_FPS;
+	bool					m_fSideBySide;
+};
+
+#endif // KU_USE_ZED_SDK
+
+#endif // !KU_ZEDSTEREOSOURCE_H